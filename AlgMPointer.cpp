@@ -9,6 +9,10 @@
 
 #include "Common.h"
 #include "AlgMPointer.h"
+#include "Trace.h"
+#include "SearchProfile.h"
+#include "PerfCounters.h"
+#include "Benchmark.h"
 
 using namespace std;
 ///////////////////////////////////////////////////////////////////////////////
@@ -16,12 +20,12 @@ using namespace std;
 // MCell
 //
 ///////////////////////////////////////////////////////////////////////////////
-void MCell::format(std::ostream& stream) const
+void AlgMPointer::formatSequence(const MCell* pcell_in_sequence, std::ostream& stream) const
 {
-	const MCell* pstart = this;
+	const MCell* pstart = pcell_in_sequence;
 	// Start from a consistent point in the sequence. If the cells are block allocated in
 	// order (and they are), this will start from the first cell:
-	while (pstart->pLeft < this)
+	while (pstart->pLeft < pcell_in_sequence)
 		pstart = pstart->pLeft;
 
 
@@ -31,33 +35,29 @@ void MCell::format(std::ostream& stream) const
 		if (pcell != pstart)
 			stream << " ";
 
-		stream << pcell->pTop->pName;
+		stream << top(pcell)->pName;
 
-		const char* pcolor = nullptr;
-		if (pcell->pColor)
-		{
-			pcolor = pcell->pColor;
-		}
-		else
+		int color = pcell->Color;
+		if (!color)
 		{
 			// If some other sequence has activated this cell's color, the cell color
-			// get null'd out. The color is in the item:
-			pcolor = pcell->pTop->pColor;
+			// get zeroed out. The color is in the item:
+			color = top(pcell)->Color;
 		}
 
-		if (pcolor)
+		if (color)
 		{
-			stream << ":" << pcolor;
+			stream << ":" << colorName(color);
 		}
 
 		pcell = pcell->pRight;
 	} while (pcell != pstart);
 }
 ///////////////////////////////////////////////////////////////////////////////
-const char* MCell::format() const
+const char* AlgMPointer::formatSequence(const MCell* pcell) const
 {
 	std::ostringstream buf;
-	format(buf);
+	formatSequence(pcell, buf);
 	static char cbuf[1024];
 	auto l = std::min(buf.str().length(), sizeof(cbuf) - 1);
 	memcpy(cbuf, buf.str().c_str(), l);
@@ -66,116 +66,83 @@ const char* MCell::format() const
 	return cbuf;
 }
 ///////////////////////////////////////////////////////////////////////////////
-//
-// AlgMChecksum
-//
-///////////////////////////////////////////////////////////////////////////////
-AlgMChecksum::AlgMChecksum()
-{
-	memset(this, 0, sizeof(*this));
-}
-///////////////////////////////////////////////////////////////////////////////
-AlgMChecksum::~AlgMChecksum()
-{
-	delete[] pHeaders;
-	delete[] pCells;
-}
-///////////////////////////////////////////////////////////////////////////////
-void AlgMChecksum::init(const AlgMPointer& alg)
-{
-	pHeaders = new ItemHeader[alg.TotalItems];
-	pCells = new MCell[alg.TotalCells];
-}
-///////////////////////////////////////////////////////////////////////////////
-void AlgMChecksum::checksum(const AlgMPointer &alg)
-{
-	memcpy(pHeaders, alg.pHeaders, alg.TotalItems * sizeof(ItemHeader));
-	memcpy(pCells, alg.pCells, alg.TotalCells * sizeof(MCell));
-	
-}
-///////////////////////////////////////////////////////////////////////////////
+// Cloning copies the items and cells in bulk. The pointers in the copy would still
+// point into the original, so they are moved by the distance between the arenas
+// as we go. Doing it in the same pass as the copy means the arenas are only
+// walked once.
 template<class T>
-static bool check_and_report (int idx, const char *pname, const T & t1, const T& t2)
+static inline T* rebase(T* p, ptrdiff_t delta)
 {
-	if (t1 == t2)
-		return true;
-
-	cout << "index " << idx << " " << pname << " differs." << endl;
-	return false;
+	return p ? (T*)((char*)p + delta) : nullptr;
 }
 
-bool AlgMChecksum::compare(const AlgMChecksum& other, const AlgMPointer& alg) const
+static void copy_arena(ItemHeader* pheaders, MCell* pcells, const ItemHeader* psrc_headers, const MCell* psrc_cells,
+	size_t nitems, size_t ncells, ptrdiff_t header_delta, ptrdiff_t cell_delta)
 {
-	bool same = true;
-	for (int i = 0; i < alg.TotalItems; i++)
-	{
-
-#define CHECK_HEADER(field) same = same && check_and_report(i, #field, pHeaders[i].field, other.pHeaders[i].field);
-			CHECK_HEADER(pName)
-			CHECK_HEADER(pPrevActive)
-			CHECK_HEADER(pNextActive)
-			CHECK_HEADER(pTopCell)
-			CHECK_HEADER(Min)
-			CHECK_HEADER(Max)
-			CHECK_HEADER(UsedCount)
-			CHECK_HEADER(AvailableSequences)
-			CHECK_HEADER(pColor)
+	memcpy(pheaders, psrc_headers, nitems * sizeof(ItemHeader));
+	for (size_t i = 0; i < nitems; i++)
+	{
+		pheaders[i].pPrevActive = rebase(pheaders[i].pPrevActive, header_delta);
+		pheaders[i].pNextActive = rebase(pheaders[i].pNextActive, header_delta);
+		pheaders[i].pTopCell = rebase(pheaders[i].pTopCell, cell_delta);
 	}
 
-	for (int i = 0; i < alg.TotalCells; i++)
+	for (size_t i = 0; i < ncells; i++)
 	{
-#define CHECK_CELL(field) same = same && check_and_report(i, #field, pCells[i].field, other.pCells[i].field);
-		CHECK_CELL(pTop)
-			CHECK_CELL(pColor)
-			CHECK_CELL(pLeft)
-			CHECK_CELL(pRight)
-			CHECK_CELL(pUp)
-			CHECK_CELL(pDown)
+		const MCell& src = psrc_cells[i];
+		MCell& cell = pcells[i];
+		cell.pUp = rebase(src.pUp, cell_delta);
+		cell.pDown = rebase(src.pDown, cell_delta);
+		cell.Top = src.Top;
+		cell.Color = src.Color;
+		cell.pLeft = rebase(src.pLeft, cell_delta);
+		cell.pRight = rebase(src.pRight, cell_delta);
 	}
-	return same;
 }
 ///////////////////////////////////////////////////////////////////////////////
 //
-// AlgMPointer
+// Restore check
 //
 ///////////////////////////////////////////////////////////////////////////////
-AlgMPointer::~AlgMPointer()
+void AlgMPointer::restoreFailed()
 {
-	delete[] pHeaders;
-	delete[] pCells;
-	delete[] pLevelState;
-
-#ifndef NDEBUG
-	delete[] pChecksums;
-#endif
-}
-///////////////////////////////////////////////////////////////////////////////
-ItemHeader* AlgMPointer::getItem(const char* pc, size_t len)
-{
-	for (int i = 0; i < TotalItems; i++)
+	if (RestoreFailures == 0)
 	{
-		if (memcmp(pc, pHeaders[i].pName, len) == 0 && pHeaders[i].pName[len] == 0)
-		{
-			return pHeaders + i;
-		}
+		cout << "Restore check failed at level " << CurLevel << " after " << loopCount << " loops." << endl;
 	}
+	RestoreFailures++;
 	assert(false);
-	return nullptr;
 }
 ///////////////////////////////////////////////////////////////////////////////
-const char* AlgMPointer::getColor(const char* pc)
+//
+// Trace
+//
+///////////////////////////////////////////////////////////////////////////////
+void AlgMPointer::traceState(TraceBuffer* ptrace, const LevelState& state) const
 {
-	// For consistency in asserts and checkums, we would like all colors to use
-	// the same pointer. A sequence item could reference a color (e.g. "x:red")
-	// with a unique address. This routine converts such a pointer to one from
-	// the input problem. 
-	for (auto pproblem_color : Problem.colors)
-	{
-		if (strcmp(pc, pproblem_color) == 0)
-			return pproblem_color;
-	}
-	assert(false);
-	return nullptr;
+	// The item is only chosen once the level has been entered, and the cell is only
+	// meaningful while we are trying cells:
+	int item = -1, cell = -1;
+	if (state.Action >= ag_TryX && state.Action <= ag_Restore)
+		item = (int) (state.pItem - pHeaders);
+	if (state.Action >= ag_TryX && state.Action <= ag_TweakNext && state.pCurCell)
+		cell = (int) (state.pCurCell - pCells);
+
+	ptrace->record(loopCount, CurLevel, state.Action, item, cell);
+}
+///////////////////////////////////////////////////////////////////////////////
+//
+// AlgMPointer
+//
+///////////////////////////////////////////////////////////////////////////////
+AlgMPointer::~AlgMPointer()
+{
+	// The headers, cells and levels go with the arena.
+}
+///////////////////////////////////////////////////////////////////////////////
+const char* AlgMPointer::colorName(int color) const
+{
+	return color ? pProblem->ColorNames[color - 1] : nullptr;
 }
 ///////////////////////////////////////////////////////////////////////////////
 bool AlgMPointer::isLinked(const ItemHeader* pitem) const
@@ -209,7 +176,7 @@ void AlgMPointer::assertValid() const
 
 		if (pitem->pTopCell)
 		{
-			assert(pitem->pTopCell->pTop == pitem);
+			assert(top(pitem->pTopCell) == pitem);
 		}
 
 		if (pitem->isPrimary())
@@ -222,7 +189,7 @@ void AlgMPointer::assertValid() const
 
 			if (islinked)
 			{
-				assert(pitem->UsedCount < pitem->Min);
+				assert(pitem->UsedCount < pitem->Max);
 			}
 			
 		}
@@ -230,35 +197,232 @@ void AlgMPointer::assertValid() const
 	}
 }
 ///////////////////////////////////////////////////////////////////////////////
-void AlgMPointer::testChecksum()
+AlgMPointer::AlgMPointer()
 {
-#ifndef NDEBUG
-	tempChecksum.checksum(*this);
+	pProblem = nullptr;
+	pFirstActiveItem = nullptr;
+	HasMultiplicities = HasColors = false;
+
+	TotalItems = TotalCells = 0;
+	MaxItems = 0;
+	pHeaders = nullptr;
+	pCells = nullptr;
+	pLevelState = nullptr;
+	pCellSequence = pSequenceStart = nullptr;
+	SequenceTableCapacity = 0;
+
+	CurLevel = 0;
+	NonSharpPreference = false;
+	MinimizeCost = false;
+	Verbose = true;
+	CurCost = 0;
+	ForcedCost = 0;
+
+	ShardDepth = 0;
+	pShardPrefixes = nullptr;
+	pChoicePrefix = nullptr;
+	Stopping = false;
+	pCancel = nullptr;
+	pTrace = nullptr;
+	pProfile = nullptr;
+	pCounts = nullptr;
+	pPerf = nullptr;
+	Cancelled = false;
+	PrefixMismatch = false;
+
+	Solutions = 0;
+	setupTime = runTime = 0;
+	loopCount = levelCount = 0;
+
+	// Cheap, but not free, so only on by default in a debug build:
+#ifdef NDEBUG
+	CheckRestore = false;
+#else
+	CheckRestore = true;
 #endif
+	RestoreHash = 0;
+	RestoreFailures = 0;
+}
+///////////////////////////////////////////////////////////////////////////////
+AlgMPointer::AlgMPointer(const ExactCoverWithMultiplicitiesAndColors& problem) : AlgMPointer()
+{
+	reset(problem);
+}
+///////////////////////////////////////////////////////////////////////////////
+AlgMPointer::AlgMPointer(const CompactExactCover& problem) : AlgMPointer()
+{
+	reset(problem);
+}
+///////////////////////////////////////////////////////////////////////////////
+void AlgMPointer::reset(const ExactCoverWithMultiplicitiesAndColors& problem)
+{
+	problem.assertValid();
+	auto start_time= std::chrono::high_resolution_clock::now();
+	if (pPerf)
+		pPerf->start();
 
+	// A clone may still be using the last one:
+	if (!pConverted || pConverted.use_count() > 1)
+		pConverted = std::make_shared<CompactExactCover>();
+	pConverted->assign(problem);
+	build(*pConverted);
 
-	assert(pChecksums[CurLevel].compare(tempChecksum, *this));
+	auto end_time = std::chrono::high_resolution_clock::now();
+	setupTime =  (long) std::chrono::duration_cast<std::chrono::microseconds>(end_time - start_time).count();
+	if (pPerf)
+		pPerf->stop(&pPerf->Setup);
 }
 ///////////////////////////////////////////////////////////////////////////////
-AlgMPointer::AlgMPointer(const ExactCoverWithMultiplicitiesAndColors& problem) : Problem(problem)
+void AlgMPointer::reset(const CompactExactCover& problem)
 {
-	Problem.assertValid();
+	problem.assertValid();
 	auto start_time= std::chrono::high_resolution_clock::now();
+	if (pPerf)
+		pPerf->start();
+
+	build(problem);
+
+	auto end_time = std::chrono::high_resolution_clock::now();
+	setupTime =  (long) std::chrono::duration_cast<std::chrono::microseconds>(end_time - start_time).count();
+	if (pPerf)
+		pPerf->stop(&pPerf->Setup);
+}
+///////////////////////////////////////////////////////////////////////////////
+class AlgMPointer::CellBuilder : public CellSink
+{
+	AlgMPointer& Alg;
+	const CompactExactCover& Problem;
+	MCell* pCell;		// The next one to fill in,
+	MCell* pFirst;		// the first of the sequence,
+	MCell* pPrev;		// and the one before pCell in it.
+	int Sequence = 0;
+	int Primary = 0;	// Cells in the sequence with a primary item.
+
+public:
+	CellBuilder(AlgMPointer& alg, const CompactExactCover& problem) :
+		Alg(alg), Problem(problem), pCell(alg.pCells), pFirst(alg.pCells), pPrev(nullptr) {}
+
+	int sequences() const { return Sequence; }
+	int cells() const { return (int)(pCell - Alg.pCells); }
+
+	void addCell(int item, int color) override
+	{
+		assert(pCell - Alg.pCells < Alg.TotalCells);
+		ItemHeader* pitem = Alg.pHeaders + item;
+		pCell->Color = color;
+		if (color)
+			Alg.HasColors = true;
+
+#if LINK_TOP
+		// It would be easiest to just link the new cell at the top of the list.
+		// However, to match AlgorithmX more closely, we should link at the bottom. This
+		// will produce the same sequence of choices.
+		pCell->pDown = pitem->pTopCell;
+
+		if (pitem->pTopCell)
+		{
+			pitem->pTopCell->pUp = pCell;
+		}
+		pitem->pTopCell = pCell;
+#else
+		MCell*& plast = Alg.LastCells[item];
+		if (plast)
+		{
+			plast->pDown = pCell;
+			pCell->pUp = plast;
+		}
+		else 
+			pitem->pTopCell = pCell;
+		plast = pCell;
+#endif
+
+		pCell->Top = item;
+		pitem->AvailableSequences++;
+
+		Alg.pCellSequence[pCell - Alg.pCells] = Sequence;	// Save for lookup when we find a solution.
+		if (pitem->isPrimary())
+			Primary++;
+
+		if (pPrev)
+		{
+			pPrev->pRight = pCell;
+		}
+		pCell->pLeft = pPrev;
+
+		pPrev = pCell;
+
+		pCell++;
+	}
+
+	void endSequence() override
+	{
+		Alg.pSequenceStart[Sequence] = (int)(pFirst - Alg.pCells);
+
+		pPrev->pRight = pFirst;	// Complete the circular linking.
+		pFirst->pLeft = pPrev;
+
+		// Split the sequence cost evenly between its primary items. Each use of an item
+		// costs at least its smallest share, which gives the lower bound used for pruning:
+		if (Primary > 0)
+		{
+			int share = Problem.sequenceCost(Sequence) / Primary;
+			for (MCell* pseq = pFirst; pseq != pCell; pseq++)
+			{
+				ItemHeader* pitem = Alg.top(pseq);
+				if (pitem->isPrimary() && (pitem->AvailableSequences == 1 || share < pitem->MinCost))
+				{
+					pitem->MinCost = share;
+				}
+			}
+		}
+
+		Sequence++;
+		Primary = 0;
+		pFirst = pCell;
+		pPrev = nullptr;
+	}
+};
+///////////////////////////////////////////////////////////////////////////////
+void AlgMPointer::build(const CompactExactCover& problem)
+{
+	pProblem = &problem;
+
+	// Anything forced was part of the old structure:
+	ForcedSequences.clear();
+	ForcedCost = 0;
+
+	TotalItems = problem.items();
+	TotalCells = problem.cells();
+
+	// Each level takes one off an item's bound, and either uses a sequence or finishes the
+	// item without one, so a large multiplicity doesn't make the search any deeper:
+	long long max_bound = 0;
+	for (int i = 0; i < problem.PrimaryItems; i++)
+		max_bound += problem.Max[i];
+	MaxItems = (int)min(max_bound, (long long)problem.sequences() + problem.PrimaryItems);
+
+	// The headers, cells and levels are laid out together in the arena. Longest possible
+	// solution is max items, and we could go 1 level deeper:
+	Arena.begin(PageArena::bytesFor<ItemHeader>(TotalItems) + PageArena::bytesFor<MCell>(TotalCells) +
+				PageArena::bytesFor<LevelState>(MaxItems + 1));
+	pHeaders = Arena.allocate<ItemHeader>(TotalItems);
+	pCells = Arena.allocate<MCell>(TotalCells);
+	pLevelState = Arena.allocate<LevelState>(MaxItems + 1);
 
-	TotalItems = (Problem.primary_options.size() + Problem.secondary_options.size());
-	pHeaders = new ItemHeader[TotalItems];
+	memset(pHeaders, 0, TotalItems * sizeof(ItemHeader));
 
 	ItemHeader *pheader = pHeaders;
 	ItemHeader* prev = nullptr;
-	MaxItems = 0;
 	 
-	for (int i = 0; i < Problem.primary_options.size(); i++)
+	HasMultiplicities = HasColors = false;
+	for (int i = 0; i < problem.PrimaryItems; i++)
 	{
-		pheader->pName = Problem.primary_options[i].pValue;
-		pheader->Max = Problem.primary_options[i].v;
-		pheader->Min = Problem.primary_options[i].u;
+		pheader->pName = problem.ItemNames[i];
+		pheader->Max = problem.Max[i];
+		pheader->Min = problem.Min[i];
+		if (pheader->Min != 1 || pheader->Max != 1)
+			HasMultiplicities = true;
 
-		MaxItems += pheader->Max;
 		pheader->pPrevActive = prev;
 		if (prev)
 			prev->pNextActive = pheader;
@@ -267,132 +431,136 @@ AlgMPointer::AlgMPointer(const ExactCoverWithMultiplicitiesAndColors& problem) :
 	}
 	pFirstActiveItem = pHeaders;
 
-	for (int i = 0; i < Problem.secondary_options.size(); i++)
+	for (int i = problem.PrimaryItems; i < TotalItems; i++)
 	{
-		pheader->pName = Problem.secondary_options[i];
+		pheader->pName = problem.ItemNames[i];
 		pheader->Min = pheader->Max = -1;
 
 		pheader++;
 	}
 
+	// The last cell in each item's list, so new cells can be linked at the bottom:
+	LastCells.assign(TotalItems, nullptr);
 
-	TotalCells = 0;
-	for (int i = 0; i < Problem.sequences.size(); i++)
-	{
-		TotalCells += Problem.sequences[i].size();
-	}
-
-	pCells = new MCell[TotalCells];
+	memset(pCells, 0, TotalCells * sizeof(MCell));
 
-	MCell *pcell = pCells;
-	
-	for (int i = 0; i < Problem.sequences.size(); i++)
+	// A clone may still be using the old tables:
+	size_t table_size = TotalCells + problem.sequences();
+	if (table_size > SequenceTableCapacity || pSequenceTables.use_count() > 1)
 	{
-		const vector<const char*>& seq = Problem.sequences[i];
-
-		MCell* pprev = nullptr;
-		MCell* pfirst = pcell;
-
-		SequenceMap[pcell] = i;	// Save for lookup when we find a solution.
-
-
-		for (const char* pc : seq)
-		{
-			const char* sep = strchr(pc, ':');
-			size_t len;
-			if (sep)
-			{
-				len = sep - pc;
-				pcell->pColor = getColor(sep + 1);
-			}
-			else
-			{
-				len = strlen(pc);
-				pcell->pColor = nullptr;
-			}
-
-			ItemHeader* pitem = getItem(pc, len);
-			
-#if LINK_TOP
-			// It would be easiest to just link the new cell at the top of the list.
-			// However, to match AlgorithmX more closely, we should link at the bottom. This
-			// will produce the same sequence of choices.
-			pcell->pDown = pitem->pTopCell;
-
-			if (pitem->pTopCell)
-			{
-				pitem->pTopCell->pUp = pcell;
-			}
-			pitem->pTopCell = pcell;
-#else
-			if (pitem->pTopCell)
-			{
-				MCell* pexisting = pitem->pTopCell;
-				while (pexisting->pDown)
-				{
-					pexisting = pexisting->pDown;
-				}
-				pexisting->pDown = pcell;
-				pcell->pUp = pexisting;
-			}
-			else 
-				pitem->pTopCell = pcell;
-#endif
-
-			pcell->pTop = pitem;
-			pitem->AvailableSequences++;
+		pSequenceTables.reset(new int[table_size], std::default_delete<int[]>());
+		SequenceTableCapacity = table_size;
+	}
+	pCellSequence = pSequenceTables.get();
+	pSequenceStart = pCellSequence + TotalCells;
 
-			if (pprev)
-			{
-				pprev->pRight = pcell;
-			}
-			pcell->pLeft = pprev;
+	// A streamed problem's cells only ever exist here:
+	CellBuilder builder(*this, problem);
+	problem.emitCells(builder);
+	assert(builder.sequences() == problem.sequences() && builder.cells() == TotalCells);
 
-			pprev = pcell;
+	CurLevel = 0;
+	memset(pLevelState, 0, (MaxItems + 1) * sizeof(LevelState));
+	CurCost = 0;
 
-			pcell++;
-		}
+	// The hash only tracks changes from here on:
+	RestoreHash = 0;
 
-		pprev->pRight = pfirst;	// Complete the circular linking.
-		pfirst->pLeft = pprev;
+	assert(_CrtCheckMemory());
+}
+///////////////////////////////////////////////////////////////////////////////
+AlgMPointer::AlgMPointer(const AlgMPointer& other) : pProblem(other.pProblem), pConverted(other.pConverted)
+{
+	auto start_time = std::chrono::high_resolution_clock::now();
 
+	TotalItems = other.TotalItems;
+	TotalCells = other.TotalCells;
+	MaxItems = other.MaxItems;
+
+	// The clone's arena is set up like the original's, on the thread making the clone:
+	Arena.setHugePages(other.Arena.hugePages());
+	Arena.setFirstTouch(other.Arena.firstTouch());
+	Arena.begin(PageArena::bytesFor<ItemHeader>(TotalItems) + PageArena::bytesFor<MCell>(TotalCells) +
+				PageArena::bytesFor<LevelState>(MaxItems + 1));
+	pHeaders = Arena.allocate<ItemHeader>(TotalItems);
+	pCells = Arena.allocate<MCell>(TotalCells);
+
+	ptrdiff_t header_delta = (char*)pHeaders - (char*)other.pHeaders;
+	ptrdiff_t cell_delta = (char*)pCells - (char*)other.pCells;
+	copy_arena(pHeaders, pCells, other.pHeaders, other.pCells, TotalItems, TotalCells, header_delta, cell_delta);
+
+	pFirstActiveItem = rebase(other.pFirstActiveItem, header_delta);
+
+	pSequenceTables = other.pSequenceTables;
+	pCellSequence = other.pCellSequence;
+	pSequenceStart = other.pSequenceStart;
+	SequenceTableCapacity = other.SequenceTableCapacity;
+
+	ForcedSequences = other.ForcedSequences;
+	ForcedCost = other.ForcedCost;
+
+	// Every search starts again from level 0, so a clone can't carry on a search in
+	// progress; it's made between searches. The levels are copied all the same, which
+	// keeps the clone an exact copy:
+	CurLevel = other.CurLevel;
+	pLevelState = Arena.allocate<LevelState>(MaxItems + 1);
+	memcpy(pLevelState, other.pLevelState, (MaxItems + 1) * sizeof(LevelState));
+	for (int i = 0; i <= MaxItems; i++)
+	{
+		pLevelState[i].pItem = rebase(pLevelState[i].pItem, header_delta);
+		pLevelState[i].pCurCell = rebase(pLevelState[i].pCurCell, cell_delta);
+		pLevelState[i].pStartingCell = rebase(pLevelState[i].pStartingCell, cell_delta);
 	}
 
-	CurLevel = 0;
-	// Longest possible solution is max items, and we could go 1 level deeper:
-	pLevelState = new LevelState[MaxItems + 1];
+	HasMultiplicities = other.HasMultiplicities;
+	HasColors = other.HasColors;
+	NonSharpPreference = other.NonSharpPreference;
+	MinimizeCost = other.MinimizeCost;
+	Verbose = other.Verbose;
+	CurCost = other.CurCost;
+
+	ShardDepth = 0;
+	pShardPrefixes = nullptr;
+	pChoicePrefix = nullptr;
+	Stopping = false;
+	pCancel = nullptr;		// The clone is usually for another request, with its own token.
+	pTrace = nullptr;		// Buffers can't be shared between threads.
+	pProfile = nullptr;		// Nor can profiles.
+	pCounts = nullptr;
+	pPerf = nullptr;		// The counters only count the thread that opened them.
+	Sink = nullptr;			// The sink is for the request, like the token.
+	Cancelled = false;
+	PrefixMismatch = false;
 
-	NonSharpPreference = false;
-
-#ifndef NDEBUG
-	pChecksums = new AlgMChecksum[MaxItems + 1];
-	for (int i = 0; i < MaxItems + 1; i++)
-		pChecksums[i].init(*this);
+	Solutions = 0;
+	runTime = 0;
+	loopCount = levelCount = 0;
 
-	tempChecksum.init(*this);
-#endif
+	// The hashes don't depend on where the arenas are, so they carry over. The ones
+	// saved for each level came with pLevelState:
+	CheckRestore = other.CheckRestore;
+	RestoreHash = other.RestoreHash;
+	RestoreFailures = 0;
 
 	auto end_time = std::chrono::high_resolution_clock::now();
-	setupTime =  (long) std::chrono::duration_cast<std::chrono::microseconds>(end_time - start_time).count();
-
-	assert(_CrtCheckMemory());
+	setupTime = (long)std::chrono::duration_cast<std::chrono::microseconds>(end_time - start_time).count();
 }
 ///////////////////////////////////////////////////////////////////////////////
 void AlgMPointer::unlinkCellVertically(MCell* pcell)
 {
-	pcell->pTop->AvailableSequences--;
+	setField(top(pcell)->AvailableSequences, top(pcell)->AvailableSequences - 1);
 	if (pcell->pUp)
 	{
-		pcell->pUp->pDown = pcell->pDown;
+		setField(pcell->pUp->pDown, pcell->pDown);
 	}
 	else
 	{
-		pcell->pTop->pTopCell = pcell->pDown;
+		setField(top(pcell)->pTopCell, pcell->pDown);
 	}
 
 	if (pcell->pDown)
 	{
-		pcell->pDown->pUp = pcell->pUp;
+		setField(pcell->pDown->pUp, pcell->pUp);
 	}
 }
 ///////////////////////////////////////////////////////////////////////////////
@@ -400,18 +568,18 @@ void AlgMPointer::relinkCellVertically(MCell* pcell)
 {
 	if (pcell->pUp)
 	{
-		pcell->pUp->pDown = pcell;
+		setField(pcell->pUp->pDown, pcell);
 	}
 	else
 	{
-		pcell->pTop->pTopCell = pcell;
+		setField(top(pcell)->pTopCell, pcell);
 	}
 
 	if (pcell->pDown)
 	{
-		pcell->pDown->pUp = pcell;
+		setField(pcell->pDown->pUp, pcell);
 	}
-	pcell->pTop->AvailableSequences++;
+	setField(top(pcell)->AvailableSequences, top(pcell)->AvailableSequences + 1);
 }
 ///////////////////////////////////////////////////////////////////////////////
 void AlgMPointer::unlinkItem(ItemHeader *pitem)
@@ -420,72 +588,76 @@ void AlgMPointer::unlinkItem(ItemHeader *pitem)
 
 	if (pitem == pFirstActiveItem)
 	{
-		pFirstActiveItem = pitem->pNextActive;
+		setFirstActiveItem(pitem->pNextActive);
 		assert(pitem->pPrevActive == nullptr);
 	}
 	else
 	{
 		assert(pitem->pPrevActive);
-		pitem->pPrevActive->pNextActive = pitem->pNextActive;
+		setField(pitem->pPrevActive->pNextActive, pitem->pNextActive);
 	}
 
 	if (pitem->pNextActive)
-		pitem->pNextActive->pPrevActive = pitem->pPrevActive;
+		setField(pitem->pNextActive->pPrevActive, pitem->pPrevActive);
 }
 ///////////////////////////////////////////////////////////////////////////////
+template<bool Profiling>
 void AlgMPointer::cover(ItemHeader* pitem)
 {
 	MCell* pcell = pitem->pTopCell;
 
 	while (pcell)
 	{
-		hide(pcell);
+		hide<Profiling>(pcell);
 		pcell = pcell->pDown;
 	};
 	
 }
 ///////////////////////////////////////////////////////////////////////////////
+template<bool Profiling, bool Multiplicities, bool Colors>
 void AlgMPointer::sequenceUsed(MCell* pcell)
 {
 	for (MCell* pright = pcell->pRight; pright != pcell; pright = pright->pRight)
 	{
-		pright->pTop->UsedCount++;
+		setField(top(pright)->UsedCount, top(pright)->UsedCount + 1);
 
-		if (pright->pColor)
+		if (Colors && pright->Color)
 		{
-			setcolor(pright);
+			setcolor<Profiling>(pright);
 		}
 		else
 		{
-			deactivateOrCover(pright->pTop);
+			deactivateOrCover<Profiling, Multiplicities>(top(pright));
 		}
 	}
 }
 ///////////////////////////////////////////////////////////////////////////////
+template<bool Profiling>
 void AlgMPointer::setcolor(MCell* pcell)
 {
-	assert(pcell->pTop->pColor == nullptr);  // Should not have been assigned yet
-	pcell->pTop->pColor = pcell->pColor;
+	assert(top(pcell)->Color == 0);  // Should not have been assigned yet
+	setField(top(pcell)->Color, pcell->Color);
 
-	for (MCell *plinked = pcell->pTop->pTopCell; plinked; plinked = plinked->pDown)
+	for (MCell *plinked = top(pcell)->pTopCell; plinked; plinked = plinked->pDown)
 	{
-		assert(plinked->pColor != nullptr);
-		if (plinked->pColor == pcell->pColor)
+		assert(plinked->Color != 0);
+		if (plinked->Color == pcell->Color)
 		{
 			// This cell matches the chosen cell's color. We can continue using the
-			// corresponding sequence, but set the color to null so we won't have to
+			// corresponding sequence, but set the color to 0 so we won't have to
 			// check in the future.
-			plinked->pColor = nullptr;
+			setField(plinked->Color, 0);
 		}
 		else
 		{
 			// Uses some other color. Hide the corresponding sequence, but leave it
 			// linked horizontally so that we can find it if we restore.
-			hide(plinked);
+			hide<Profiling>(plinked);
 		}
 	}
 }
 ///////////////////////////////////////////////////////////////////////////////
+template<bool Profiling, bool Multiplicities>
 void AlgMPointer::deactivateOrCover(ItemHeader* pitem)
 {
 	if (!pitem->isPrimary())
@@ -493,61 +665,56 @@ void AlgMPointer::deactivateOrCover(ItemHeader* pitem)
 		return;
 	}
 
-	if (pitem->UsedCount == pitem->Min)
+	// The item stays active until it can't be used again, even once it has Min
+	// sequences, since a solution may use it more than that. Only the search deactivates
+	// an item before then, when it chooses to give it no more (see ag_Skip). Without
+	// multiplicities, one use is all there is:
+	if (!Multiplicities || pitem->UsedCount == pitem->Max)
 	{
-		// The item is no longer active - we don't need any more sequences that reference it,
-		// but we don't cover it either because it could be used again.
 		unlinkItem(pitem);
-	}
-	else if (pitem->UsedCount > pitem->Min)
-	{
-		// Should have already been unlinked.
-		assert(!isLinked(pitem));
-	}
-	else
-	{
-		assert(isLinked(pitem));
-	}
-
-	if (pitem->UsedCount == pitem->Max)
-	{
-		cover(pitem);
+		cover<Profiling>(pitem);
 	}
 }
 ///////////////////////////////////////////////////////////////////////////////
+template<bool Profiling>
 void AlgMPointer::tweak(MCell* pcell)
 {
 	// All sequences above this cell should have already been tweaked.
-	assert(pcell->pTop->pTopCell == pcell);
+	assert(top(pcell)->pTopCell == pcell);
 
-	hide(pcell);
-	pcell->pTop->pTopCell = pcell->pDown;
-	pcell->pTop->AvailableSequences--;
+	hide<Profiling>(pcell);
+	setField(top(pcell)->pTopCell, pcell->pDown);
+	setField(top(pcell)->AvailableSequences, top(pcell)->AvailableSequences - 1);
+	if (Profiling)
+		pCounts->CellsUnlinked++;
 
 	// Unhook this cell from the one below:
 	if (pcell->pDown)
 	{
-		pcell->pDown->pUp = nullptr;
+		setField(pcell->pDown->pUp, nullptr);
 	}
 }
 ///////////////////////////////////////////////////////////////////////////////
+template<bool Profiling>
 void AlgMPointer::untweak_all()
 {
 	ItemHeader* pitem = pLevelState[CurLevel].pItem;
 
 	MCell *pcell = pLevelState[CurLevel].pStartingCell;
 
-	pitem->pTopCell = pcell;
+	setField(pitem->pTopCell, pcell);
 	assert(pcell->pDown == nullptr || pcell->pDown->pUp == nullptr);
 
 	for (;;)
 	{
-		unhide(pcell);
-		pitem->AvailableSequences++;
+		unhide<Profiling>(pcell);
+		setField(pitem->AvailableSequences, pitem->AvailableSequences + 1);
+		if (Profiling)
+			pCounts->CellsRelinked++;
 
 		if (pcell->pDown)
 		{
-			pcell->pDown->pUp = pcell;
+			setField(pcell->pDown->pUp, pcell);
 		}
 
 		if (pcell == pLevelState[CurLevel].pCurCell)
@@ -559,6 +726,7 @@ void AlgMPointer::untweak_all()
 	}
 }
 ///////////////////////////////////////////////////////////////////////////////
+template<bool Profiling>
 void AlgMPointer::hide(MCell* pcell)
 {
 
@@ -566,17 +734,22 @@ void AlgMPointer::hide(MCell* pcell)
 	while (right != pcell)
 	{
 		unlinkCellVertically(right);
+		if (Profiling)
+			pCounts->CellsUnlinked++;
 		right = right->pRight;
 	}
 }
 
 ///////////////////////////////////////////////////////////////////////////////
+template<bool Profiling>
 void AlgMPointer::unhide(MCell* pcell)
 {
 	MCell* left = pcell->pLeft;
 	while (left != pcell)
 	{
 		relinkCellVertically(left);
+		if (Profiling)
+			pCounts->CellsRelinked++;
 		left = left->pLeft;
 	}
 }
@@ -592,70 +765,74 @@ void AlgMPointer::relinkItem(ItemHeader* pitem)
 
 	if (pitem->pPrevActive == nullptr)
 	{
-		pFirstActiveItem = pitem;
+		setFirstActiveItem(pitem);
 	}
 	else
 	{
-		pitem->pPrevActive->pNextActive = pitem;
+		setField(pitem->pPrevActive->pNextActive, pitem);
 	}
 
 	if (pitem->pNextActive)
-		pitem->pNextActive->pPrevActive = pitem;
+		setField(pitem->pNextActive->pPrevActive, pitem);
 }
 ///////////////////////////////////////////////////////////////////////////////
+template<bool Profiling>
 void AlgMPointer::uncover(ItemHeader* pitem)
 {
 	MCell* pcell = pitem->pTopCell;
 
 	while (pcell)
 	{
-		unhide(pcell);
+		unhide<Profiling>(pcell);
 		pcell = pcell->pDown;
 	}
 }
 ///////////////////////////////////////////////////////////////////////////////
+template<bool Profiling, bool Multiplicities, bool Colors>
 void AlgMPointer::sequenceReleased(MCell* pcell)
 {
 	for (MCell* pleft = pcell->pLeft; pleft != pcell; pleft = pleft->pLeft)
 	{
-		pleft->pTop->UsedCount--;
+		setField(top(pleft)->UsedCount, top(pleft)->UsedCount - 1);
 
-		if (pleft->pColor)
+		if (Colors && pleft->Color)
 		{
-			clearColor(pleft);
+			clearColor<Profiling>(pleft);
 		}
 		else
 		{
-			reactivateOrUncover(pleft->pTop);
+			reactivateOrUncover<Profiling, Multiplicities>(top(pleft));
 		}
 	}
 }
 ///////////////////////////////////////////////////////////////////////////////
+template<bool Profiling>
 void AlgMPointer::clearColor(MCell* pcell)
 {
-	assert(pcell->pTop->pColor == pcell->pColor);
-	pcell->pTop->pColor = nullptr;
+	assert(top(pcell)->Color == pcell->Color);
+	setField(top(pcell)->Color, 0);
 
 	// Note that this is not exactly the reverse of the setColor order. Both
 	// are going top-down.
-	for (MCell* plinked = pcell->pTop->pTopCell; plinked; plinked = plinked->pDown)
+	for (MCell* plinked = top(pcell)->pTopCell; plinked; plinked = plinked->pDown)
 	{
-		if (plinked->pColor == nullptr)
+		if (plinked->Color == 0)
 		{
-			// This cell's color was set to null, which means it matches the target
+			// This cell's color was set to 0, which means it matches the target
 			// color when the target cell was selected. Set it back now.
-			plinked->pColor = pcell->pColor;
+			setField(plinked->Color, pcell->Color);
 		}
 		else
 		{
-			assert(plinked->pColor != pcell->pColor);
+			assert(plinked->Color != pcell->Color);
 			// This cell has some other color, so it wasn't compatible; it
 			// would have been hidden, so unhide now.
-			unhide(plinked);
+			unhide<Profiling>(plinked);
 		}
 	}
 }
 ///////////////////////////////////////////////////////////////////////////////
+template<bool Profiling, bool Multiplicities>
 void AlgMPointer::reactivateOrUncover(ItemHeader* pitem)
 {
 	if (!pitem->isPrimary())
@@ -663,15 +840,11 @@ void AlgMPointer::reactivateOrUncover(ItemHeader* pitem)
 		return;
 	}
 
-	if (pitem->UsedCount == pitem->Max - 1)
+	if (!Multiplicities || pitem->UsedCount == pitem->Max - 1)
 	{
 		// Use count just transitioned from Max, so the item is available
 		// again:
-		uncover(pitem);
-	}
-
-	if (pitem->UsedCount == pitem->Min - 1)
-	{
+		uncover<Profiling>(pitem);
 		relinkItem(pitem);
 	}
 }
@@ -695,9 +868,9 @@ void AlgMPointer::format(ostream& stream) const
 	}
 
 	// Secondary items don't get deactivated, so we want to print all of them:
-	for (int i = 0; i < Problem.secondary_options.size(); i++)
+	for (int i = 0; i < pProblem->secondaryItems(); i++)
 	{
-		ItemHeader* pitem = pHeaders + Problem.primary_options.size() + i;
+		ItemHeader* pitem = pHeaders + pProblem->PrimaryItems + i;
 		pitems[idx] = pitem;
 		item_indexes[pitem - pHeaders] = idx++;
 	}
@@ -757,7 +930,7 @@ void AlgMPointer::format(ostream& stream) const
 	for (int i = 0; i < idx; i++)
 	{
 		auto pitem = pitems[i];
-		stream << setw(5) << ((pitem->pColor) ? pitem->pColor : "");
+		stream << setw(5) << ((pitem->Color) ? colorName(pitem->Color) : "");
 	}
 	stream << endl;
 
@@ -791,7 +964,7 @@ void AlgMPointer::format(ostream& stream) const
 			{
 				seen_cells.insert(poutput_cell);
 
-				int index = item_indexes[poutput_cell->pTop - pHeaders];
+				int index = item_indexes[poutput_cell->Top];
 				pseq_cells[index] = poutput_cell;
 
 				poutput_cell = poutput_cell->pRight;
@@ -804,12 +977,12 @@ void AlgMPointer::format(ostream& stream) const
 				auto pcell = pseq_cells[i];
 				if (pcell)
 				{
-					string s = pcell->pTop->pName;
-					const char* pcolor = pcell->pColor ? pcell->pColor : pcell->pTop->pColor;
-					if (pcolor)
+					string s = top(pcell)->pName;
+					int color = pcell->Color ? pcell->Color : top(pcell)->Color;
+					if (color)
 					{
 						s += ':';
-						s += pcolor;
+						s += colorName(color);
 					}
 					stream << setw(5) << s;
 				}
@@ -823,36 +996,126 @@ void AlgMPointer::format(ostream& stream) const
 }
 ///////////////////////////////////////////////////////////////////////////////
 bool AlgMPointer::exactCover(std::vector<std::vector<int>>* presults, int max_results)
+{
+	ShardDepth = 0;
+	pChoicePrefix = nullptr;
+	return search(presults, max_results);
+}
+///////////////////////////////////////////////////////////////////////////////
+void AlgMPointer::enumeratePrefixes(int depth, std::vector<std::vector<int>>* pprefixes)
+{
+	assert(depth > 0);
+
+	// Pruning depends on solutions we won't find, so the enumeration has to be
+	// exhaustive. Shards can still be searched for the cheapest solutions.
+	bool minimize_cost = MinimizeCost;
+	MinimizeCost = false;
+
+	ShardDepth = depth;
+	pShardPrefixes = pprefixes;
+	pChoicePrefix = nullptr;
+
+	vector<vector<int>> results;
+	search(&results, 1);
+	assert(results.size() == 0);
+
+	ShardDepth = 0;
+	pShardPrefixes = nullptr;
+	MinimizeCost = minimize_cost;
+}
+///////////////////////////////////////////////////////////////////////////////
+bool AlgMPointer::exactCoverFromPrefix(const std::vector<int>& prefix, std::vector<std::vector<int>>* presults, int max_results)
+{
+	ShardDepth = 0;
+	pChoicePrefix = &prefix;
+	bool b = search(presults, max_results);
+	pChoicePrefix = nullptr;
+	return b;
+}
+///////////////////////////////////////////////////////////////////////////////
+bool AlgMPointer::search(std::vector<std::vector<int>>* presults, int max_results)
 {
 	assert(max_results >= 1);
 	assert(presults->size() == 0);
 	assert(_CrtCheckMemory());
 
-	if (TotalItems < 50)
+	if (Verbose && TotalItems < 50)
 	{
-		Problem.print();
+		pProblem->print();
 		print();
 	}
 #ifndef NDEBUG
-	assert(testUncoverCover());
+	// Covering an item twice isn't allowed, so we can only test this without forced sequences:
+	assert(ForcedSequences.size() > 0 || testUncoverCover());
 #endif
 
+	if (pProfile)
+		return searchKernel<true>(presults, max_results);
+	return searchKernel<false>(presults, max_results);
+}
+///////////////////////////////////////////////////////////////////////////////
+template<bool Profiling>
+bool AlgMPointer::searchKernel(std::vector<std::vector<int>>* presults, int max_results)
+{
+	if (HasMultiplicities)
+	{
+		if (HasColors)
+			return runSearch<Profiling, true, true>(presults, max_results);
+		return runSearch<Profiling, true, false>(presults, max_results);
+	}
+	if (HasColors)
+		return runSearch<Profiling, false, true>(presults, max_results);
+	return runSearch<Profiling, false, false>(presults, max_results);
+}
+///////////////////////////////////////////////////////////////////////////////
+// The search loop. With Profiling, it also counts the work done at each level.
+//
+// Without Multiplicities, every primary item is used exactly once, which is Knuth's
+// Algorithm X, or C with Colors. Choosing an item covers it, so there is nothing to
+// tweak or skip, and the branching factor is just the number of sequences. Without
+// Colors, the color checks go. The structure goes through the same states either way.
+template<bool Profiling, bool Multiplicities, bool Colors>
+bool AlgMPointer::runSearch(std::vector<std::vector<int>>* presults, int max_results)
+{
 	auto start_time = std::chrono::high_resolution_clock::now();
+	if (pPerf)
+		pPerf->start();
+
+	// A local, so the test stays cheap when there is no trace:
+	TraceBuffer* ptrace = pTrace && pTrace->isActive() ? pTrace : nullptr;
 
 	CurLevel = 0;
 	pLevelState[0].Action = ag_Init;
 
 	Solutions = 0;
 	loopCount = levelCount = 0;
+	CurCost = ForcedCost;
+	SolutionCosts.clear();
+	Stopping = false;
+	Cancelled = false;
+	PrefixMismatch = false;
+	RestoreFailures = 0;
 
 	for (;;)
 	{
-		loopCount++;
+		if (!Stopping)
+		{
+			loopCount++;	// Don't count backing out, so the stats reflect the search.
+
+			if (pCancel && pCancel->load(std::memory_order_relaxed))
+			{
+				// Back out just as if we had all the solutions we want:
+				Stopping = Cancelled = true;
+			}
+		}
 
 		assertValid();
 
 		LevelState& state = pLevelState[CurLevel];
-		TRACE("%lli:%i - %s\n", loopCount, CurLevel, ActionName(state.Action));
+		if (ptrace)
+			traceState(ptrace, state);
+		if (Profiling)
+			pCounts = &pProfile->level(CurLevel);
 
 		switch (state.Action)
 		{
@@ -864,32 +1127,65 @@ bool AlgMPointer::exactCover(std::vector<std::vector<int>>* presults, int max_re
 			}
 			case ag_EnterLevel:
 			{
+				if (Stopping)
+				{
+					state.Action = ag_LeaveLevel;
+					continue;
+				}
+
 				levelCount++;
+				if (Profiling)
+					pCounts->Entries++;
+
+				if (ShardDepth > 0 && (pFirstActiveItem == nullptr || CurLevel == ShardDepth))
+				{
+					// Enumerating shards. Solutions above the shard depth are shards too, so
+					// the shards cover every solution:
+					recordPrefix();
+					state.Action = ag_LeaveLevel;
+					continue;
+				}
+
+				if (pFirstActiveItem == nullptr && pChoicePrefix && CurLevel < pChoicePrefix->size())
+				{
+					// A prefix from this problem doesn't go on past a solution either:
+					PrefixMismatch = true;
+					state.Action = ag_LeaveLevel;
+					continue;
+				}
+
 				if (pFirstActiveItem == nullptr)
 				{
-					recordSolution(presults);
+					if (Profiling)
+						pCounts->Solutions++;
+					recordSolution(presults, max_results);
 
-					if (presults->size() < max_results)
+					// When minimizing cost, we have to look at every solution that could be
+					// cheaper than the ones we have:
+					if (!MinimizeCost && (int)presults->size() >= max_results)
 					{
-						// We should continue searching:
-						state.Action = ag_LeaveLevel;
-					}
-					else
-					{
-						state.Action = ag_Done;
+						// We have all the solutions we want. Back out of the search without
+						// trying anything else, so the structure is left the way we found it:
+						Stopping = true;
 					}
+					state.Action = ag_LeaveLevel;
 					continue;
 				}
-#ifndef NDEBUG
-				pChecksums[CurLevel].checksum(*this);
-#endif
+				state.RestoreHash = RestoreHash;
 
 				int smallest_branch_factor = std::numeric_limits<int>::max();
 				ItemHeader* pbest = nullptr;
+				long long lower_bound = 0;
 
 				for (ItemHeader* pitem = pFirstActiveItem; pitem; pitem = pitem->pNextActive)
 				{
-					int branching_factor = pitem->branchingFactor();
+					int branching_factor = Multiplicities ? pitem->branchingFactor() : pitem->AvailableSequences;
+
+					// Every active item still needs Min - UsedCount more sequences:
+					if (Multiplicities)
+						lower_bound += (long long)std::max(pitem->Min - pitem->UsedCount, 0) * pitem->MinCost;
+					else
+						lower_bound += pitem->MinCost;
 
 					// This implements the non-sharp preference heuristic.
 					// This is needed for the word rectangle problem, but not in general:
@@ -908,32 +1204,76 @@ bool AlgMPointer::exactCover(std::vector<std::vector<int>>* presults, int max_re
 					}
 				}
 
+				if (Profiling)
+				{
+					pCounts->Choices++;
+					if (smallest_branch_factor <= 0)
+						pCounts->DeadEnds++;
+					else
+						pCounts->Branches += pbest->branchingFactor();	// Without the heuristic's penalty.
+				}
+
 				if (smallest_branch_factor <= 0)
 				{
+					// A prefix from this problem never runs into a dead end:
+					if (pChoicePrefix && CurLevel < pChoicePrefix->size())
+						PrefixMismatch = true;
 					state.Action = ag_LeaveLevel;
 					continue;
 				}
 
-				pbest->UsedCount++;
-				deactivateOrCover(pbest);
+				if (MinimizeCost && !canImproveCost(CurCost + lower_bound, presults, max_results))
+				{
+					// Anything we find below here costs at least as much as what we have:
+					state.Action = ag_LeaveLevel;
+					continue;
+				}
+
+				setField(pbest->UsedCount, pbest->UsedCount + 1);
+				deactivateOrCover<Profiling, Multiplicities>(pbest);
 
 				state.pItem = pbest;
 				state.pCurCell = pbest->pTopCell;
+				state.Branch = 0;
 
-				// There are two different cases: The usage we are adding finishes this item, which causes
-				// it to be covered. Or the item will still be active. If the item is still active, we only
-				// consider as many sequences as we have to before branching again.
-				if (pbest->UsedCount == pbest->Max)
+				if (!Multiplicities)
 				{
-					state.Action = ag_TryX;
+					// The item was covered, and we try each of its sequences:
 					state.TryCellCount = pbest->AvailableSequences;
+					state.CanSkip = false;
+					state.Action = ag_TryX;
 				}
 				else
 				{
+					// We only consider as many sequences as leave enough for the sequences the item
+					// still needs after this one. If it doesn't need this one, giving it no more is
+					// the last choice (Knuth's x_l = i):
+					state.TryCellCount = pbest->AvailableSequences - std::max(pbest->Min - pbest->UsedCount, 0);
+					state.CanSkip = pbest->UsedCount > pbest->Min;
+
+					// There are two different cases: The usage we are adding finishes this item, which causes
+					// it to be covered. Or the item will still be active, and each sequence we try is tweaked
+					// out of it so the next level that chooses the item only tries the ones below.
+					if (pbest->UsedCount == pbest->Max)
+					{
+						state.Action = ag_TryX;
+					}
+					else
+					{
 
-					state.Action = ag_Tweak;
-					state.pStartingCell = state.pCurCell;	      // Only matters for tweaking
-					state.TryCellCount = smallest_branch_factor;
+						state.Action = ag_Tweak;
+						state.pStartingCell = state.pCurCell;	      // Only matters for tweaking
+					}
+					if (state.TryCellCount == 0)
+					{
+						assert(state.CanSkip);
+						state.Action = ag_Skip;
+					}
+				}
+
+				if (pChoicePrefix && CurLevel < pChoicePrefix->size() && !followPrefix<Profiling>(state))
+				{
+					state.Action = ag_Restore;
 				}
 				break;
 			}
@@ -942,10 +1282,10 @@ bool AlgMPointer::exactCover(std::vector<std::vector<int>>* presults, int max_re
 				assert(state.pCurCell);
 				state.TryCellCount--;
 
-				TRACE("\t\t%i - trying: %s\n", CurLevel, state.pCurCell->format());
-
 				// If we selected the current cell, all the items it references get used:
-				sequenceUsed(state.pCurCell);
+				sequenceUsed<Profiling, Multiplicities, Colors>(state.pCurCell);
+				if (MinimizeCost)
+					CurCost += cellCost(state.pCurCell);
 
 				CurLevel++;
 				pLevelState[CurLevel].Action = ag_EnterLevel;
@@ -953,16 +1293,24 @@ bool AlgMPointer::exactCover(std::vector<std::vector<int>>* presults, int max_re
 			}
 			case ag_NextX:
 			{
-				sequenceReleased(state.pCurCell);
+				sequenceReleased<Profiling, Multiplicities, Colors>(state.pCurCell);
+				if (MinimizeCost)
+					CurCost -= cellCost(state.pCurCell);
 
 
-				if (state.TryCellCount == 0)
+				if (state.TryCellCount == 0 && Multiplicities && state.CanSkip && !Stopping)
+				{
+					state.Branch++;
+					state.Action = ag_Skip;
+				}
+				else if (state.TryCellCount == 0 || Stopping)
 				{
 					state.Action = ag_Restore;
 				}
 				else
 				{
 					state.pCurCell = state.pCurCell->pDown;
+					state.Branch++;
 					assert(state.pCurCell); // Else TryCellCount should have hit 0.
 					state.Action = ag_TryX;
 				}
@@ -970,8 +1318,16 @@ bool AlgMPointer::exactCover(std::vector<std::vector<int>>* presults, int max_re
 			}
 			case ag_Tweak:
 			{
+				if (Profiling)
+					pCounts->Tweaks++;
 				state.TryCellCount--;
-				tweak(state.pCurCell);
+				tweak<Profiling>(state.pCurCell);
+
+				// Tweaking hid the sequence, as covering the item would have, and its
+				// other items get used:
+				sequenceUsed<Profiling, Multiplicities, Colors>(state.pCurCell);
+				if (MinimizeCost)
+					CurCost += cellCost(state.pCurCell);
 				CurLevel++;
 				pLevelState[CurLevel].Action = ag_EnterLevel;
 				break;
@@ -979,29 +1335,62 @@ bool AlgMPointer::exactCover(std::vector<std::vector<int>>* presults, int max_re
 
 			case ag_TweakNext:
 			{
+				// The cell stays tweaked until we leave the level:
+				sequenceReleased<Profiling, Multiplicities, Colors>(state.pCurCell);
+				if (MinimizeCost)
+					CurCost -= cellCost(state.pCurCell);
 
-				if (state.TryCellCount == 0)
+				if (state.TryCellCount == 0 && Multiplicities && state.CanSkip && !Stopping)
+				{
+					state.Branch++;
+					state.Action = ag_Skip;
+				}
+				else if (state.TryCellCount == 0 || Stopping)
 				{
-					untweak_all();
+					untweak_all<Profiling>();
 					state.Action = ag_Restore;
 				}
 				else
 				{
 					state.pCurCell = state.pCurCell->pDown;
+					state.Branch++;
 					assert(state.pCurCell); // Else TryCellCount should have hit 0.
 					state.Action = ag_Tweak;
 				}
 				break;
 			}
+			case ag_Skip:
+			{
+				// Every sequence we were going to try has been, so the item gets no more. If
+				// it wasn't covered, they have all been tweaked out of it and nothing else can
+				// use it, so it just has to be deactivated:
+				if (state.pItem->UsedCount < state.pItem->Max)
+					unlinkItem(state.pItem);
+				CurLevel++;
+				pLevelState[CurLevel].Action = ag_EnterLevel;
+				break;
+			}
+			case ag_Unskip:
+			{
+				if (state.pItem->UsedCount < state.pItem->Max)
+				{
+					relinkItem(state.pItem);
+					if (state.pStartingCell)
+						untweak_all<Profiling>();
+				}
+				state.Action = ag_Restore;
+				break;
+			}
 			case ag_Restore:
 			{
-				state.pItem->UsedCount--;
-				reactivateOrUncover(state.pItem);
+				setField(state.pItem->UsedCount, state.pItem->UsedCount - 1);
+				reactivateOrUncover<Profiling, Multiplicities>(state.pItem);
 
 #ifndef NDEBUG
 				assertValid();
-				testChecksum();
 #endif
+				if (CheckRestore && RestoreHash != state.RestoreHash)
+					restoreFailed();
 
 				state.Action = ag_LeaveLevel;
 				break;
@@ -1021,6 +1410,10 @@ bool AlgMPointer::exactCover(std::vector<std::vector<int>>* presults, int max_re
 					{
 						pLevelState[CurLevel].Action = ag_NextX;
 					}
+					else if (pLevelState[CurLevel].Action == ag_Skip)
+					{
+						pLevelState[CurLevel].Action = ag_Unskip;
+					}
 					else
 					{
 						assert(pLevelState[CurLevel].Action == ag_Tweak);
@@ -1033,6 +1426,8 @@ bool AlgMPointer::exactCover(std::vector<std::vector<int>>* presults, int max_re
 			{
 				auto end_time = std::chrono::high_resolution_clock::now();
 				runTime = (long)std::chrono::duration_cast<std::chrono::microseconds>(end_time - start_time).count();
+				if (pPerf)
+					pPerf->stop(&pPerf->Search);
 
 				assert(_CrtCheckMemory());
 				Solutions = presults->size();
@@ -1042,28 +1437,227 @@ bool AlgMPointer::exactCover(std::vector<std::vector<int>>* presults, int max_re
 	}
 }
 ///////////////////////////////////////////////////////////////////////////////
-void AlgMPointer::recordSolution(std::vector<std::vector<int>>* presults)
+int AlgMPointer::cellCost(const MCell* pcell) const
+{
+	return pProblem->sequenceCost(pCellSequence[pcell - pCells]);
+}
+///////////////////////////////////////////////////////////////////////////////
+bool AlgMPointer::isLinkedVertically(const MCell* pcell) const
+{
+	if (pcell->pUp)
+		return pcell->pUp->pDown == pcell;
+	return top(pcell)->pTopCell == pcell;
+}
+///////////////////////////////////////////////////////////////////////////////
+bool AlgMPointer::canForce(MCell* pfirst) const
+{
+	// A sequence that conflicts with what has already been chosen will have been
+	// hidden, so some of its cells won't be linked. The exception is a cell in an item
+	// that has been covered, so check the item is still available, and the color.
+	MCell* pcell = pfirst;
+	do
+	{
+		if (!isLinkedVertically(pcell))
+			return false;
+
+		ItemHeader* pitem = top(pcell);
+		if (pitem->isPrimary())
+		{
+			if (pitem->UsedCount >= pitem->Max)
+				return false;
+		}
+		else if (pcell->Color && pitem->Color && pcell->Color != pitem->Color)
+		{
+			return false;
+		}
+		pcell = pcell->pRight;
+	} while (pcell != pfirst);
+
+	return true;
+}
+///////////////////////////////////////////////////////////////////////////////
+void AlgMPointer::forceSequence(MCell* pfirst)
+{
+	// Like choosing the sequence in the search, except there is no item we chose it
+	// for, so every cell gets used. First take it out of the lists so nothing else can
+	// choose it:
+	MCell* pcell = pfirst;
+	do
+	{
+		unlinkCellVertically(pcell);
+		pcell = pcell->pRight;
+	} while (pcell != pfirst);
+
+	do
+	{
+		setField(top(pcell)->UsedCount, top(pcell)->UsedCount + 1);
+		if (pcell->Color)
+		{
+			setcolor<false>(pcell);
+		}
+		else
+		{
+			deactivateOrCover<false>(top(pcell));
+		}
+		pcell = pcell->pRight;
+	} while (pcell != pfirst);
+}
+///////////////////////////////////////////////////////////////////////////////
+void AlgMPointer::releaseSequence(MCell* pfirst)
 {
-	vector<int> result;
-	result.resize(CurLevel);
+	// Exactly the reverse of forceSequence:
+	MCell* pcell = pfirst;
+	do
+	{
+		pcell = pcell->pLeft;
+		setField(top(pcell)->UsedCount, top(pcell)->UsedCount - 1);
+		if (pcell->Color)
+		{
+			clearColor<false>(pcell);
+		}
+		else
+		{
+			reactivateOrUncover<false>(top(pcell));
+		}
+	} while (pcell != pfirst);
+
+	do
+	{
+		pcell = pcell->pLeft;
+		relinkCellVertically(pcell);
+	} while (pcell != pfirst);
+}
+///////////////////////////////////////////////////////////////////////////////
+bool AlgMPointer::forceSequences(const std::vector<int>& sequences)
+{
+	releaseForcedSequences();
+
+	for (auto idx_seq : sequences)
+	{
+		assert(idx_seq >= 0 && idx_seq < pProblem->sequences());
+		MCell* pfirst = pCells + pSequenceStart[idx_seq];
+
+		if (!canForce(pfirst))
+		{
+			releaseForcedSequences();
+			return false;
+		}
+
+		forceSequence(pfirst);
+		ForcedSequences.push_back(idx_seq);
+		ForcedCost += pProblem->sequenceCost(idx_seq);
+	}
+	return true;
+}
+///////////////////////////////////////////////////////////////////////////////
+void AlgMPointer::releaseForcedSequences()
+{
+	while (ForcedSequences.size() > 0)
+	{
+		releaseSequence(pCells + pSequenceStart[ForcedSequences.back()]);
+		ForcedSequences.pop_back();
+	}
+	ForcedCost = 0;
+}
+///////////////////////////////////////////////////////////////////////////////
+bool AlgMPointer::canImproveCost(long long lower_bound, const std::vector<std::vector<int>>* presults, int max_results) const
+{
+	// Until we have max_results solutions, anything is an improvement. After that,
+	// we have to beat the most expensive one we are keeping:
+	if ((int)presults->size() < max_results)
+		return true;
+
+	return lower_bound < SolutionCosts.back();
+}
+///////////////////////////////////////////////////////////////////////////////
+void AlgMPointer::recordSolution(std::vector<std::vector<int>>* presults, int max_results)
+{
+	vector<int> result = ForcedSequences;
 	for (int lout = 0; lout < CurLevel; lout++)
 	{
+		// Levels that gave their item no more sequences didn't choose one:
+		if (pLevelState[lout].Action == ag_Skip)
+			continue;
 		MCell *pcell = pLevelState[lout].pCurCell;
+		result.push_back(pCellSequence[pcell - pCells]);
+	}
 
-		for (;;)
+	if (!MinimizeCost)
+	{
+		presults->emplace_back(result);
+		if (Sink && !Sink(presults->back()))
+			Stopping = true;
+		return;
+	}
+
+	if (!canImproveCost(CurCost, presults, max_results))
+		return;
+
+	// Keep the solutions sorted by cost. Solutions with the same cost stay in the
+	// order they were found:
+	auto iter = upper_bound(SolutionCosts.begin(), SolutionCosts.end(), CurCost);
+	auto idx = iter - SolutionCosts.begin();
+	SolutionCosts.insert(iter, CurCost);
+	presults->insert(presults->begin() + idx, result);
+
+	if ((int)presults->size() > max_results)
+	{
+		presults->pop_back();
+		SolutionCosts.pop_back();
+	}
+}
+///////////////////////////////////////////////////////////////////////////////
+void AlgMPointer::recordPrefix()
+{
+	vector<int> prefix;
+	prefix.resize(CurLevel);
+	for (int lout = 0; lout < CurLevel; lout++)
+	{
+		prefix[lout] = pLevelState[lout].Branch;
+	}
+	pShardPrefixes->emplace_back(prefix);
+}
+///////////////////////////////////////////////////////////////////////////////
+template<bool Profiling>
+bool AlgMPointer::followPrefix(LevelState& state)
+{
+	// We are at a level covered by the choice prefix. Put the structure in the same state
+	// the full search would have when it got to the prefix's branch, and only try that
+	// one. Returns false, setting PrefixMismatch, if the prefix doesn't fit this problem.
+	// Giving the item no more sequences is the branch after the last one:
+	int branch = (*pChoicePrefix)[CurLevel];
+	bool skip = branch == state.TryCellCount;
+	if (branch < 0 || branch > state.TryCellCount || (skip && !state.CanSkip))
+	{
+		PrefixMismatch = true;
+		return false;
+	}
+
+	for (int i = 0; i < branch; i++)
+	{
+		// The full search would have tried each of these and moved on. When tweaking,
+		// they stay tweaked:
+		if (state.Action == ag_Tweak)
+			tweak<Profiling>(state.pCurCell);
+
+		if (i + 1 < state.TryCellCount)
 		{
-			auto iter = SequenceMap.find(pcell);
-			if (iter != SequenceMap.end())
-			{
-				int idx_seq = iter->second;
-				result[lout] = idx_seq;
-				break;
-			}
-			pcell = pcell->pLeft;
+			state.pCurCell = state.pCurCell->pDown;
+			assert(state.pCurCell);
 		}
-
 	}
-	presults->emplace_back(result);
+	state.Branch = branch;
+	if (skip)
+	{
+		state.TryCellCount = 0;
+		state.Action = ag_Skip;
+	}
+	else
+	{
+		state.TryCellCount = 1;
+		state.CanSkip = false;
+	}
+	return true;
 }
 ///////////////////////////////////////////////////////////////////////////////
 void AlgMPointer::showStats(std::ostream& stream) const
@@ -1072,17 +1666,151 @@ void AlgMPointer::showStats(std::ostream& stream) const
 
 	if (NonSharpPreference)
 		cout << "\tThe non-sharp preference heuristic was used." << endl;
+	if (MinimizeCost && SolutionCosts.size() > 0)
+		cout << "\tSolutions were chosen to minimize cost, which ranges from " << SolutionCosts.front() <<
+			" to " << SolutionCosts.back() << "." << endl;
+	if (Cancelled)
+		cout << "\tThe search was cancelled before it was complete." << endl;
+	if (CheckRestore)
+		cout << "\tThe restore check found " << RestoreFailures << " levels that were not restored." << endl;
 	cout << "\tTime used (microseconds): " << setupTime << " for setup and " <<
 		runTime << " to run." << endl;
 
 	cout << "\tLoop ran " << loopCount << " times with " << levelCount << " level transitions." << endl;
+	Arena.format(cout);
+	if (pPerf)
+		pPerf->format(levelCount, cout);
+}
+///////////////////////////////////////////////////////////////////////////////
+bool AlgMPointer::isRestored(const std::string& before) const
+{
+	ostringstream after;
+	format(after);
+	return print_diff(before, after.str());
+}
+///////////////////////////////////////////////////////////////////////////////
+template<bool Profiling>
+long long AlgMPointer::sweepPrimitive(BenchmarkPrimitives primitive, bool setup_only)
+{
+	long long calls = 0;
+	switch (primitive)
+	{
+		case bp_Cover:
+			for (size_t i = 0; i < TotalItems && !setup_only; i++)
+			{
+				cover<Profiling>(pHeaders + i);
+				uncover<Profiling>(pHeaders + i);
+				calls++;
+			}
+			break;
+
+		case bp_Hide:
+			for (size_t i = 0; i < TotalCells && !setup_only; i++)
+			{
+				hide<Profiling>(pCells + i);
+				unhide<Profiling>(pCells + i);
+				calls++;
+			}
+			break;
+
+		case bp_Color:
+			for (size_t i = 0; i < TotalCells; i++)
+			{
+				MCell* pcell = pCells + i;
+				if (!pcell->Color)
+					continue;
+
+				// In the search, covering the item the sequence was chosen for has hidden
+				// the cell, so setcolor doesn't find it in the item's list:
+				unlinkCellVertically(pcell);
+				if (!setup_only)
+				{
+					setcolor<Profiling>(pcell);
+					clearColor<Profiling>(pcell);
+				}
+				relinkCellVertically(pcell);
+				calls++;
+			}
+			break;
+
+		case bp_Tweak:
+		{
+			// untweak_all takes the tweaked cells from the level state, as in the search:
+			LevelState& state = pLevelState[CurLevel];
+			for (int i = 0; i < pProblem->PrimaryItems && !setup_only; i++)
+			{
+				ItemHeader* pitem = pHeaders + i;
+				if (!pitem->pTopCell)
+					continue;
+
+				state.pItem = pitem;
+				state.pStartingCell = pitem->pTopCell;
+				while (pitem->pTopCell)
+				{
+					state.pCurCell = pitem->pTopCell;
+					tweak<Profiling>(state.pCurCell);
+					calls++;
+				}
+				untweak_all<Profiling>();
+			}
+			break;
+		}
+
+		default:
+			assert(0);
+	}
+	return calls;
+}
+///////////////////////////////////////////////////////////////////////////////
+bool AlgMPointer::benchmarkPrimitives(int sweeps, std::vector<PrimitiveTiming>* ptimings)
+{
+	static const char* names[bp_Count] = { "cover+uncover", "hide+unhide", "setcolor+clearColor", "tweak+untweak_all" };
+	assert(CurLevel == 0 && ForcedSequences.empty());
+
+	ostringstream before;
+	format(before);
+	LevelState saved_state = pLevelState[CurLevel];
+	bool check_restore = CheckRestore;
+	bool pass = true;
+
+	ptimings->clear();
+	for (int i = 0; i < bp_Count; i++)
+	{
+		BenchmarkPrimitives primitive = (BenchmarkPrimitives)i;
+		PrimitiveTiming timing;
+		timing.pName = names[i];
+
+		// Count the cells with the profiling version, checking the restore hash on the way:
+		LevelCounts counts;
+		pCounts = &counts;
+		CheckRestore = true;
+		uint64_t hash = RestoreHash;
+		timing.Calls = sweepPrimitive<true>(primitive, false);
+		timing.Cells = counts.CellsUnlinked + counts.CellsRelinked;
+		timing.Restored = RestoreHash == hash;
+		CheckRestore = false;
+		pCounts = nullptr;
+
+		timing.Nanoseconds = fastest_sweep(sweeps, [this, primitive]() { sweepPrimitive<false>(primitive, false); }) -
+			fastest_sweep(sweeps, [this, primitive]() { sweepPrimitive<false>(primitive, true); });
+		timing.Nanoseconds = timing.Calls > 0 ? max(0.0, timing.Nanoseconds) : 0;
+
+		// And the same check as testUncoverCover:
+		timing.Restored = isRestored(before.str()) && timing.Restored;
+		pass = pass && timing.Restored;
+		ptimings->push_back(timing);
+	}
+
+	pLevelState[CurLevel] = saved_state;
+	CheckRestore = check_restore;
+	return pass;
 }
 ///////////////////////////////////////////////////////////////////////////////
 #ifndef NDEBUG
 bool AlgMPointer::testUncoverCover()
 {
 
-	ostringstream  before, after;
+	ostringstream  before;
 	format(before);
 
 	bool pass = true;
@@ -1091,27 +1819,24 @@ bool AlgMPointer::testUncoverCover()
 	{
 		ItemHeader* pitem = pHeaders + i;
 
-		cover(pitem);
+		cover<false>(pitem);
 
 		if (prev)
 		{
-			cover(prev);
-			uncover(prev);
+			cover<false>(prev);
+			uncover<false>(prev);
 		}
-		uncover(pitem);
-		format(after);
-		if (!print_diff(before.str(), after.str()))
+		uncover<false>(pitem);
+		if (!isRestored(before.str()))
 		{
 			if (pass == true)
 			{
 				pass = false;
 				cout << before.str();
 			}
-			cout << after.str();
 		}
 		prev = pitem;
 	}
 	return pass;
 }
 #endif
-
@@ -6,29 +6,43 @@
 
 #include <vector>
 #include <map>
+#include <memory>
+#include <atomic>
+#include <cstdint>
 #include <cassert>
 #include <sstream>
+#include <algorithm>
+#include <functional>
 #include "AlgMPointer.h"
+#include "PageArena.h"
 
 class ItemHeader;
 class XCellHeader;
 class MCell;
 class AlgMPointer;
+class TraceBuffer;
+class SearchProfile;
+class PerfCounters;
+struct LevelCounts;
+struct PrimitiveTiming;
 
 struct ExactCoverWithMultiplicitiesAndColors;
+struct CompactExactCover;
 enum AlgXStates;
+enum BenchmarkPrimitives : int;
+
+// Called with each solution as it is found. Returning false ends the search, as if it had
+// all the solutions it wanted:
+typedef std::function<bool(const std::vector<int>& solution)> SolutionSink;
 
 ///////////////////////////////////////////////////////////////////////////////
 class ItemHeader
 {
 	// Header for both primary and secondary items. Secondary items can be
 	// used 0 more times and will have a color assigned to them.
+	// No constructor, so arrays can be allocated without touching the memory. Use
+	// new ItemHeader[n]() to get them zeroed.
 public:
-	ItemHeader()
-	{
-		memset(this, 0, sizeof(*this));
-	}
-
 	const char* pName;
 
 	// Linked list of active headers. A primary item can be active, inactive and covered,
@@ -55,7 +69,9 @@ public:
 	int branchingFactor() const
 	{
 		assert(UsedCount <= Max);
-		int needed = Min - UsedCount;
+		// As in Knuth, an item that already has Min sequences can also be given no more,
+		// which is one more choice:
+		int needed = std::max(Min - UsedCount, 0);
 		int branching_factor = AvailableSequences - needed + 1;
 
 		return branching_factor;
@@ -66,35 +82,32 @@ public:
 		return Max - UsedCount;
 	}
 
+	// Smallest share of a sequence's cost that one use of this item can account for.
+	// Only used by the minimum cost search, as a lower bound on the remaining cost.
+	int MinCost;
+
 	// For a secondary item, the currently active color:
-	const char* pColor;	// or null if no color has been assigned.
+	int Color;	// or 0 if no color has been assigned.
 };
 ///////////////////////////////////////////////////////////////////////////////
 class MCell
 {
-	// Represents an items used in a sequence:
+	// Represents an items used in a sequence. Like ItemHeader, there's no constructor.
 public:
-	MCell()
-	{
-		memset(this, 0, sizeof(*this));
-	}
-
 	// Previous and next sequences containing this item. Null terminated.
 	MCell* pUp;
 	MCell* pDown;
 
-	ItemHeader* pTop;
-
-	const char* pColor; // Will match one of the pointers in the input problem, or nullptr if not colored.
+	// The item's index in the headers, and 1 + the color's index in the problem, or 0 if
+	// not colored. As ints they share the room of one pointer, which makes a cell 40 bytes
+	// rather than 48. Shorter colors wouldn't make it any smaller, since the cell is
+	// aligned for its pointers, so there's no limit on the number of colors.
+	int Top;
+	int Color;
 
 	// Next and previous cells in this sequence. Forms a circularly linked list.
 	MCell* pLeft;
 	MCell* pRight;
-
-
-	void format(std::ostream& stream) const;
-	const char* format() const;
-
 };
 ///////////////////////////////////////////////////////////////////////////////
 enum AgActions
@@ -105,6 +118,8 @@ enum AgActions
 	ag_Tweak,
 	ag_NextX,
 	ag_TweakNext,
+	ag_Skip,
+	ag_Unskip,
 	ag_Restore,
 	ag_LeaveLevel,
 	ag_Done,
@@ -117,31 +132,13 @@ struct LevelState
 	MCell* pCurCell;
 	MCell* pStartingCell;
 	int TryCellCount;
-};
-///////////////////////////////////////////////////////////////////////////////
-// The goal of dancing links is to be able to descend the search tree and
-// then quickly backtrack. The backtracking code is supposed to restore
-// the items & cells to their previous state exactly. The checksum code
-// is used to make sure this works properly.
-class AlgMChecksum
-{
-	ItemHeader* pHeaders;
-	MCell* pCells;
-public:
-	AlgMChecksum();
-	~AlgMChecksum();
-
-	void init(const AlgMPointer& alg);
-
-	void checksum(const AlgMPointer &alg);
-
-	bool compare(const AlgMChecksum& other, const AlgMPointer& alg) const;
+	int Branch;		// Which of the choices at this level we are trying, starting from 0.
+	bool CanSkip;	// The item already has Min sequences, so the last choice is to use no more.
+	uint64_t RestoreHash;	// When the level was entered. See CheckRestore.
 };
 ///////////////////////////////////////////////////////////////////////////////
 class AlgMPointer
 {
-	friend class AlgMChecksum;
-
 	ItemHeader* pFirstActiveItem;
 
 	size_t TotalItems;
@@ -152,27 +149,35 @@ class AlgMPointer
 	size_t TotalCells;
 	MCell* pCells;
 
-	std::map<MCell*, int> SequenceMap;
+	// Index of the sequence each cell belongs to. Used to record solutions and to
+	// look up sequence costs.
+	int* pCellSequence;
+	// And the other way: the index of the first cell of each sequence.
+	int* pSequenceStart;
+	// Both tables are in one allocation. They never change, so clones share it:
+	std::shared_ptr<int> pSequenceTables;
 
-	const ExactCoverWithMultiplicitiesAndColors& Problem;
+	// Sequences that are part of every solution. See forceSequences:
+	std::vector<int> ForcedSequences;
+	long long ForcedCost;
 
-	static inline const char* ActionName(AgActions action)
-	{
-		switch (action)
-		{
-			case ag_Init:				return "Init";
-			case ag_EnterLevel:			return "EnterLevel";
-			case ag_TryX:				return "TryX";
-			case ag_Tweak:				return "Tweak";
-			case ag_NextX:				return "NextX";
-			case ag_TweakNext:			return "TweakNext";
-			case ag_Restore:			return "Restore";
-			case ag_LeaveLevel:			return "LeaveLevel";
-			case ag_Done:				return "Done";
+	// What the engine was built from. reset converts a problem with names into pConverted,
+	// which clones share, like the sequence tables:
+	const CompactExactCover* pProblem;
+	std::shared_ptr<CompactExactCover> pConverted;
 
-			default:			assert(0); return "Error";
-		}
-	}
+	// What the problem uses, so search can run a kernel compiled without the rest:
+	bool HasMultiplicities;		// Some primary item isn't used exactly once.
+	bool HasColors;				// Some sequence gives a secondary item a color.
+
+	// Holds pHeaders, pCells and pLevelState. reset only remaps it when a problem needs
+	// more room, or when asked for first touch:
+	PageArena Arena;
+	// Allocated size. reset only reallocates when a problem needs more room:
+	size_t SequenceTableCapacity;
+
+	// Only used by reset. A member so it keeps its capacity:
+	std::vector<MCell*> LastCells;
 
 	// This stores the search state as we go down the tree:
 	int CurLevel;
@@ -181,60 +186,256 @@ class AlgMPointer
 	// Heuristic that can be used with item selection:
 	bool NonSharpPreference;
 
-#ifndef NDEBUG
-	AlgMChecksum* pChecksums;
-	AlgMChecksum tempChecksum;
-#endif
+	// Branch and bound mode. Instead of stopping after max_results solutions, keep
+	// the max_results cheapest ones, pruning any branch that cannot beat them:
+	bool MinimizeCost;
+	long long CurCost;		// Cost of the sequences in the partial solution.
+
+	// Small problems are printed before they are searched, which is handy when testing:
+	bool Verbose;
+
+	// Choice prefixes identify a subtree of the search by the branch taken at each level.
+	// If ShardDepth is set, we record the prefixes at that depth instead of searching
+	// below them. If pChoicePrefix is set, only the subtree under it is searched:
+	int ShardDepth;
+	std::vector<std::vector<int>>* pShardPrefixes;
+	const std::vector<int>* pChoicePrefix;
+
+	// Set once the search is over, while we back out to level 0:
+	bool Stopping;
+
+	// Polled by the search. Another thread can set it to end the search early:
+	const std::atomic<bool>* pCancel;
+
+	// Null unless the search is being traced:
+	TraceBuffer* pTrace;
+
+	// Empty unless each solution is wanted as soon as it is found:
+	SolutionSink Sink;
+
+	// Null unless the search is being profiled. While it is, pCounts holds the counts
+	// for the current level:
+	SearchProfile* pProfile;
+	LevelCounts* pCounts;
+
+	// Null unless hardware counters are measuring the setup and search:
+	PerfCounters* pPerf;
+
+	// The goal of dancing links is to be able to descend the search tree and then
+	// quickly backtrack, restoring the items & cells exactly. To check that, the
+	// restore hash covers every field the search changes and is updated as they change.
+	// The hash saved when a level is entered has to match when that level is restored.
+	//
+	// The hash is the sum of key(field) * value over the fields, less its value when
+	// the structure was built, so a change only has to add key * (new - old). Keys and
+	// values are byte offsets from the start of the arena, where the headers are
+	// followed by the cells, rather than addresses, so a clone has the same hashes as
+	// the original and can copy them. Each change costs a subtraction and two multiplies.
+	bool CheckRestore;
+	uint64_t RestoreHash;
+
+	uint64_t hashKey(const void* pfield) const
+	{
+		assert(pfield >= pHeaders && pfield < pCells + TotalCells);
+
+		// Multiplying scrambles the offset, so keys have no simple relation to each other:
+		return (uint64_t)((const char*)pfield - (const char*)pHeaders) * 0x9E3779B97F4A7C15ull | 1;
+	}
+	uint64_t hashValue(const void* p) const { return p ? (const char*)p - (const char*)pHeaders + 1 : 0; }
+	uint64_t hashValue(int n) const { return (uint64_t)(int64_t)n; }
+	void restoreFailed();
 
-	ItemHeader* getItem(const char* pc, size_t len);
-	// We 
-	const char* getColor(const char* pc);
+	void traceState(TraceBuffer* ptrace, const LevelState& state) const;
+
+	// Every change the search makes to the structure goes through here:
+	template<class T, class V>
+	void setField(T& field, V value)
+	{
+		T new_value = value;
+		if (CheckRestore)
+			RestoreHash += hashKey(&field) * (hashValue(new_value) - hashValue(field));
+		field = new_value;
+	}
+	// Except pFirstActiveItem, which isn't in the arena, so it has a key of its own:
+	void setFirstActiveItem(ItemHeader* pitem)
+	{
+		if (CheckRestore)
+			RestoreHash += 0xBF58476D1CE4E5B9ull * (hashValue(pitem) - hashValue(pFirstActiveItem));
+		pFirstActiveItem = pitem;
+	}
+
+	// The part of reset that builds the structure:
+	void build(const CompactExactCover& problem);
+	// Links the cells in as the problem emits them, for build:
+	class CellBuilder;
+
+	ItemHeader* top(const MCell* pcell) const { return pHeaders + pcell->Top; }
+	const char* colorName(int color) const;
+
+	// Writes the items of the sequence the cell is in:
+	void formatSequence(const MCell* pcell, std::ostream& stream) const;
+	const char* formatSequence(const MCell* pcell) const;
 
 	// Unlink/relink a single cell in the corresponding list of items:
 	void unlinkCellVertically(MCell* pcell);
 	void relinkCellVertically(MCell* pcell);
 
+	// The functions that unlink and relink cells are compiled twice, with and without
+	// counting the cells in pCounts. See setProfile. Those that use items can also be
+	// compiled without multiplicities or colors, for the search kernels; see runSearch.
 	void unlinkItem(ItemHeader* pitem);
-	void cover(ItemHeader* pitem);		// cover is called when an item is being chosen.
-	void sequenceUsed(MCell* pcell);   
-	void setcolor(MCell* pcell);
-	void deactivateOrCover(ItemHeader* pitem);
+	template<bool Profiling> void cover(ItemHeader* pitem);		// cover is called when an item is being chosen.
+	template<bool Profiling, bool Multiplicities = true, bool Colors = true> void sequenceUsed(MCell* pcell);
+	template<bool Profiling> void setcolor(MCell* pcell);
+	template<bool Profiling, bool Multiplicities = true> void deactivateOrCover(ItemHeader* pitem);
 
 
-	void tweak(MCell* pcell);
-	void untweak_all();
+	template<bool Profiling> void tweak(MCell* pcell);
+	template<bool Profiling> void untweak_all();
 
-	void hide(MCell* pcell);	// hide/unhide removes the sequence containing pcell.
-	void unhide(MCell* pcell);
+	template<bool Profiling> void hide(MCell* pcell);	// hide/unhide removes the sequence containing pcell.
+	template<bool Profiling> void unhide(MCell* pcell);
 	void relinkItem(ItemHeader* pitem);
-	void uncover(ItemHeader* pitem);	
-	void sequenceReleased(MCell* pcell);
-	void clearColor(MCell* pcell);
-	void reactivateOrUncover(ItemHeader* pitem);
-	void recordSolution(std::vector<std::vector<int>>* presults);
+	template<bool Profiling> void uncover(ItemHeader* pitem);
+	template<bool Profiling, bool Multiplicities = true, bool Colors = true> void sequenceReleased(MCell* pcell);
+	template<bool Profiling> void clearColor(MCell* pcell);
+	template<bool Profiling, bool Multiplicities = true> void reactivateOrUncover(ItemHeader* pitem);
+	int cellCost(const MCell* pcell) const;
+	bool canImproveCost(long long lower_bound, const std::vector<std::vector<int>>* presults, int max_results) const;
+
+	bool isLinkedVertically(const MCell* pcell) const;
+	bool canForce(MCell* pfirst) const;
+	void forceSequence(MCell* pfirst);
+	void releaseSequence(MCell* pfirst);
+
+	void recordSolution(std::vector<std::vector<int>>* presults, int max_results);
+	void recordPrefix();
+	template<bool Profiling> bool followPrefix(LevelState& state);
+
+	bool search(std::vector<std::vector<int>>* presults, int max_results);
+	template<bool Profiling> bool searchKernel(std::vector<std::vector<int>>* presults, int max_results);
+	template<bool Profiling, bool Multiplicities, bool Colors>
+	bool runSearch(std::vector<std::vector<int>>* presults, int max_results);
 
 	bool isLinked(const ItemHeader* pitem) const;
 	void assertValid() const;
-	void testChecksum();
+	// Compares the structure with what format wrote earlier, printing the differences:
+	bool isRestored(const std::string& before) const;
+
+	// One sweep for benchmarkPrimitives. Returns the number of calls. With setup_only, only
+	// does what has to happen around the primitive:
+	template<bool Profiling> long long sweepPrimitive(BenchmarkPrimitives primitive, bool setup_only);
 public:
+	// An empty engine, for reset to fill in:
+	AlgMPointer();
 	AlgMPointer(const ExactCoverWithMultiplicitiesAndColors& problem);
+	AlgMPointer(const CompactExactCover& problem);
+	// Clones the current state, including forced sequences, for another thread. Much
+	// faster than building from the problem again. Only between searches, since the
+	// clone's searches start from level 0.
+	AlgMPointer(const AlgMPointer& other);
 	~AlgMPointer();
 
+	AlgMPointer& operator=(const AlgMPointer&) = delete;
+
+	static inline const char* ActionName(AgActions action)
+	{
+		switch (action)
+		{
+			case ag_Init:				return "Init";
+			case ag_EnterLevel:			return "EnterLevel";
+			case ag_TryX:				return "TryX";
+			case ag_Tweak:				return "Tweak";
+			case ag_NextX:				return "NextX";
+			case ag_TweakNext:			return "TweakNext";
+			case ag_Skip:				return "Skip";
+			case ag_Unskip:				return "Unskip";
+			case ag_Restore:			return "Restore";
+			case ag_LeaveLevel:			return "LeaveLevel";
+			case ag_Done:				return "Done";
+
+			default:			assert(0); return "Error";
+		}
+	}
+
 	void setHeuristic(bool b) { NonSharpPreference = b; }
+	void setMinimizeCost(bool b) { MinimizeCost = b; }
+	bool heuristic() const { return NonSharpPreference; }
+	bool minimizeCost() const { return MinimizeCost; }
+	void setVerbose(bool b) { Verbose = b; }
+	// Checks that backtracking restores the structure exactly. On by default in a debug
+	// build, and cheap enough to turn on in a release build:
+	void setRestoreCheck(bool b) { CheckRestore = b; }
+	bool restoreCheck() const { return CheckRestore; }
+	// Once *pcancel is set, the search backs out, restoring the structure, and returns
+	// the solutions found so far with Cancelled set. See AsyncSolve.h.
+	void setCancellation(const std::atomic<bool>* pcancel) { pCancel = pcancel; }
+	// Hands each solution to the sink as soon as it is found, as well as adding it to the
+	// results. Not when minimizing cost, since the cheapest solutions are only known once
+	// the search is over. Pass an empty sink to stop.
+	void setSolutionSink(const SolutionSink& sink) { Sink = sink; }
+	// Records each step of the search in the buffer, once it is started. See Trace.h.
+	void setTrace(TraceBuffer* ptrace) { pTrace = ptrace; }
+	// Adds counts by level for each search to *pprofile. See SearchProfile.h.
+	void setProfile(SearchProfile* pprofile) { pProfile = pprofile; }
+	// Measures reset and each search with the counters, and adds them to showStats. Set it
+	// before reset to include the setup. See PerfCounters.h.
+	void setPerfCounters(PerfCounters* pperf) { pPerf = pperf; }
+
+	// Puts the headers, cells and levels on huge pages from the next reset, falling back to
+	// regular pages if there aren't any. With first touch, reset maps fresh memory, so reset
+	// on the thread that will search. showStats says what the arena got. See PageArena.h.
+	void setHugePages(HugePageMode mode) { Arena.setHugePages(mode); }
+	void setFirstTouch(bool first_touch) { Arena.setFirstTouch(first_touch); }
 	void format(std::ostream& stream = std::cout) const;
 	void print() { format(); }		// Just so we can call from the debugger if we want.
 
+	// Rebuilds the engine for another problem, keeping the allocations when they are big
+	// enough, so solving many small problems in a row doesn't spend its time in the heap.
+	// Forced sequences are released. The options set above and the cancellation flag stay.
+	// The problem has to stay around while the engine, or a clone of it, uses it.
+	void reset(const ExactCoverWithMultiplicitiesAndColors& problem);
+	void reset(const CompactExactCover& problem);
+
 	bool exactCover(std::vector<std::vector<int>>* presults, int max_results = 1);
 
+	// Forces the given sequences to be part of every solution, as if they had been
+	// chosen before the search starts, e.g. the givens in a sudoku. Later searches only
+	// look at what is left, but the solutions include the forced sequences. Any previously
+	// forced sequences are released first. Returns false, and forces nothing, if the
+	// sequences can't all be used together.
+	bool forceSequences(const std::vector<int>& sequences);
+	void releaseForcedSequences();
+
+	// Support for splitting a search into shards. enumeratePrefixes lists the choice prefixes
+	// of the search tree at the given depth, in the order exactCover would visit them. Searching
+	// each prefix with exactCoverFromPrefix and concatenating the results gives the same solutions,
+	// in the same order, as exactCover. Prefixes that end in a solution above the depth
+	// are included. A prefix that doesn't fit the problem, e.g. from another problem or
+	// other options, finds nothing and sets PrefixMismatch.
+	void enumeratePrefixes(int depth, std::vector<std::vector<int>>* pprefixes);
+	bool exactCoverFromPrefix(const std::vector<int>& prefix, std::vector<std::vector<int>>* presults, int max_results = 1);
+
 	// Metrics for stats:
 	size_t Solutions;
 	long setupTime;
 	long runTime;
 	long long loopCount;
 	long long levelCount;
+	bool Cancelled;		// The last search was cancelled before it was complete.
+	bool PrefixMismatch;	// The last exactCoverFromPrefix was given a prefix that doesn't fit the problem.
+	long long RestoreFailures;	// Levels the restore check found were not restored in the last search.
+
+	// When minimizing cost, the cost of each solution found, cheapest first:
+	std::vector<long long> SolutionCosts;
 
 	void showStats(std::ostream& stream = std::cout) const;
 
+	// Times cover, hide, setcolor and tweak, each with its inverse, over the whole problem,
+	// taking the fastest of the sweeps. Returns false if any of them didn't restore the
+	// structure. Only call before searching or forcing sequences. See Benchmark.h.
+	bool benchmarkPrimitives(int sweeps, std::vector<PrimitiveTiming>* ptimings);
+
 #ifndef NDEBUG
 	bool testUncoverCover();
 #endif
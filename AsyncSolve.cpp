@@ -0,0 +1,56 @@
+
+#include <mutex>
+
+#include "Common.h"
+#include "AlgMPointer.h"
+#include "MStringValues.h"
+#include "AsyncSolve.h"
+
+using namespace std;
+///////////////////////////////////////////////////////////////////////////////
+std::future<AsyncResults> exact_cover_async(AlgMPointer& alg, int max_results, CancellationToken token)
+{
+	return async(launch::async, [&alg, max_results, token]()
+	{
+		AsyncResults results;
+
+		// The token is captured by value, so the flag lives as long as the search:
+		alg.setCancellation(token.flag());
+		alg.exactCover(&results.Results, max_results);
+		alg.setCancellation(nullptr);
+
+		results.Costs = alg.SolutionCosts;
+		results.Cancelled = alg.Cancelled;
+		results.SetupTime = alg.setupTime;
+		results.RunTime = alg.runTime;
+		results.LoopCount = alg.loopCount;
+		results.LevelCount = alg.levelCount;
+		return results;
+	});
+}
+///////////////////////////////////////////////////////////////////////////////
+std::future<AsyncResults> exact_cover_with_multiplicities_and_colors_async(
+	const ExactCoverWithMultiplicitiesAndColors& problem, int max_results,
+	bool non_sharp_preference, CancellationToken token, const std::vector<int>* pforced)
+{
+	return async(launch::async, [&problem, max_results, non_sharp_preference, token, pforced]()
+	{
+		AsyncResults results;
+
+		lock_guard<mutex> lock(exact_cover_with_multiplicities_and_colors_mutex());
+
+		// Don't bother with the setup if we were cancelled while waiting for the lock:
+		if (token.isCancelled())
+		{
+			results.Cancelled = true;
+			return results;
+		}
+
+		exact_cover_with_multiplicities_and_colors(problem, &results.Results, max_results,
+			non_sharp_preference, pforced, token.flag());
+
+		get_exact_cover_with_multiplicities_and_colors_stats(&results.SetupTime, &results.RunTime,
+			&results.LoopCount, &results.LevelCount, &results.Cancelled);
+		return results;
+	});
+}
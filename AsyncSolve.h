@@ -0,0 +1,54 @@
+#pragma once
+
+// Asynchronous versions of the solvers, for use in a process that serves requests.
+// The search runs on its own thread and the results come back through a future.
+// A CancellationToken lets the caller stop a search that is taking too long: the
+// engines poll it in their main loop, back out to level 0 so everything they changed
+// is restored, and report the solutions found so far with Cancelled set.
+
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <future>
+
+struct ExactCoverWithMultiplicitiesAndColors;
+class AlgMPointer;
+
+///////////////////////////////////////////////////////////////////////////////
+class CancellationToken
+{
+	// Copies share the flag, so the caller keeps one and passes another to the search:
+	std::shared_ptr<std::atomic<bool>> pCancelled;
+public:
+	CancellationToken() : pCancelled(std::make_shared<std::atomic<bool>>(false)) {}
+
+	void cancel() { pCancelled->store(true); }
+	bool isCancelled() const { return pCancelled->load(); }
+
+	const std::atomic<bool>* flag() const { return pCancelled.get(); }
+};
+///////////////////////////////////////////////////////////////////////////////
+struct AsyncResults
+{
+	std::vector<std::vector<int>> Results;
+	std::vector<long long> Costs;	// Only if the search minimized cost.
+
+	bool Cancelled = false;
+
+	// Stats, with times in microseconds:
+	long SetupTime = 0;
+	long RunTime = 0;
+	long long LoopCount = 0;
+	long long LevelCount = 0;
+};
+///////////////////////////////////////////////////////////////////////////////
+// Searches with an existing AlgMPointer, which must not be used by anything else until
+// the future is ready. To serve several requests at once, give each its own clone.
+std::future<AsyncResults> exact_cover_async(AlgMPointer& alg, int max_results, CancellationToken token);
+
+// The MStringValues engine. It keeps its state in globals, so these searches run one
+// at a time, in the order they get the lock:
+std::future<AsyncResults> exact_cover_with_multiplicities_and_colors_async(
+							const ExactCoverWithMultiplicitiesAndColors& problem, int max_results,
+							bool non_sharp_preference, CancellationToken token,
+							const std::vector<int>* pforced = nullptr);
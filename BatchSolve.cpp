@@ -0,0 +1,58 @@
+
+#include <chrono>
+#include <cassert>
+
+#include "BatchSolve.h"
+
+using namespace std;
+///////////////////////////////////////////////////////////////////////////////
+void BatchStats::format(std::ostream& stream) const
+{
+	stream << "Batch solved " << Problems << " problems, " << Solved << " with solutions, " <<
+		Solutions << " solutions in all." << endl;
+	stream << "\tTime used (microseconds): " << SetupTime << " for setup and " << RunTime <<
+		" to run, " << TotalTime << " in all." << endl;
+	stream << "\t" << problemsPerSecond() << " problems per second." << endl;
+}
+///////////////////////////////////////////////////////////////////////////////
+BatchSolver::BatchSolver(const char* pengine, bool non_sharp_preference)
+{
+	pSolver = create_solver(pengine);
+	assert(pSolver);
+
+	SolverOptions options;
+	options.NonSharpPreference = non_sharp_preference;
+	options.Verbose = false;
+	pSolver->setOptions(options);
+}
+///////////////////////////////////////////////////////////////////////////////
+const std::vector<std::vector<int>>& BatchSolver::solve(const ExactCoverWithMultiplicitiesAndColors& problem, int max_results)
+{
+	Results.clear();
+
+	pSolver->solve(problem, &Results, max_results);
+	SolverStats stats = pSolver->stats();
+
+	Stats.Problems++;
+	if (Results.size() > 0)
+		Stats.Solved++;
+	Stats.Solutions += Results.size();
+	Stats.SetupTime += stats.SetupTime;
+	Stats.RunTime += stats.RunTime;
+	return Results;
+}
+///////////////////////////////////////////////////////////////////////////////
+void BatchSolver::run(const ProblemSource& source, int max_results, const ResultSink& sink)
+{
+	auto start_time = chrono::high_resolution_clock::now();
+
+	for (int idx_problem = 0; source(idx_problem, &Problem); idx_problem++)
+	{
+		solve(Problem, max_results);
+		if (sink)
+			sink(idx_problem, Problem, Results);
+	}
+
+	auto end_time = chrono::high_resolution_clock::now();
+	Stats.TotalTime += chrono::duration_cast<chrono::microseconds>(end_time - start_time).count();
+}
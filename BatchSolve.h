@@ -0,0 +1,68 @@
+#pragma once
+
+// Solving many small problems, one after the other. For small problems the setup,
+// and in particular the allocations, can cost more than the search. A BatchSolver
+// keeps one engine, one problem and one results vector, and rebuilds them in place
+// for each problem, so once the buffers have grown to the largest problem seen, a
+// batch runs without going back to the heap for them.
+
+#include <vector>
+#include <functional>
+#include <iostream>
+#include <memory>
+
+#include "Common.h"
+#include "Solver.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// Times are in microseconds:
+struct BatchStats
+{
+	long long Problems = 0;
+	long long Solved = 0;		// Problems with at least one solution.
+	long long Solutions = 0;
+	long long SetupTime = 0;
+	long long RunTime = 0;
+	long long TotalTime = 0;	// Includes generating the problems and handling the results.
+
+	double problemsPerSecond() const
+	{
+		return TotalTime > 0 ? Problems * 1e6 / TotalTime : 0;
+	}
+
+	void format(std::ostream& stream) const;
+};
+///////////////////////////////////////////////////////////////////////////////
+// Fills in the next problem, returning false when there are no more. The problem is
+// the one used for the previous call, so clearing it keeps the vectors' capacity.
+// Any strings it points to must stay valid until the problem's results are handled.
+typedef std::function<bool(int idx_problem, ExactCoverWithMultiplicitiesAndColors* pproblem)> ProblemSource;
+
+// Called with each problem's solutions. They are reused for the next problem, so copy
+// anything that needs to be kept.
+typedef std::function<void(int idx_problem, const ExactCoverWithMultiplicitiesAndColors& problem,
+							const std::vector<std::vector<int>>& results)> ResultSink;
+///////////////////////////////////////////////////////////////////////////////
+class BatchSolver
+{
+	std::unique_ptr<Solver> pSolver;
+	ExactCoverWithMultiplicitiesAndColors Problem;
+	std::vector<std::vector<int>> Results;
+
+public:
+	// The engine is one of solver_names(). The MStringValues engine keeps its buffers in
+	// globals, which also only grow, so it gets the same benefit. It is still limited to
+	// one search at a time. With auto, each problem goes to the engine that suits it.
+	BatchSolver(const char* pengine = "pointer", bool non_sharp_preference = false);
+
+	BatchSolver(const BatchSolver&) = delete;
+	BatchSolver& operator=(const BatchSolver&) = delete;
+
+	BatchStats Stats;		// Totals over every problem solved so far.
+
+	// Solves one problem, reusing the buffers from the previous one:
+	const std::vector<std::vector<int>>& solve(const ExactCoverWithMultiplicitiesAndColors& problem, int max_results);
+
+	// Solves problems from the source until it runs out:
+	void run(const ProblemSource& source, int max_results, const ResultSink& sink);
+};
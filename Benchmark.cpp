@@ -0,0 +1,373 @@
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstring>
+#include <cstdlib>
+#include <chrono>
+
+#include "Benchmark.h"
+#include "AlgMPointer.h"
+#include "MStringValues.h"
+
+using namespace std;
+///////////////////////////////////////////////////////////////////////////////
+BenchmarkStat BenchmarkStat::of(std::vector<double> values)
+{
+	BenchmarkStat stat;
+	if (values.empty())
+		return stat;
+
+	sort(values.begin(), values.end());
+	size_t n = values.size();
+	stat.Median = n % 2 ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2;
+	stat.Min = values.front();
+	stat.Max = values.back();
+	return stat;
+}
+///////////////////////////////////////////////////////////////////////////////
+void BenchmarkSuite::add(const std::string& name, const ExactCoverWithMultiplicitiesAndColors& problem, int max_results)
+{
+	Workloads.push_back({ name, &problem, max_results });
+}
+///////////////////////////////////////////////////////////////////////////////
+BenchmarkResult BenchmarkSuite::runCase(const Workload& workload, bool pointer_version, bool non_sharp_preference,
+										int repeats)
+{
+	BenchmarkResult result;
+	result.Workload = workload.Name;
+	result.PointerVersion = pointer_version;
+	result.NonSharpPreference = non_sharp_preference;
+	result.Repeats = repeats;
+
+	AlgMPointer alg;
+	alg.setVerbose(false);
+	alg.setHeuristic(non_sharp_preference);
+	vector<vector<int>> results;
+
+	// Solves the problem once, adding the times in microseconds:
+	auto solve = [&](double* psetup_time, double* prun_time)
+	{
+		results.clear();
+		auto start_time = chrono::steady_clock::now();
+		if (pointer_version)
+		{
+			alg.reset(*workload.pProblem);
+			auto setup_time = chrono::steady_clock::now();
+			alg.exactCover(&results, workload.MaxResults);
+			auto end_time = chrono::steady_clock::now();
+
+			*psetup_time += chrono::duration<double, micro>(setup_time - start_time).count();
+			*prun_time += chrono::duration<double, micro>(end_time - setup_time).count();
+			result.Loops = alg.loopCount;
+			result.Levels = alg.levelCount;
+		}
+		else
+		{
+			exact_cover_with_multiplicities_and_colors(*workload.pProblem, &results, workload.MaxResults,
+				non_sharp_preference);
+			auto end_time = chrono::steady_clock::now();
+
+			// The setup happens inside, so we only have its whole microseconds:
+			long setup_time, run_time;
+			bool cancelled;
+			get_exact_cover_with_multiplicities_and_colors_stats(&setup_time, &run_time, &result.Loops, &result.Levels,
+				&cancelled);
+			double total_time = chrono::duration<double, micro>(end_time - start_time).count();
+			*psetup_time += setup_time;
+			*prun_time += max(0.0, total_time - setup_time);
+		}
+		result.Solutions = results.size();
+	};
+
+	// Small problems take less time than the clock can resolve, so each sample solves
+	// them enough times to take about 10ms. This also warms the caches:
+	double setup_time, run_time;
+	int batch = 1;
+	for (;;)
+	{
+		setup_time = run_time = 0;
+		for (int j = 0; j < batch; j++)
+			solve(&setup_time, &run_time);
+		if (setup_time + run_time >= 10000 || batch >= (1 << 20))
+			break;
+		batch *= 2;
+	}
+
+	vector<double> setup_times, run_times, loop_rates, level_rates;
+	for (int i = 0; i < repeats; i++)
+	{
+		setup_time = run_time = 0;
+		for (int j = 0; j < batch; j++)
+			solve(&setup_time, &run_time);
+		setup_time /= batch;
+		run_time /= batch;
+
+		setup_times.push_back(setup_time);
+		run_times.push_back(run_time);
+		loop_rates.push_back(run_time > 0 ? result.Loops * 1e6 / run_time : 0);
+		level_rates.push_back(run_time > 0 ? result.Levels * 1e6 / run_time : 0);
+	}
+
+	result.SetupTime = BenchmarkStat::of(setup_times);
+	result.RunTime = BenchmarkStat::of(run_times);
+	result.LoopsPerSecond = BenchmarkStat::of(loop_rates);
+	result.LevelsPerSecond = BenchmarkStat::of(level_rates);
+	return result;
+}
+///////////////////////////////////////////////////////////////////////////////
+static void format_header(std::ostream& stream)
+{
+	stream << left << setw(24) << "Workload" << setw(9) << "Engine" << setw(10) << "Nonsharp" << right <<
+		setw(11) << "Solutions" << setw(13) << "Loops" << setw(12) << "Setup us" << setw(14) << "Run us" <<
+		setw(9) << "Spread" << setw(14) << "Loops/s" << setw(14) << "Levels/s" << endl;
+}
+///////////////////////////////////////////////////////////////////////////////
+static void format_result(const BenchmarkResult& result, std::ostream& stream)
+{
+	ios::fmtflags flags = stream.flags();
+	streamsize precision = stream.precision();
+
+	stream << left << setw(24) << result.Workload << setw(9) << result.engineName() <<
+		setw(10) << (result.NonSharpPreference ? "yes" : "no") << right <<
+		setw(11) << result.Solutions << setw(13) << result.Loops << fixed << setprecision(2) <<
+		setw(12) << result.SetupTime.Median << setw(14) << result.RunTime.Median << setprecision(0) <<
+		setw(8) << result.RunTime.spread() * 100 << "%" <<
+		setw(14) << result.LoopsPerSecond.Median << setw(14) << result.LevelsPerSecond.Median << endl;
+
+	stream.flags(flags);
+	stream.precision(precision);
+}
+///////////////////////////////////////////////////////////////////////////////
+void BenchmarkSuite::run(int repeats, std::ostream& stream)
+{
+	stream << "Running " << Workloads.size() * 4 << " benchmark cases, " << repeats << " times each." << endl;
+	format_header(stream);
+
+	for (const Workload& workload : Workloads)
+	{
+		for (bool pointer_version : { true, false })
+		{
+			for (bool non_sharp_preference : { false, true })
+			{
+				Results.push_back(runCase(workload, pointer_version, non_sharp_preference, repeats));
+				format_result(Results.back(), stream);
+			}
+		}
+	}
+}
+///////////////////////////////////////////////////////////////////////////////
+void BenchmarkSuite::format(std::ostream& stream) const
+{
+	format_header(stream);
+	for (const BenchmarkResult& result : Results)
+		format_result(result, stream);
+}
+///////////////////////////////////////////////////////////////////////////////
+static void format_stat(const char* pname, const BenchmarkStat& stat, std::ostream& stream)
+{
+	stream << ", \"" << pname << "\": {\"median\": " << stat.Median << ", \"min\": " << stat.Min <<
+		", \"max\": " << stat.Max << "}";
+}
+///////////////////////////////////////////////////////////////////////////////
+void BenchmarkSuite::formatJson(std::ostream& stream) const
+{
+	ios::fmtflags flags = stream.flags();
+	streamsize precision = stream.precision();
+	stream << fixed << setprecision(3);
+
+	stream << "{" << endl << "\"results\": [" << endl;
+	for (size_t i = 0; i < Results.size(); i++)
+	{
+		const BenchmarkResult& result = Results[i];
+
+		// Workload names are ours, so they don't need escaping:
+		stream << "{\"workload\": \"" << result.Workload << "\", \"engine\": \"" << result.engineName() <<
+			"\", \"nonsharp\": " << (result.NonSharpPreference ? "true" : "false") <<
+			", \"repeats\": " << result.Repeats << ", \"solutions\": " << result.Solutions <<
+			", \"loops\": " << result.Loops << ", \"levels\": " << result.Levels;
+		format_stat("setup_us", result.SetupTime, stream);
+		format_stat("run_us", result.RunTime, stream);
+		format_stat("loops_per_second", result.LoopsPerSecond, stream);
+		format_stat("levels_per_second", result.LevelsPerSecond, stream);
+		stream << "}" << (i + 1 < Results.size() ? "," : "") << endl;
+	}
+	stream << "]" << endl << "}" << endl;
+
+	stream.flags(flags);
+	stream.precision(precision);
+}
+///////////////////////////////////////////////////////////////////////////////
+bool BenchmarkSuite::writeJson(const char* pfile_name) const
+{
+	ofstream file(pfile_name);
+	if (!file)
+	{
+		cout << "Couldn't create benchmark file " << pfile_name << "." << endl;
+		return false;
+	}
+
+	formatJson(file);
+	return (bool)file;
+}
+///////////////////////////////////////////////////////////////////////////////
+// Helpers for reading back a line written by formatJson. pobject limits the search to
+// one of the nested objects:
+static const char* find_value(const string& line, const char* pname, const char* pobject = nullptr)
+{
+	size_t pos = 0;
+	if (pobject)
+	{
+		pos = line.find(string("\"") + pobject + "\": {");
+		if (pos == string::npos)
+			return nullptr;
+	}
+
+	pos = line.find(string("\"") + pname + "\": ", pos);
+	if (pos == string::npos)
+		return nullptr;
+	return line.c_str() + pos + strlen(pname) + 4;
+}
+
+static bool read_number(const string& line, const char* pname, double* pvalue, const char* pobject = nullptr)
+{
+	const char* pc = find_value(line, pname, pobject);
+	if (!pc)
+		return false;
+	*pvalue = strtod(pc, nullptr);
+	return true;
+}
+
+static bool read_stat(const string& line, const char* pobject, BenchmarkStat* pstat)
+{
+	return read_number(line, "median", &pstat->Median, pobject) &&
+		read_number(line, "min", &pstat->Min, pobject) &&
+		read_number(line, "max", &pstat->Max, pobject);
+}
+///////////////////////////////////////////////////////////////////////////////
+bool BenchmarkSuite::readJson(const char* pfile_name, std::vector<BenchmarkResult>* presults)
+{
+	ifstream file(pfile_name);
+	if (!file)
+	{
+		cout << "Couldn't open benchmark file " << pfile_name << "." << endl;
+		return false;
+	}
+
+	presults->clear();
+	string line;
+	while (getline(file, line))
+	{
+		const char* pworkload = find_value(line, "workload");
+		if (!pworkload)
+			continue;
+
+		BenchmarkResult result;
+		const char* pend = pworkload[0] == '"' ? strchr(pworkload + 1, '"') : nullptr;
+		const char* pengine = find_value(line, "engine");
+		const char* pnon_sharp = find_value(line, "nonsharp");
+		double repeats, solutions, loops, levels;
+
+		if (!pend || !pengine || !pnon_sharp ||
+			!read_number(line, "repeats", &repeats) || !read_number(line, "solutions", &solutions) ||
+			!read_number(line, "loops", &loops) || !read_number(line, "levels", &levels) ||
+			!read_stat(line, "setup_us", &result.SetupTime) || !read_stat(line, "run_us", &result.RunTime) ||
+			!read_stat(line, "loops_per_second", &result.LoopsPerSecond) ||
+			!read_stat(line, "levels_per_second", &result.LevelsPerSecond))
+		{
+			cout << "Benchmark file " << pfile_name << " has a line that can't be read:" << endl << line << endl;
+			return false;
+		}
+
+		result.Workload.assign(pworkload + 1, pend);
+		result.PointerVersion = strncmp(pengine, "\"pointer\"", 9) == 0;
+		result.NonSharpPreference = strncmp(pnon_sharp, "true", 4) == 0;
+		result.Repeats = (int)repeats;
+		result.Solutions = (long long)solutions;
+		result.Loops = (long long)loops;
+		result.Levels = (long long)levels;
+		presults->push_back(result);
+	}
+	return true;
+}
+///////////////////////////////////////////////////////////////////////////////
+int BenchmarkSuite::compare(const std::vector<BenchmarkResult>& baseline, double threshold_percent,
+							std::ostream& stream) const
+{
+	ios::fmtflags flags = stream.flags();
+	streamsize precision = stream.precision();
+	stream << fixed << setprecision(1);
+
+	stream << "Compared with the baseline, flagging run times more than " << threshold_percent << "% slower:" << endl;
+
+	int flagged = 0;
+	for (const BenchmarkResult& result : Results)
+	{
+		auto pbase = find_if(baseline.begin(), baseline.end(),
+			[&result](const BenchmarkResult& base) { return base.sameCase(result); });
+
+		stream << "\t" << result.Workload << ", " << result.engineName() <<
+			(result.NonSharpPreference ? ", nonsharp" : "") << ": ";
+
+		if (pbase == baseline.end())
+		{
+			stream << "not in the baseline." << endl;
+			continue;
+		}
+
+		if (pbase->Loops != result.Loops || pbase->Solutions != result.Solutions)
+		{
+			stream << "the search changed, " << pbase->Loops << " loops and " << pbase->Solutions <<
+				" solutions before, " << result.Loops << " and " << result.Solutions << " now. FLAGGED" << endl;
+			flagged++;
+			continue;
+		}
+
+		stream << setprecision(2) << pbase->RunTime.Median << " -> " << result.RunTime.Median << " us" <<
+			setprecision(1);
+		if (pbase->RunTime.Median <= 0)
+		{
+			stream << "." << endl;		// Too quick to compare.
+			continue;
+		}
+
+		double change = (result.RunTime.Median - pbase->RunTime.Median) * 100 / pbase->RunTime.Median;
+		stream << " (" << showpos << change << noshowpos << "%)";
+		if (change > threshold_percent)
+		{
+			stream << " FLAGGED";
+			flagged++;
+		}
+		stream << endl;
+	}
+
+	stream << flagged << " cases flagged." << endl;
+
+	stream.flags(flags);
+	stream.precision(precision);
+	return flagged;
+}
+///////////////////////////////////////////////////////////////////////////////
+void format_primitive_timings(const char* pengine, int sweeps, const std::vector<PrimitiveTiming>& timings,
+							  std::ostream& stream)
+{
+	ios::fmtflags flags = stream.flags();
+	streamsize precision = stream.precision();
+
+	stream << "Primitives of the " << pengine << " version, fastest of " << sweeps << " sweeps:" << endl;
+	stream << left << setw(24) << "Primitive" << right << setw(12) << "Calls" << setw(14) << "Cells" <<
+		setw(14) << "Sweep us" << setw(12) << "ns/call" << setw(12) << "ns/cell" << "  Restored" << endl;
+
+	stream << fixed;
+	for (const PrimitiveTiming& timing : timings)
+	{
+		stream << left << setw(24) << timing.pName << right << setw(12) << timing.Calls << setw(14) << timing.Cells <<
+			setprecision(1) << setw(14) << timing.Nanoseconds / 1000 << setprecision(2) <<
+			setw(12) << timing.nanosecondsPerCall() << setw(12) << timing.nanosecondsPerCell() <<
+			"  " << (timing.Restored ? "yes" : "NO") << endl;
+	}
+
+	stream.flags(flags);
+	stream.precision(precision);
+}
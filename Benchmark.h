@@ -0,0 +1,141 @@
+#pragma once
+
+// Repeatable benchmarks of both engines. Each workload is solved by AlgMPointer and by
+// the MStringValues version, with and without the non-sharp preference, a number of
+// times. The median and spread of the times are reported, and can be saved as JSON and
+// compared with a saved baseline to catch regressions.
+//
+// Problems that solve in less than about 10ms are solved repeatedly for each sample, and
+// the times are per solve.
+//
+// There are also microbenchmarks of the primitives that unlink and relink cells, which
+// show which of them got slower when whole searches do.
+
+#include <vector>
+#include <string>
+#include <iostream>
+#include <chrono>
+
+#include "Common.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// Summary of one measurement over the repeats:
+struct BenchmarkStat
+{
+	double Median = 0;
+	double Min = 0;
+	double Max = 0;
+
+	// The range as a fraction of the median:
+	double spread() const { return Median > 0 ? (Max - Min) / Median : 0; }
+
+	static BenchmarkStat of(std::vector<double> values);
+};
+///////////////////////////////////////////////////////////////////////////////
+struct BenchmarkResult
+{
+	std::string Workload;
+	bool PointerVersion = true;
+	bool NonSharpPreference = false;
+	int Repeats = 0;
+
+	// The search is deterministic, so these are the same for every solve:
+	long long Solutions = 0;
+	long long Loops = 0;
+	long long Levels = 0;
+
+	BenchmarkStat SetupTime;		// Microseconds.
+	BenchmarkStat RunTime;
+	BenchmarkStat LoopsPerSecond;
+	BenchmarkStat LevelsPerSecond;
+
+	const char* engineName() const { return PointerVersion ? "pointer" : "basic"; }
+	bool sameCase(const BenchmarkResult& other) const
+	{
+		return Workload == other.Workload && PointerVersion == other.PointerVersion &&
+			NonSharpPreference == other.NonSharpPreference;
+	}
+};
+///////////////////////////////////////////////////////////////////////////////
+class BenchmarkSuite
+{
+	struct Workload
+	{
+		std::string Name;
+		const ExactCoverWithMultiplicitiesAndColors* pProblem;
+		int MaxResults;
+	};
+	std::vector<Workload> Workloads;
+
+	BenchmarkResult runCase(const Workload& workload, bool pointer_version, bool non_sharp_preference, int repeats);
+
+public:
+	std::vector<BenchmarkResult> Results;
+
+	// The problem, and anything it points to, has to stay valid until the suite has run:
+	void add(const std::string& name, const ExactCoverWithMultiplicitiesAndColors& problem, int max_results);
+
+	// Runs every workload with both engines, with and without the heuristic, printing
+	// each result as it goes:
+	void run(int repeats, std::ostream& stream = std::cout);
+
+	void format(std::ostream& stream = std::cout) const;
+
+	// One result per line, so files diff well:
+	void formatJson(std::ostream& stream) const;
+	bool writeJson(const char* pfile_name) const;
+	// Only reads files written by writeJson:
+	static bool readJson(const char* pfile_name, std::vector<BenchmarkResult>* presults);
+
+	// Compares the median run times with the baseline's, reporting each case and flagging
+	// those that got slower by more than threshold_percent. Cases whose loop or solution
+	// counts changed are flagged too, since they no longer measure the same search.
+	// Returns the number of cases flagged.
+	int compare(const std::vector<BenchmarkResult>& baseline, double threshold_percent,
+				std::ostream& stream = std::cout) const;
+};
+///////////////////////////////////////////////////////////////////////////////
+// Each engine sweeps each primitive, with its inverse, over every item or cell it applies
+// to, and checks the structure is restored afterwards. See AlgMPointer::benchmarkPrimitives
+// and benchmark_exact_cover_with_multiplicities_and_colors_primitives.
+enum BenchmarkPrimitives : int
+{
+	bp_Cover,		// Cover and uncover each item.
+	bp_Hide,		// Hide and unhide each cell's sequence.
+	bp_Color,		// Set and clear the color of each colored cell (purify and unpurify in Knuth).
+	bp_Tweak,		// Tweak each sequence of each primary item in turn, then untweak them all.
+	bp_Count
+};
+
+struct PrimitiveTiming
+{
+	const char* pName;
+	long long Calls = 0;		// Of the primitive, in one sweep.
+	long long Cells = 0;		// Unlinked and relinked in one sweep.
+	double Nanoseconds = 0;		// The fastest sweep.
+	bool Restored = false;
+
+	double nanosecondsPerCall() const { return Calls > 0 ? Nanoseconds / Calls : 0; }
+	double nanosecondsPerCell() const { return Cells > 0 ? Nanoseconds / Cells : 0; }
+};
+
+void format_primitive_timings(const char* pengine, int sweeps, const std::vector<PrimitiveTiming>& timings,
+							  std::ostream& stream = std::cout);
+
+// Runs sweep the given number of times, returning the fastest in nanoseconds:
+template<class Sweep>
+double fastest_sweep(int sweeps, Sweep sweep)
+{
+	double fastest = 0;
+	for (int i = 0; i < sweeps; i++)
+	{
+		auto start_time = std::chrono::steady_clock::now();
+		sweep();
+		auto end_time = std::chrono::steady_clock::now();
+
+		double time = std::chrono::duration<double, std::nano>(end_time - start_time).count();
+		if (i == 0 || time < fastest)
+			fastest = time;
+	}
+	return fastest;
+}
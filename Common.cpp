@@ -76,7 +76,7 @@ bool print_diff(std::string s1, std::string s2)
 		equal = false;
 		result.push_back(*p1++);
 	}
-	while (*p1)
+	while (*p2)
 	{
 		equal = false;
 		result.push_back(*p2++);
@@ -123,7 +123,8 @@ void ExactCoverWithMultiplicitiesAndColors::format(std::ostream& stream) const
 ///////////////////////////////////////////////////////////////////////////////
 void ExactCoverWithMultiplicitiesAndColors::assertValid() const
 {
-
+	// Everything here is only for the asserts, so don't build the sets in a release build:
+#ifndef NDEBUG
 	std::map<const char*, int, CmpSame> primaries_set;		// All we really need is an unordered set...
 	std::map<const char*, int, CmpSame> secondaries_set;
 	std::map<const char*, int, CmpSame> colors_set;
@@ -153,6 +154,14 @@ void ExactCoverWithMultiplicitiesAndColors::assertValid() const
 		colors_set[pc] = 0;
 	}
 
+	// Costs are optional, but if present there must be one for each sequence. The
+	// lower bound used by the minimum cost search assumes they are not negative.
+	assert(costs.empty() || costs.size() == sequences.size());
+	for (auto cost : costs)
+	{
+		assert(cost >= 0);
+	}
+
 	char* buf = (char*)_alloca(max_len + 1);
 	for (int i = 0; i < sequences.size(); i++)
 	{
@@ -177,6 +186,7 @@ void ExactCoverWithMultiplicitiesAndColors::assertValid() const
 			}
 		}
 	}
+#endif
 }
 ///////////////////////////////////////////////////////////////////////////////
 void ExactCoverWithMultiplicitiesAndColors::format_sequence(int idx_seq, std::ostream& stream) const
@@ -202,5 +212,206 @@ void ExactCoverWithMultiplicitiesAndColors::format_solution(std::vector<std::vec
 	}
 }
 ///////////////////////////////////////////////////////////////////////////////
+void CompactExactCover::clear()
+{
+	PrimaryItems = 0;
+	ItemNames.clear();
+	Min.clear();
+	Max.clear();
+	ColorNames.clear();
+	SequenceStarts.assign(1, 0);
+	Cells.clear();
+	Costs.clear();
+	EmitCells = nullptr;
+}
+///////////////////////////////////////////////////////////////////////////////
+int CompactExactCover::addPrimary(const char* pname, int u, int v)
+{
+	assert(PrimaryItems == items());		// No secondary items yet.
+	ItemNames.push_back(pname);
+	Min.push_back(u);
+	Max.push_back(v);
+	return PrimaryItems++;
+}
+///////////////////////////////////////////////////////////////////////////////
+int CompactExactCover::addSecondary(const char* pname)
+{
+	ItemNames.push_back(pname);
+	return items() - 1;
+}
+///////////////////////////////////////////////////////////////////////////////
+int CompactExactCover::addColor(const char* pname)
+{
+	ColorNames.push_back(pname);
+	return (int)ColorNames.size();
+}
+///////////////////////////////////////////////////////////////////////////////
+void CompactExactCover::assign(const ExactCoverWithMultiplicitiesAndColors& problem)
+{
+	clear();
+
+	ItemIndex.clear();
+	for (auto& option : problem.primary_options)
+		ItemIndex.emplace(option.pValue, addPrimary(option.pValue, option.u, option.v));
+	for (const char* pc : problem.secondary_options)
+		ItemIndex.emplace(pc, addSecondary(pc));
+
+	ColorIndex.clear();
+	for (const char* pc : problem.colors)
+		ColorIndex.emplace(pc, addColor(pc));
+
+	size_t ncells = 0;
+	for (auto& seq : problem.sequences)
+		ncells += seq.size();
+	Cells.reserve(ncells);
+	SequenceStarts.reserve(problem.sequences.size() + 1);
+
+	for (auto& seq : problem.sequences)
+	{
+		for (const char* pc : seq)
+		{
+			// The separator means the item has an assigned color:
+			const char* sep = strchr(pc, ':');
+			int color = 0;
+			if (sep)
+			{
+				Name.assign(pc, sep - pc);
+				auto it = ColorIndex.find(sep + 1);
+				assert(it != ColorIndex.end());
+				color = it->second;
+			}
+			else
+			{
+				Name = pc;
+			}
+
+			auto it = ItemIndex.find(Name);
+			assert(it != ItemIndex.end());
+			addCell(it->second, color);
+		}
+		endSequence();
+	}
+	Costs = problem.costs;
+}
+///////////////////////////////////////////////////////////////////////////////
+// Only counts, for the sequence starts of a streamed problem:
+struct SequenceCounter : CellSink
+{
+	std::vector<int>* pStarts;
+	int Cells = 0;
+
+	SequenceCounter(std::vector<int>* pstarts) : pStarts(pstarts) {}
+
+	void addCell(int, int) override { Cells++; }
+	void endSequence() override { pStarts->push_back(Cells); }
+};
+
+void CompactExactCover::stream(const std::function<void(CellSink&)>& emit)
+{
+	Cells.clear();
+	Cells.shrink_to_fit();
+	SequenceStarts.assign(1, 0);
+
+	SequenceCounter counter(&SequenceStarts);
+	emit(counter);
+	EmitCells = emit;
+}
+///////////////////////////////////////////////////////////////////////////////
+void CompactExactCover::fillCells()
+{
+	if (!streamed())
+		return;
+
+	// Emitting adds the sequence starts again:
+	std::function<void(CellSink&)> emit;
+	emit.swap(EmitCells);
+	int nsequences = sequences();
+	size_t ncells = cells();
+	SequenceStarts.assign(1, 0);
+	reserve(nsequences, ncells);
+
+	emit(*this);
+	assert(sequences() == nsequences && Cells.size() == ncells);
+}
+///////////////////////////////////////////////////////////////////////////////
+void CompactExactCover::emitCells(CellSink& sink) const
+{
+	if (streamed())
+	{
+		EmitCells(sink);
+		return;
+	}
+
+	for (int i = 0; i < sequences(); i++)
+	{
+		for (int c = SequenceStarts[i]; c < SequenceStarts[i + 1]; c++)
+			sink.addCell(Cells[c].Item, Cells[c].Color);
+		sink.endSequence();
+	}
+}
+///////////////////////////////////////////////////////////////////////////////
+void CompactExactCover::assertValid() const
+{
+	assert(PrimaryItems <= items());
+	assert((int)Min.size() == PrimaryItems && (int)Max.size() == PrimaryItems);
+	for (int i = 0; i < PrimaryItems; i++)
+		assert(0 <= Min[i] && Min[i] <= Max[i]);
+
+	assert(SequenceStarts.size() >= 1 && SequenceStarts[0] == 0);
+	assert(streamed() ? Cells.empty() : SequenceStarts.back() == (int)Cells.size());
+	assert(Costs.empty() || (int)Costs.size() == sequences());
+#ifndef NDEBUG
+	for (auto cost : Costs)
+		assert(cost >= 0);
+
+	// Primary items are never colored, and secondary ones always are:
+	for (auto& cell : Cells)
+	{
+		assert(0 <= cell.Item && cell.Item < items());
+		assert(0 <= cell.Color && cell.Color <= (int)ColorNames.size());
+		assert((cell.Item < PrimaryItems) == (cell.Color == 0));
+	}
+#endif
+}
+///////////////////////////////////////////////////////////////////////////////
+void CompactExactCover::format(std::ostream& stream) const
+{
+	stream << "CompactExactCover problem." << std::endl;
 
+	stream << PrimaryItems << " primary options." << std::endl;
+	for (int i = 0; i < PrimaryItems; i++)
+		stream << "\t" << Min[i] << " <= m <= " << Max[i] << ", " << ItemNames[i] << std::endl;
+
+	stream << ColorNames.size() << " colors." << std::endl;
+	for (auto pc : ColorNames)
+		stream << "\t" << pc << std::endl;
+
+	stream << secondaryItems() << " secondary options." << std::endl;
+	for (int i = PrimaryItems; i < items(); i++)
+		stream << "\t" << ItemNames[i] << std::endl;
+
+	if (streamed())
+	{
+		stream << sequences() << " sequences, streamed." << std::endl;
+		return;
+	}
 
+	stream << sequences() << " sequences." << std::endl;
+	for (int i = 0; i < sequences(); i++)
+		format_sequence(i, stream);
+}
+///////////////////////////////////////////////////////////////////////////////
+void CompactExactCover::format_sequence(int idx_seq, std::ostream& stream) const
+{
+	assert(!streamed());
+	stream << "\t";
+	for (int c = SequenceStarts[idx_seq]; c < SequenceStarts[idx_seq + 1]; c++)
+	{
+		stream << ItemNames[Cells[c].Item];
+		if (Cells[c].Color && *ColorNames[Cells[c].Color - 1])
+			stream << ":" << ColorNames[Cells[c].Color - 1];
+		stream << "   ";
+	}
+	stream << std::endl;
+}
+///////////////////////////////////////////////////////////////////////////////
@@ -6,10 +6,12 @@
 
 
 #include <cassert>
+#include <functional>
 #include <string>
 #include <iostream>
 #include <vector>
 #include <map>
+#include <unordered_map>
 #include <unordered_set>
 
 // Want conditional output that completely compiles away when not needed.
@@ -54,6 +56,19 @@ void print_sequences(const std::vector< std::vector<const char*> >& sequences);
 // above.
 bool print_diff(std::string s1, std::string s2);
 ///////////////////////////////////////////////////////////////////////////////
+// Grow only buffer, for code that is set up over and over again with problems of
+// different sizes. The contents are not preserved when it grows.
+template<class T>
+void reserve_buffer(T*& p, size_t* pcapacity, size_t size)
+{
+	if (size <= *pcapacity && p)
+		return;
+
+	delete[] p;
+	p = new T[size > 0 ? size : 1];
+	*pcapacity = size;
+}
+///////////////////////////////////////////////////////////////////////////////
 // Special comparator so we can make a map of string pointers eliminating
 // duplicates:
 struct CmpSame
@@ -80,6 +95,15 @@ struct ExactCoverWithMultiplicitiesAndColors
 	std::vector<const char*> secondary_options;
 	std::vector< std::vector<const char*> > sequences;
 
+	// Optional cost of each sequence, used when searching for the cheapest solutions.
+	// Either empty, in which case every sequence costs 0, or the same size as sequences.
+	std::vector<int> costs;
+
+	int sequenceCost(int idx_seq) const
+	{
+		return costs.empty() ? 0 : costs[idx_seq];
+	}
+
 	void format(std::ostream& stream) const;
 	
 	void assertValid() const;
@@ -98,4 +122,110 @@ struct ExactCoverWithMultiplicitiesAndColors
 		format_solution(results, std::cout);
 	}
 };
+///////////////////////////////////////////////////////////////////////////////
+// Takes the cells of a numbered problem (see below) a sequence at a time, so a generator
+// can emit them straight into an engine's arrays:
+struct CellSink
+{
+	virtual ~CellSink() {}
+
+	virtual void addCell(int item, int color = 0) = 0;
+	virtual void endSequence() = 0;
+};
+///////////////////////////////////////////////////////////////////////////////
+// The same problem with its items and colors numbered. The primary items come first,
+// then the secondary ones, and the cells of all the sequences are in one array: sequence
+// i's are from SequenceStarts[i] up to SequenceStarts[i + 1]. The names are only kept
+// for printing, and for the non-sharp preference, which looks for a '#'.
+//
+// A generator can fill one in without formatting a name for every cell, and the engines
+// set up from it in one pass over the cells. They convert the string form with assign.
+//
+// Or it can stream the problem, leaving a function that emits the cells instead. Only
+// the sequence starts are filled in, by a pass that counts, and the engines run it again
+// to set up, so the cells are only ever held by them.
+struct CompactExactCover : CellSink
+{
+	struct Cell
+	{
+		int Item;
+		int Color;		// 1 + the index in ColorNames, or 0 if not colored.
+	};
+
+	int PrimaryItems = 0;
+	std::vector<const char*> ItemNames;		// Primary items, then secondary ones.
+	std::vector<int> Min;					// Of each primary item, u in Knuth,
+	std::vector<int> Max;					// and v.
+	std::vector<const char*> ColorNames;	// A color only one cell has can have an empty name.
+
+	std::vector<int> SequenceStarts = { 0 };
+	std::vector<Cell> Cells;
+
+	// Optional, as in ExactCoverWithMultiplicitiesAndColors:
+	std::vector<int> Costs;
+
+	// Set instead of the cells for a streamed problem. It usually calls the generator, which
+	// has to outlive it:
+	std::function<void(CellSink&)> EmitCells;
+
+	int items() const { return (int)ItemNames.size(); }
+	int secondaryItems() const { return items() - PrimaryItems; }
+	int sequences() const { return (int)SequenceStarts.size() - 1; }
+	int cells() const { return SequenceStarts.back(); }
+	bool streamed() const { return (bool)EmitCells; }
+	int sequenceCost(int idx_seq) const { return Costs.empty() ? 0 : Costs[idx_seq]; }
+
+	// Empties the problem, keeping the capacity:
+	void clear();
+
+	// Adding returns the new number. All the primary items have to come first:
+	int addPrimary(const char* pname, int u = 1, int v = 1);
+	int addSecondary(const char* pname);
+	int addColor(const char* pname);
+
+	void addCell(int item, int color = 0) final
+	{
+		Cells.push_back({ item, color });
+	}
+	void endSequence() final
+	{
+		SequenceStarts.push_back((int)Cells.size());
+	}
+
+	// Makes the problem a streamed one, and counts the cells of each sequence. The items
+	// and any costs are filled in as usual:
+	void stream(const std::function<void(CellSink&)>& emit);
+	// Fills in the cells of a streamed problem, e.g. to print solutions once the engine is
+	// done with it. Does nothing if it already has them:
+	void fillCells();
+	// The cells held, or what the function emits:
+	void emitCells(CellSink& sink) const;
+
+	// For a generator that can count what it will add, so the arrays are allocated once
+	// instead of growing, which briefly holds the cells twice:
+	void reserve(int sequences, size_t cells)
+	{
+		SequenceStarts.reserve(sequences + 1);
+		Cells.reserve(cells);
+	}
+
+	// Numbers the items and colors in the order the problem lists them. The names still
+	// point at the problem's:
+	void assign(const ExactCoverWithMultiplicitiesAndColors& problem);
+
+	void assertValid() const;
+
+	void format(std::ostream& stream) const;
+	void format_sequence(int idx_seq, std::ostream& stream) const;
+
+	void print() const
+	{
+		format(std::cout);
+	}
+
+	// Only used by assign, kept so they keep their buckets:
+	std::unordered_map<std::string, int> ItemIndex;
+	std::unordered_map<std::string, int> ColorIndex;
+	std::string Name;
+};
 
@@ -0,0 +1,488 @@
+
+#include <algorithm>
+#include <random>
+#include <chrono>
+#include <cstring>
+#include <memory>
+
+#include "DifferentialFuzz.h"
+#include "Solver.h"
+
+using namespace std;
+///////////////////////////////////////////////////////////////////////////////
+// Every engine is asked for all the solutions. The problems are small enough that there
+// are never this many:
+static const int max_fuzz_results = 1 << 20;
+///////////////////////////////////////////////////////////////////////////////
+DifferentialFuzzer::DifferentialFuzzer(const FuzzLimits& limits) : Limits(limits)
+{
+	Alg.setVerbose(false);
+}
+///////////////////////////////////////////////////////////////////////////////
+const char* DifferentialFuzzer::intern(const std::string& s)
+{
+	auto iter = Interned.find(s);
+	if (iter != Interned.end())
+		return iter->second;
+
+	Strings.push_back(s);
+	const char* pc = Strings.back().c_str();
+	Interned[s] = pc;
+	return pc;
+}
+///////////////////////////////////////////////////////////////////////////////
+void DifferentialFuzzer::addEngine(const std::string& name, const FuzzSolver& solve)
+{
+	Engines.push_back({ name, solve });
+}
+///////////////////////////////////////////////////////////////////////////////
+void DifferentialFuzzer::addDefaultEngines()
+{
+	// Every engine in the registry. Auto is left out since it is one of the others:
+	for (const string& name : solver_names())
+	{
+		if (name == "auto")
+			continue;
+
+		for (bool non_sharp_preference : { false, true })
+		{
+			shared_ptr<Solver> psolver(create_solver(name));
+			SolverOptions options;
+			options.NonSharpPreference = non_sharp_preference;
+			options.Verbose = false;
+			psolver->setOptions(options);
+
+			addEngine(name + (non_sharp_preference ? " nonsharp" : ""),
+				[psolver](const ExactCoverWithMultiplicitiesAndColors& problem, vector<vector<int>>* presults)
+				{
+					psolver->solve(problem, presults, max_fuzz_results);
+					return true;
+				});
+		}
+	}
+
+	// The renumbered and sorted problems have to map their solutions back:
+	for (const string& name : solver_names())
+	{
+		if (name == "auto")
+			continue;
+
+		for (int policy = vo_Input; policy <= vo_Random; policy++)
+		{
+			shared_ptr<Solver> psolver(create_solver(name));
+			SolverOptions options;
+			options.Verbose = false;
+			// Input order is already covered, so that one renumbers:
+			options.Locality = policy == vo_Input;
+			options.Ordering = (ValueOrderPolicy)policy;
+			psolver->setOptions(options);
+
+			addEngine(name + (options.Locality ? " locality" : string(" order=") + value_order_name(options.Ordering)),
+				[psolver](const ExactCoverWithMultiplicitiesAndColors& problem, vector<vector<int>>* presults)
+				{
+					psolver->solve(problem, presults, max_fuzz_results);
+					return true;
+				});
+		}
+	}
+
+	// Searching each shard and putting the results together should find the same solutions
+	// as a single search. A small depth is enough to get a few shards from these problems:
+	addEngine("pointer sharded",
+		[this](const ExactCoverWithMultiplicitiesAndColors& problem, vector<vector<int>>* presults)
+		{
+			Alg.reset(problem);
+			Alg.setHeuristic(false);
+
+			vector<vector<int>> prefixes;
+			Alg.enumeratePrefixes(2, &prefixes);
+			for (auto& prefix : prefixes)
+			{
+				vector<vector<int>> results;
+				Alg.exactCoverFromPrefix(prefix, &results, max_fuzz_results);
+				presults->insert(presults->end(), results.begin(), results.end());
+			}
+			return true;
+		});
+	addEngine("brute force", bruteForce);
+}
+///////////////////////////////////////////////////////////////////////////////
+// Tries every subset of the sequences, so it is only used for small problems. Nothing
+// clever, so there's little to get wrong.
+bool DifferentialFuzzer::bruteForce(const ExactCoverWithMultiplicitiesAndColors& problem, std::vector<std::vector<int>>* presults)
+{
+	size_t nsequences = problem.sequences.size();
+	if (nsequences > 16)
+		return false;
+
+	vector<int> counts(problem.primary_options.size());
+	map<string, string> item_colors;		// For the secondary items used so far.
+	for (uint32_t subset = 0; subset < (1u << nsequences); subset++)
+	{
+		fill(counts.begin(), counts.end(), 0);
+		item_colors.clear();
+		bool valid = true;
+
+		for (size_t i = 0; i < nsequences && valid; i++)
+		{
+			if (!(subset & (1u << i)))
+				continue;
+
+			for (const char* pc : problem.sequences[i])
+			{
+				const char* sep = strchr(pc, ':');
+				if (sep)
+				{
+					string item(pc, sep);
+					auto iter = item_colors.find(item);
+					if (iter == item_colors.end())
+						item_colors[item] = sep + 1;
+					else if (iter->second != sep + 1)
+						valid = false;
+					continue;
+				}
+
+				for (size_t j = 0; j < problem.primary_options.size(); j++)
+				{
+					if (strcmp(problem.primary_options[j].pValue, pc) == 0)
+						counts[j]++;
+				}
+			}
+		}
+
+		for (size_t j = 0; j < problem.primary_options.size() && valid; j++)
+		{
+			valid = counts[j] >= problem.primary_options[j].u && counts[j] <= problem.primary_options[j].v;
+		}
+
+		if (valid)
+		{
+			presults->emplace_back();
+			for (size_t i = 0; i < nsequences; i++)
+			{
+				if (subset & (1u << i))
+					presults->back().push_back((int)i);
+			}
+		}
+	}
+	return true;
+}
+///////////////////////////////////////////////////////////////////////////////
+void DifferentialFuzzer::generate(uint32_t seed, ExactCoverWithMultiplicitiesAndColors* pproblem)
+{
+	// mt19937 gives the same numbers everywhere, which the standard distributions don't:
+	mt19937 rng(seed);
+	auto random = [&rng](int lo, int hi) { return lo + (int)(rng() % (uint32_t)(hi - lo + 1)); };
+
+	*pproblem = ExactCoverWithMultiplicitiesAndColors();
+
+	int nprimary = random(1, Limits.MaxPrimaryItems);
+	int nsecondary = random(0, Limits.MaxSecondaryItems);
+	int ncolors = nsecondary > 0 ? random(1, Limits.MaxColors) : 0;
+	int nsequences = random(1, Limits.MaxSequences);
+
+	// Some are plain exact cover, which the engines search with kernels of their own:
+	bool exact_cover = random(0, 3) == 0;
+
+	for (int i = 0; i < nprimary; i++)
+	{
+		// Names starting with # are the ones the non-sharp preference puts off:
+		ExactCoverWithMultiplicitiesAndColors::PrimaryOption option;
+		option.pValue = intern((random(0, 3) == 0 ? "#p" : "p") + to_string(i));
+		option.u = exact_cover ? 1 : random(0, Limits.MaxMultiplicity);
+		option.v = exact_cover ? 1 : random(max(option.u, 1), Limits.MaxMultiplicity);
+		pproblem->primary_options.push_back(option);
+	}
+	for (int i = 0; i < nsecondary; i++)
+		pproblem->secondary_options.push_back(intern("s" + to_string(i)));
+	for (int i = 0; i < ncolors; i++)
+		pproblem->colors.push_back(intern("c" + to_string(i)));
+
+	// Some primary items aren't in any sequence, which only leaves solutions if u is 0:
+	int ncovered = random(0, 3) == 0 ? random(1, nprimary) : nprimary;
+
+	vector<bool> used(nprimary + nsecondary);
+	for (int i = 0; i < nsequences; i++)
+	{
+		fill(used.begin(), used.end(), false);
+		vector<const char*> sequence;
+
+		int length = random(1, Limits.MaxSequenceLength);
+		for (int j = 0; j < length; j++)
+		{
+			// The first item is always primary:
+			int idx_item = j == 0 ? random(0, ncovered - 1) : random(0, ncovered + nsecondary - 1);
+			if (idx_item >= ncovered)
+				idx_item += nprimary - ncovered;
+			if (used[idx_item])
+				continue;
+			used[idx_item] = true;
+
+			if (idx_item < nprimary)
+				sequence.push_back(pproblem->primary_options[idx_item].pValue);
+			else
+				sequence.push_back(intern(string(pproblem->secondary_options[idx_item - nprimary]) + ":" +
+					pproblem->colors[random(0, ncolors - 1)]));
+		}
+		pproblem->sequences.push_back(sequence);
+	}
+}
+///////////////////////////////////////////////////////////////////////////////
+bool DifferentialFuzzer::agree(const ExactCoverWithMultiplicitiesAndColors& problem)
+{
+	assert(Engines.size() > 0);
+	problem.assertValid();
+
+	SolvedBy.resize(Engines.size());
+	Solutions.resize(Engines.size());
+
+	bool same = true;
+	int first = -1;
+	for (size_t i = 0; i < Engines.size(); i++)
+	{
+		vector<vector<int>>& solutions = Solutions[i];
+		solutions.clear();
+		SolvedBy[i].clear();
+		if (!Engines[i].Solve(problem, &solutions))
+			continue;
+		SolvedBy[i] = Engines[i].Name;
+
+		for (vector<int>& solution : solutions)
+			sort(solution.begin(), solution.end());
+		sort(solutions.begin(), solutions.end());
+		SolutionsCompared += solutions.size();
+
+		if (first < 0)
+			first = (int)i;
+		else if (solutions != Solutions[first])
+			same = false;
+	}
+	return same;
+}
+///////////////////////////////////////////////////////////////////////////////
+bool DifferentialFuzzer::removePrimaryItem(ExactCoverWithMultiplicitiesAndColors* pproblem, size_t idx)
+{
+	// There has to be one left:
+	if (idx >= pproblem->primary_options.size() || pproblem->primary_options.size() == 1)
+		return false;
+
+	const char* pname = pproblem->primary_options[idx].pValue;
+	pproblem->primary_options.erase(pproblem->primary_options.begin() + idx);
+
+	for (size_t i = 0; i < pproblem->sequences.size(); )
+	{
+		vector<const char*>& sequence = pproblem->sequences[i];
+		sequence.erase(remove(sequence.begin(), sequence.end(), pname), sequence.end());
+
+		// Sequences need a primary item, and those have no colon:
+		bool has_primary = any_of(sequence.begin(), sequence.end(), [](const char* pc) { return !strchr(pc, ':'); });
+		if (has_primary)
+			i++;
+		else
+			pproblem->sequences.erase(pproblem->sequences.begin() + i);
+	}
+	return true;
+}
+///////////////////////////////////////////////////////////////////////////////
+bool DifferentialFuzzer::removeSecondaryItem(ExactCoverWithMultiplicitiesAndColors* pproblem, size_t idx)
+{
+	if (idx >= pproblem->secondary_options.size())
+		return false;
+
+	string prefix = string(pproblem->secondary_options[idx]) + ":";
+	pproblem->secondary_options.erase(pproblem->secondary_options.begin() + idx);
+
+	for (vector<const char*>& sequence : pproblem->sequences)
+	{
+		sequence.erase(remove_if(sequence.begin(), sequence.end(),
+			[&prefix](const char* pc) { return strncmp(pc, prefix.c_str(), prefix.size()) == 0; }), sequence.end());
+	}
+	return true;
+}
+///////////////////////////////////////////////////////////////////////////////
+// Merges the color into another one.
+bool DifferentialFuzzer::removeColor(ExactCoverWithMultiplicitiesAndColors* pproblem, size_t idx)
+{
+	if (idx >= pproblem->colors.size() || pproblem->colors.size() == 1)
+		return false;
+
+	string color = pproblem->colors[idx];
+	const char* preplacement = pproblem->colors[idx == 0 ? 1 : 0];
+	pproblem->colors.erase(pproblem->colors.begin() + idx);
+
+	for (vector<const char*>& sequence : pproblem->sequences)
+	{
+		for (const char*& pc : sequence)
+		{
+			const char* sep = strchr(pc, ':');
+			if (sep && color == sep + 1)
+				pc = intern(string(pc, sep + 1) + preplacement);
+		}
+	}
+	return true;
+}
+///////////////////////////////////////////////////////////////////////////////
+void DifferentialFuzzer::shrink(ExactCoverWithMultiplicitiesAndColors* pproblem)
+{
+	ExactCoverWithMultiplicitiesAndColors candidate;
+
+	// Keeps the candidate if the engines still disagree on it:
+	auto keep = [this, pproblem, &candidate]()
+	{
+		if (agree(candidate))
+			return false;
+		*pproblem = candidate;
+		return true;
+	};
+
+	bool changed = true;
+	while (changed)
+	{
+		changed = false;
+
+		// Indices only move on when nothing was removed, since a removal moves the rest down:
+		for (size_t i = 0; i < pproblem->sequences.size() && pproblem->sequences.size() > 1; )
+		{
+			candidate = *pproblem;
+			candidate.sequences.erase(candidate.sequences.begin() + i);
+			if (keep())
+				changed = true;
+			else
+				i++;
+		}
+
+		for (size_t i = 0; i < pproblem->primary_options.size(); )
+		{
+			candidate = *pproblem;
+			if (removePrimaryItem(&candidate, i) && !candidate.sequences.empty() && keep())
+				changed = true;
+			else
+				i++;
+		}
+
+		for (size_t i = 0; i < pproblem->secondary_options.size(); )
+		{
+			candidate = *pproblem;
+			if (removeSecondaryItem(&candidate, i) && keep())
+				changed = true;
+			else
+				i++;
+		}
+
+		for (size_t i = 0; i < pproblem->colors.size(); )
+		{
+			candidate = *pproblem;
+			if (removeColor(&candidate, i) && keep())
+				changed = true;
+			else
+				i++;
+		}
+
+		// Colors no sequence uses any more can go too:
+		if (pproblem->secondary_options.empty() && !pproblem->colors.empty())
+		{
+			candidate = *pproblem;
+			candidate.colors.clear();
+			if (keep())
+				changed = true;
+		}
+
+		// Lower the multiplicities, one step at a time:
+		for (size_t i = 0; i < pproblem->primary_options.size(); i++)
+		{
+			candidate = *pproblem;
+			ExactCoverWithMultiplicitiesAndColors::PrimaryOption& option = candidate.primary_options[i];
+			if (option.v > max(option.u, 1))
+				option.v--;
+			else if (option.u > 0)
+				option.u--;
+			else
+				continue;
+			if (keep())
+				changed = true;
+		}
+	}
+
+	// Leave the solutions for the shrunk problem, for report:
+	agree(*pproblem);
+}
+///////////////////////////////////////////////////////////////////////////////
+void DifferentialFuzzer::report(const ExactCoverWithMultiplicitiesAndColors& problem, std::ostream& stream)
+{
+	agree(problem);
+
+	problem.format(stream);
+	for (size_t i = 0; i < Engines.size(); i++)
+	{
+		if (SolvedBy[i].empty())
+		{
+			stream << Engines[i].Name << " skipped the problem." << endl;
+			continue;
+		}
+
+		stream << Engines[i].Name << " found " << Solutions[i].size() << " solutions:";
+		for (const vector<int>& solution : Solutions[i])
+		{
+			stream << " {";
+			for (size_t j = 0; j < solution.size(); j++)
+				stream << (j > 0 ? " " : "") << solution[j];
+			stream << "}";
+		}
+		stream << endl;
+	}
+}
+///////////////////////////////////////////////////////////////////////////////
+void DifferentialFuzzer::regressions(std::vector<ExactCoverWithMultiplicitiesAndColors>* pproblems)
+{
+	pproblems->clear();
+
+	// An item with u = 0 that no sequence has. Choosing it followed links that were never set:
+	pproblems->emplace_back();
+	ExactCoverWithMultiplicitiesAndColors& problem = pproblems->back();
+	problem.primary_options.push_back({ intern("p0"), 0, 1 });
+	problem.primary_options.push_back({ intern("p1"), 0, 1 });
+	problem.sequences.push_back({ intern("p1") });
+}
+///////////////////////////////////////////////////////////////////////////////
+bool DifferentialFuzzer::run(uint32_t first_seed, double seconds, long long max_problems, std::ostream& stream)
+{
+	auto start_time = chrono::steady_clock::now();
+	ExactCoverWithMultiplicitiesAndColors problem;
+
+	vector<ExactCoverWithMultiplicitiesAndColors> problems;
+	regressions(&problems);
+	for (size_t i = 0; i < problems.size(); i++)
+	{
+		ProblemsTried++;
+		if (agree(problems[i]))
+			continue;
+
+		stream << "The engines disagree on regression problem " << i + 1 << ":" << endl;
+		report(problems[i], stream);
+		return false;
+	}
+
+	for (uint32_t seed = first_seed; ProblemsTried < max_problems; seed++)
+	{
+		chrono::duration<double> elapsed = chrono::steady_clock::now() - start_time;
+		if (elapsed.count() >= seconds)
+			break;
+
+		generate(seed, &problem);
+		ProblemsTried++;
+		if (agree(problem))
+			continue;
+
+		size_t sequences = problem.sequences.size();
+		shrink(&problem);
+		stream << "The engines disagree on the problem from seed=" << seed << ". Shrunk from " << sequences <<
+			" to " << problem.sequences.size() << " sequences:" << endl;
+		report(problem, stream);
+		return false;
+	}
+
+	chrono::duration<double> elapsed = chrono::steady_clock::now() - start_time;
+	stream << "The engines agreed on " << ProblemsTried << " problems with " << SolutionsCompared <<
+		" solutions between them, in " << elapsed.count() << " seconds." << endl;
+	return true;
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+// Differential fuzzing of the engines. Random valid problems are solved by every engine,
+// and by brute force when they are small enough, and the solution sets are compared.
+// When the engines disagree, the problem is shrunk: sequences, items and colors are
+// removed and multiplicities lowered for as long as they still disagree, so what is left
+// is small enough to debug by hand.
+//
+// The problems stay within what both engines support: every sequence has a primary item
+// and every use of a secondary item has a color. Primary items may have u = 0, and some
+// are left out of every sequence.
+
+#include <vector>
+#include <deque>
+#include <map>
+#include <string>
+#include <functional>
+#include <iostream>
+#include <cstdint>
+
+#include "Common.h"
+#include "AlgMPointer.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// Fills in every solution. Returns false if the engine can't take the problem, in which
+// case it is left out of the comparison:
+typedef std::function<bool(const ExactCoverWithMultiplicitiesAndColors& problem,
+							std::vector<std::vector<int>>* presults)> FuzzSolver;
+
+struct FuzzEngine
+{
+	std::string Name;
+	FuzzSolver Solve;
+};
+///////////////////////////////////////////////////////////////////////////////
+// Sizes of the random problems:
+struct FuzzLimits
+{
+	int MaxPrimaryItems = 5;
+	int MaxSecondaryItems = 3;
+	int MaxColors = 3;
+	int MaxSequences = 10;
+	int MaxSequenceLength = 4;
+	int MaxMultiplicity = 3;
+};
+///////////////////////////////////////////////////////////////////////////////
+class DifferentialFuzzer
+{
+	FuzzLimits Limits;
+	std::vector<FuzzEngine> Engines;
+
+	// The problems point into this, so each name is made once and kept:
+	std::deque<std::string> Strings;
+	std::map<std::string, const char*> Interned;
+	const char* intern(const std::string& s);
+
+	AlgMPointer Alg;		// Reused by the pointer engines.
+
+	// Each engine's solutions, with the sequences in each solution sorted, and the
+	// solutions sorted, so they can be compared. Engines that skipped the problem get
+	// an empty name:
+	std::vector<std::string> SolvedBy;
+	std::vector<std::vector<std::vector<int>>> Solutions;
+
+	static bool bruteForce(const ExactCoverWithMultiplicitiesAndColors& problem, std::vector<std::vector<int>>* presults);
+
+	// Shrinking steps. Each returns false if there's nothing at that index to remove:
+	bool removePrimaryItem(ExactCoverWithMultiplicitiesAndColors* pproblem, size_t idx);
+	bool removeSecondaryItem(ExactCoverWithMultiplicitiesAndColors* pproblem, size_t idx);
+	bool removeColor(ExactCoverWithMultiplicitiesAndColors* pproblem, size_t idx);
+
+	// Problems that broke an engine once, which run checks before the random ones:
+	void regressions(std::vector<ExactCoverWithMultiplicitiesAndColors>* pproblems);
+
+public:
+	DifferentialFuzzer(const FuzzLimits& limits = FuzzLimits());
+
+	DifferentialFuzzer(const DifferentialFuzzer&) = delete;
+	DifferentialFuzzer& operator=(const DifferentialFuzzer&) = delete;
+
+	// Any engine can be added. The default engines are every engine in the registry (see
+	// Solver.h), with and without the non-sharp preference, the pointer version split into
+	// shards, and brute force for problems of up to 16 sequences:
+	void addEngine(const std::string& name, const FuzzSolver& solve);
+	void addDefaultEngines();
+
+	// The same seed always gives the same problem:
+	void generate(uint32_t seed, ExactCoverWithMultiplicitiesAndColors* pproblem);
+
+	// Solves the problem with every engine and returns true if their solutions match:
+	bool agree(const ExactCoverWithMultiplicitiesAndColors& problem);
+
+	// Makes the problem as small as possible while the engines still disagree on it:
+	void shrink(ExactCoverWithMultiplicitiesAndColors* pproblem);
+
+	// Prints the problem and each engine's solutions:
+	void report(const ExactCoverWithMultiplicitiesAndColors& problem, std::ostream& stream = std::cout);
+
+	// Checks the regression problems, then fuzzes problems from first_seed on, until
+	// max_problems have been tried or the seconds have passed. Stops at the first problem
+	// the engines disagree on, printing the shrunk problem, and returns false.
+	bool run(uint32_t first_seed, double seconds, long long max_problems, std::ostream& stream = std::cout);
+
+	long long ProblemsTried = 0;
+	long long SolutionsCompared = 0;
+};
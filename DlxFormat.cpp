@@ -0,0 +1,424 @@
+
+#include <cstring>
+#include <climits>
+#include <fstream>
+
+#include "DlxFormat.h"
+
+using namespace std;
+///////////////////////////////////////////////////////////////////////////////
+// FNV-1a, over the bytes of a name in the buffer:
+static uint32_t hash_name(const char* pc, size_t len)
+{
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < len; i++)
+	{
+		hash ^= (unsigned char)pc[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+///////////////////////////////////////////////////////////////////////////////
+static bool is_space(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r';
+}
+///////////////////////////////////////////////////////////////////////////////
+// The next token from *ppc, leaving *ppc after it. Returns false at the end of the line:
+static bool next_token(char** ppc, char* pend, char** pstart, char** pstop)
+{
+	char* pc = *ppc;
+	while (pc < pend && is_space(*pc))
+		pc++;
+	if (pc == pend)
+		return false;
+
+	*pstart = pc;
+	while (pc < pend && !is_space(*pc))
+		pc++;
+	*pstop = *ppc = pc;
+	return true;
+}
+///////////////////////////////////////////////////////////////////////////////
+// A multiplicity, which is all digits:
+static bool parse_count(const char* pc, const char* pend, int* pn)
+{
+	if (pc == pend || pend - pc > 9)
+		return false;
+
+	int n = 0;
+	for (; pc < pend; pc++)
+	{
+		if (*pc < '0' || *pc > '9')
+			return false;
+		n = n * 10 + *pc - '0';
+	}
+	*pn = n;
+	return true;
+}
+///////////////////////////////////////////////////////////////////////////////
+void DlxReader::NameTable::clear()
+{
+	Slots.clear();
+	Hashes.clear();
+	Offsets.clear();
+	Count = 0;
+}
+///////////////////////////////////////////////////////////////////////////////
+int DlxReader::find(const NameTable& table, const char* pc, size_t len, uint32_t hash) const
+{
+	if (table.Slots.empty())
+		return -1;
+
+	size_t mask = table.Slots.size() - 1;
+	for (size_t slot = hash & mask; table.Slots[slot]; slot = (slot + 1) & mask)
+	{
+		int idx = table.Slots[slot] - 1;
+		const char* pname = Names.data() + table.Offsets[idx];
+		if (table.Hashes[idx] == hash && memcmp(pname, pc, len) == 0 && pname[len] == 0)
+			return idx;
+	}
+	return -1;
+}
+///////////////////////////////////////////////////////////////////////////////
+int DlxReader::add(NameTable* ptable, const char* pc, size_t len, uint32_t hash)
+{
+	// Kept at most half full, and a power of 2:
+	if (2 * (ptable->Count + 1) > (int)ptable->Slots.size())
+	{
+		ptable->Slots.assign(max<size_t>(1024, 2 * ptable->Slots.size()), 0);
+		size_t mask = ptable->Slots.size() - 1;
+		for (int idx = 0; idx < (int)ptable->Offsets.size(); idx++)
+		{
+			// The colors without names aren't looked up:
+			if (ptable->Offsets[idx] == 0)
+				continue;
+
+			size_t slot = ptable->Hashes[idx] & mask;
+			while (ptable->Slots[slot])
+				slot = (slot + 1) & mask;
+			ptable->Slots[slot] = idx + 1;
+		}
+	}
+
+	int idx = (int)ptable->Offsets.size();
+	ptable->Offsets.push_back(Names.size());
+	ptable->Hashes.push_back(hash);
+	Names.insert(Names.end(), pc, pc + len);
+	Names.push_back(0);
+
+	size_t mask = ptable->Slots.size() - 1;
+	size_t slot = hash & mask;
+	while (ptable->Slots[slot])
+		slot = (slot + 1) & mask;
+	ptable->Slots[slot] = idx + 1;
+	ptable->Count++;
+	return idx;
+}
+///////////////////////////////////////////////////////////////////////////////
+bool DlxReader::fail(const std::string& why)
+{
+	Error = FileName + ", line " + to_string(Line) + ": " + why;
+	Problem.clear();
+	return false;
+}
+///////////////////////////////////////////////////////////////////////////////
+bool DlxReader::parseItems(char* pc, char* pend)
+{
+	bool secondary = false;
+	char *pstart, *pstop;
+	while (next_token(&pc, pend, &pstart, &pstop))
+	{
+		if (pstop - pstart == 1 && *pstart == '|')
+		{
+			if (secondary)
+				return fail("There is more than one bar between the items.");
+			secondary = true;
+			continue;
+		}
+
+		// "u:v|name" or "v|name":
+		int u = 1, v = 1;
+		char* pbar = (char*)memchr(pstart, '|', pstop - pstart);
+		if (pbar)
+		{
+			if (secondary)
+				return fail("Secondary item " + string(pstart, pstop) + " has multiplicities.");
+
+			char* pcolon = (char*)memchr(pstart, ':', pbar - pstart);
+			bool b = pcolon ? parse_count(pstart, pcolon, &u) && parse_count(pcolon + 1, pbar, &v) :
+							parse_count(pstart, pbar, &v);
+			if (!pcolon)
+				u = v;
+			if (!b || u > v || v == 0)
+				return fail("Item " + string(pstart, pstop) + " has impossible multiplicities.");
+			pstart = pbar + 1;
+		}
+
+		size_t len = pstop - pstart;
+		if (len == 0 || memchr(pstart, ':', len) || memchr(pstart, '|', len))
+			return fail("Item name " + string(pstart, pstop) + " is empty or has a colon or bar in it.");
+
+		uint32_t hash = hash_name(pstart, len);
+		if (find(Items, pstart, len, hash) >= 0)
+			return fail("Item " + string(pstart, pstop) + " is listed twice.");
+		add(&Items, pstart, len, hash);
+
+		if (!secondary)
+		{
+			Problem.PrimaryItems++;
+			Problem.Min.push_back(u);
+			Problem.Max.push_back(v);
+		}
+	}
+
+	if (Problem.PrimaryItems == 0)
+		return fail("There are no primary items.");
+
+	ReadItems = true;
+	LastOption.assign(Items.Offsets.size(), -1);
+	return true;
+}
+///////////////////////////////////////////////////////////////////////////////
+bool DlxReader::parseOption(char* pc, char* pend)
+{
+	int option = Problem.sequences();
+	char *pstart, *pstop;
+	while (next_token(&pc, pend, &pstart, &pstop))
+	{
+		char* pcolon = (char*)memchr(pstart, ':', pstop - pstart);
+		char* pname_end = pcolon ? pcolon : pstop;
+
+		int item = find(Items, pstart, pname_end - pstart, hash_name(pstart, pname_end - pstart));
+		if (item < 0)
+			return fail("Item " + string(pstart, pname_end) + " isn't in the list of items.");
+		if (LastOption[item] == option)
+			return fail("Item " + string(pstart, pname_end) + " is in the option twice.");
+		LastOption[item] = option;
+
+		int color = 0;
+		if (item < Problem.PrimaryItems)
+		{
+			if (pcolon)
+				return fail("Primary item " + string(pstart, pname_end) + " has a color.");
+		}
+		else if (pcolon)
+		{
+			size_t len = pstop - pcolon - 1;
+			if (len == 0)
+				return fail("Item " + string(pstart, pname_end) + " has an empty color.");
+
+			uint32_t hash = hash_name(pcolon + 1, len);
+			int idx = find(Colors, pcolon + 1, len, hash);
+			if (idx < 0)
+				idx = add(&Colors, pcolon + 1, len, hash);
+			color = idx + 1;
+		}
+		else
+		{
+			// A color of its own, with the empty name:
+			Colors.Offsets.push_back(0);
+			Colors.Hashes.push_back(0);
+			color = (int)Colors.Offsets.size();
+		}
+
+		Problem.addCell(item, color);
+	}
+
+	Problem.endSequence();
+	return true;
+}
+///////////////////////////////////////////////////////////////////////////////
+bool DlxReader::parseLine(char* pc, char* pend)
+{
+	if (pc < pend && *pc == '|')
+		return true;	// A comment.
+
+	char* pfirst = pc;
+	while (pfirst < pend && is_space(*pfirst))
+		pfirst++;
+	if (pfirst == pend)
+		return true;
+
+	return ReadItems ? parseOption(pc, pend) : parseItems(pc, pend);
+}
+///////////////////////////////////////////////////////////////////////////////
+bool DlxReader::read(std::istream& stream, const char* pname)
+{
+	Problem.clear();
+	Items.clear();
+	Colors.clear();
+	Names.assign(1, 0);
+	ReadItems = false;
+	Line = 0;
+	FileName = pname;
+	Error.clear();
+
+	if (Buffer.empty())
+		Buffer.resize(1 << 20);
+
+	// Whole lines are parsed where they are in the buffer, and the start of the next one
+	// is moved to the front before reading more:
+	size_t kept = 0;
+	for (;;)
+	{
+		// A line longer than the buffer:
+		if (kept == Buffer.size())
+			Buffer.resize(2 * Buffer.size());
+
+		stream.read(Buffer.data() + kept, Buffer.size() - kept);
+		bool last = !stream;
+
+		char* pc = Buffer.data();
+		char* pend = pc + kept + (size_t)stream.gcount();
+		for (;;)
+		{
+			char* peol = (char*)memchr(pc, '\n', pend - pc);
+			if (!peol)
+			{
+				if (!last || pc == pend)
+					break;
+				peol = pend;
+			}
+
+			Line++;
+			if (!parseLine(pc, peol))
+				return false;
+			pc = peol < pend ? peol + 1 : pend;
+		}
+
+		kept = pend - pc;
+		memmove(Buffer.data(), pc, kept);
+		if (last)
+			break;
+	}
+
+	if (stream.bad())
+		return fail("The file couldn't be read.");
+	if (!ReadItems)
+		return fail("There are no items.");
+
+	// The names only stop moving once they are all read:
+	Problem.ItemNames.resize(Items.Offsets.size());
+	for (size_t i = 0; i < Items.Offsets.size(); i++)
+		Problem.ItemNames[i] = Names.data() + Items.Offsets[i];
+	Problem.ColorNames.resize(Colors.Offsets.size());
+	for (size_t i = 0; i < Colors.Offsets.size(); i++)
+		Problem.ColorNames[i] = Names.data() + Colors.Offsets[i];
+
+	Problem.assertValid();
+	return true;
+}
+///////////////////////////////////////////////////////////////////////////////
+bool DlxReader::read(const char* pfile_name)
+{
+	ifstream file(pfile_name, ios::binary);
+	if (!file)
+	{
+		Problem.clear();
+		Error = string(pfile_name) + " can't be opened.";
+		return false;
+	}
+	return read(file, pfile_name);
+}
+///////////////////////////////////////////////////////////////////////////////
+// Names can't be empty or have spaces, colons or bars in them. Colors only can't have
+// spaces:
+static bool can_write_name(const char* pc, bool color)
+{
+	if (*pc == 0)
+		return false;
+	for (; *pc; pc++)
+	{
+		if (*pc == ' ' || *pc == '\t' || *pc == '\r' || *pc == '\n' || (!color && (*pc == ':' || *pc == '|')))
+			return false;
+	}
+	return true;
+}
+///////////////////////////////////////////////////////////////////////////////
+bool format_dlx(const CompactExactCover& problem, std::ostream& stream)
+{
+	problem.assertValid();
+
+	for (const char* pc : problem.ItemNames)
+	{
+		if (!can_write_name(pc, false))
+		{
+			cout << "Item \"" << pc << "\" can't be written in Knuth's format." << endl;
+			return false;
+		}
+	}
+	for (const char* pc : problem.ColorNames)
+	{
+		if (*pc && !can_write_name(pc, true))
+		{
+			cout << "Color \"" << pc << "\" can't be written in Knuth's format." << endl;
+			return false;
+		}
+	}
+
+	// Written a block at a time:
+	string text;
+	char buf[32];
+	for (int i = 0; i < problem.items(); i++)
+	{
+		if (i > 0)
+			text += ' ';
+		if (i == problem.PrimaryItems)
+			text += "| ";
+
+		if (i < problem.PrimaryItems && (problem.Min[i] != 1 || problem.Max[i] != 1))
+		{
+			if (problem.Min[i] == problem.Max[i])
+				sprintf_s(buf, "%i|", problem.Max[i]);
+			else
+				sprintf_s(buf, "%i:%i|", problem.Min[i], problem.Max[i]);
+			text += buf;
+		}
+		text += problem.ItemNames[i];
+	}
+	text += '\n';
+
+	for (int i = 0; i < problem.sequences(); i++)
+	{
+		for (int c = problem.SequenceStarts[i]; c < problem.SequenceStarts[i + 1]; c++)
+		{
+			const CompactExactCover::Cell& cell = problem.Cells[c];
+			if (c > problem.SequenceStarts[i])
+				text += ' ';
+			text += problem.ItemNames[cell.Item];
+
+			// A color without a name is the item's alone:
+			if (cell.Color && *problem.ColorNames[cell.Color - 1])
+			{
+				text += ':';
+				text += problem.ColorNames[cell.Color - 1];
+			}
+		}
+		text += '\n';
+
+		if (text.size() >= (1 << 20))
+		{
+			stream.write(text.data(), text.size());
+			text.clear();
+		}
+	}
+	stream.write(text.data(), text.size());
+	return (bool)stream;
+}
+///////////////////////////////////////////////////////////////////////////////
+bool write_dlx_file(const char* pfile_name, const CompactExactCover& problem)
+{
+	ofstream file(pfile_name, ios::binary);
+	if (!file)
+	{
+		cout << "Couldn't create " << pfile_name << "." << endl;
+		return false;
+	}
+	if (!format_dlx(problem, file))
+	{
+		cout << "Couldn't write " << pfile_name << "." << endl;
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+// Knuth's text format for exact cover problems, as read by his DLX programs:
+//
+//	| A comment is a line that starts with a bar.
+//	a b 2:3|c | x y
+//	a x:red
+//	b c y:blue
+//
+// The first line lists the items, primary then secondary, with a bar between them. A
+// primary item can have multiplicities, "u:v|name", or "v|name" for exactly v. Each line
+// after that is an option, which lists its items, with a color after the secondary ones
+// that have one.
+//
+// The engines need every use of a secondary item to have a color. A use without one
+// can't share the item with any other option, so the reader gives it a color of its own,
+// with an empty name, and the writer leaves such colors out again. Costs aren't part of
+// the format, so they aren't written.
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <iostream>
+
+#include "Common.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// Reads a file straight into a CompactExactCover, a buffer at a time, looking up each
+// name in a hash table over the bytes in the buffer. The names are kept here, so the
+// problem lasts as long as the reader, or until the next read.
+class DlxReader
+{
+	// Open addressing over names kept in Names:
+	struct NameTable
+	{
+		std::vector<int> Slots;				// 1 + the index of a name, or 0 if empty.
+		std::vector<uint32_t> Hashes;		// Of each name,
+		std::vector<size_t> Offsets;		// and where it is in Names.
+		int Count = 0;
+
+		void clear();
+	};
+
+	std::vector<char> Buffer;
+	std::vector<char> Names;	// 0 terminated. The first is the empty name.
+	NameTable Items;
+	NameTable Colors;			// The colors without names aren't in the table.
+	std::vector<int> LastOption;	// Of each item, to catch an item listed twice.
+
+	CompactExactCover Problem;
+	bool ReadItems;
+	int Line;
+	std::string FileName;
+	std::string Error;
+
+	int find(const NameTable& table, const char* pc, size_t len, uint32_t hash) const;
+	int add(NameTable* ptable, const char* pc, size_t len, uint32_t hash);
+
+	bool fail(const std::string& why);
+	bool parseItems(char* pc, char* pend);
+	bool parseOption(char* pc, char* pend);
+	bool parseLine(char* pc, char* pend);
+
+public:
+	DlxReader() {}
+	DlxReader(const DlxReader&) = delete;
+	DlxReader& operator=(const DlxReader&) = delete;
+
+	// Returns false with the file, line and reason in error():
+	bool read(const char* pfile_name);
+	bool read(std::istream& stream, const char* pname = "input");
+
+	const CompactExactCover& problem() const { return Problem; }
+	const std::string& error() const { return Error; }
+};
+///////////////////////////////////////////////////////////////////////////////
+// Returns false, printing why, if a name can't be written in the format, e.g. because
+// it has a space in it:
+bool format_dlx(const CompactExactCover& problem, std::ostream& stream);
+bool write_dlx_file(const char* pfile_name, const CompactExactCover& problem);
@@ -0,0 +1,169 @@
+
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+
+#include "Locality.h"
+
+using namespace std;
+///////////////////////////////////////////////////////////////////////////////
+const ExactCoverWithMultiplicitiesAndColors& LocalityOrder::reorder(const ExactCoverWithMultiplicitiesAndColors& problem)
+{
+	problem.assertValid();
+	auto start_time = std::chrono::high_resolution_clock::now();
+
+	int nprimary = (int)problem.primary_options.size();
+	int nitems = nprimary + (int)problem.secondary_options.size();
+	int nsequences = (int)problem.sequences.size();
+
+	// Primary items are numbered first, like the engines do:
+	ItemIndex.clear();
+	for (int i = 0; i < nprimary; i++)
+		ItemIndex[problem.primary_options[i].pValue] = i;
+	for (int i = 0; i < (int)problem.secondary_options.size(); i++)
+		ItemIndex[problem.secondary_options[i]] = nprimary + i;
+
+	// The item of every cell, counting the sequences of each item as we go:
+	CellItems.clear();
+	SequenceStart.clear();
+	ItemStart.assign(nitems + 1, 0);
+	string name;
+	for (auto& seq : problem.sequences)
+	{
+		SequenceStart.push_back((int)CellItems.size());
+		for (const char* pc : seq)
+		{
+			const char* sep = strchr(pc, ':');
+			name.assign(pc, sep ? sep - pc : strlen(pc));
+
+			auto it = ItemIndex.find(name);
+			assert(it != ItemIndex.end());
+			CellItems.push_back(it->second);
+			ItemStart[it->second + 1]++;
+		}
+	}
+	SequenceStart.push_back((int)CellItems.size());
+
+	// Then the sequences of each item, in their original order. The queue holds where the
+	// next one goes until the search needs it:
+	for (int i = 0; i < nitems; i++)
+		ItemStart[i + 1] += ItemStart[i];
+
+	ItemSequences.resize(CellItems.size());
+	Queue.assign(ItemStart.begin(), ItemStart.end() - 1);
+	for (int i = 0; i < nsequences; i++)
+	{
+		for (int c = SequenceStart[i]; c < SequenceStart[i + 1]; c++)
+			ItemSequences[Queue[CellItems[c]]++] = i;
+	}
+
+	// Each component is searched from its primary item in the fewest sequences, which
+	// tends to be at an edge of the problem, so the search sweeps across it:
+	StartOrder.resize(nitems);
+	for (int i = 0; i < nitems; i++)
+		StartOrder[i] = i;
+	stable_sort(StartOrder.begin(), StartOrder.end(), [this, nprimary](int i1, int i2)
+	{
+		if ((i1 < nprimary) != (i2 < nprimary))
+			return i1 < nprimary;
+		return ItemStart[i1 + 1] - ItemStart[i1] < ItemStart[i2 + 1] - ItemStart[i2];
+	});
+
+	// The numbers are only used as visited marks until the search is done:
+	ItemNumber.assign(nitems, -1);
+	ReorderedSequence.assign(nsequences, -1);
+	OriginalSequence.clear();
+	Queue.clear();
+
+	size_t head = 0;
+	for (int start : StartOrder)
+	{
+		if (ItemNumber[start] >= 0)
+			continue;
+
+		ItemNumber[start] = 0;
+		Queue.push_back(start);
+
+		while (head < Queue.size())
+		{
+			int item = Queue[head++];
+			for (int k = ItemStart[item]; k < ItemStart[item + 1]; k++)
+			{
+				int seq = ItemSequences[k];
+				if (ReorderedSequence[seq] >= 0)
+					continue;
+
+				ReorderedSequence[seq] = (int)OriginalSequence.size();
+				OriginalSequence.push_back(seq);
+
+				for (int c = SequenceStart[seq]; c < SequenceStart[seq + 1]; c++)
+				{
+					if (ItemNumber[CellItems[c]] < 0)
+					{
+						ItemNumber[CellItems[c]] = 0;
+						Queue.push_back(CellItems[c]);
+					}
+				}
+			}
+		}
+	}
+	assert((int)Queue.size() == nitems);
+	assert((int)OriginalSequence.size() == nsequences);
+
+	// The primary items keep their order, which breaks ties when the search chooses an
+	// item. The secondary items are numbered in the order visited:
+	Reordered.primary_options = problem.primary_options;
+	for (int i = 0; i < nprimary; i++)
+		ItemNumber[i] = i;
+
+	Reordered.secondary_options.clear();
+	for (int item : Queue)
+	{
+		if (item >= nprimary)
+		{
+			ItemNumber[item] = nprimary + (int)Reordered.secondary_options.size();
+			Reordered.secondary_options.push_back(problem.secondary_options[item - nprimary]);
+		}
+	}
+	Reordered.colors = problem.colors;
+
+	// Resizing keeps the buffers of the sequences from the last problem:
+	Reordered.sequences.resize(nsequences);
+	Reordered.costs.resize(problem.costs.size());
+	for (int i = 0; i < nsequences; i++)
+	{
+		int seq = OriginalSequence[i];
+
+		SortedCells.clear();
+		for (int c = SequenceStart[seq]; c < SequenceStart[seq + 1]; c++)
+			SortedCells.emplace_back(ItemNumber[CellItems[c]], problem.sequences[seq][c - SequenceStart[seq]]);
+		sort(SortedCells.begin(), SortedCells.end());
+
+		vector<const char*>& cells = Reordered.sequences[i];
+		cells.clear();
+		for (auto& cell : SortedCells)
+			cells.push_back(cell.second);
+
+		if (!problem.costs.empty())
+			Reordered.costs[i] = problem.costs[seq];
+	}
+
+	auto end_time = std::chrono::high_resolution_clock::now();
+	RenumberTime = (long)std::chrono::duration_cast<std::chrono::microseconds>(end_time - start_time).count();
+	return Reordered;
+}
+///////////////////////////////////////////////////////////////////////////////
+void LocalityOrder::toReordered(std::vector<int>* psequences) const
+{
+	for (int& seq : *psequences)
+		seq = ReorderedSequence[seq];
+}
+///////////////////////////////////////////////////////////////////////////////
+void LocalityOrder::toOriginal(std::vector<std::vector<int>>* presults) const
+{
+	for (auto& solution : *presults)
+	{
+		for (int& seq : solution)
+			seq = OriginalSequence[seq];
+	}
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+// Reorders the sequences of a problem, and renumbers its secondary items, so that sequences
+// sharing items are next to each other. Both engines lay out the cells in sequence order and
+// the item headers in declaration order, so in the original order the cells of one item's
+// list, and the items one hide visits, can be spread over the whole problem. For partridge,
+// the position items are row-major but the sequences are grouped by square size.
+//
+// The order comes from a breadth first search of the items and sequences, like
+// Cuthill-McKee: starting from the primary item in the fewest sequences, each item visited
+// places its sequences that aren't placed yet, and each of those visits its new items.
+// Cells within a sequence are sorted by item number. It takes one pass over the cells.
+//
+// The primary items keep their order. Renumbering them too changes which item the search
+// chooses when several tie, and the bigger or smaller search tree that follows swamps any
+// difference in memory traffic. With them kept, the search makes the same choices in the
+// same order, only taking the sequences of an item in a different order.
+//
+// The renumbered problem has the same solutions, with different sequence indices, so
+// they are mapped back before anyone sees them.
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include "Common.h"
+
+///////////////////////////////////////////////////////////////////////////////
+class LocalityOrder
+{
+	// The renumbered copy. It points at the original problem's strings:
+	ExactCoverWithMultiplicitiesAndColors Reordered;
+
+	std::vector<int> OriginalSequence;		// Of each reordered sequence.
+	std::vector<int> ReorderedSequence;		// Of each original sequence.
+
+	// Kept so their buffers are reused:
+	std::unordered_map<std::string, int> ItemIndex;
+	std::vector<int> CellItems;				// The item of each cell, by original sequence,
+	std::vector<int> SequenceStart;			// starting here, with one more at the end.
+	std::vector<int> ItemSequences;			// The sequences of each item,
+	std::vector<int> ItemStart;				// starting here.
+	std::vector<int> StartOrder;			// Where each search of a component can start.
+	std::vector<int> ItemNumber;			// The new number of each item.
+	std::vector<int> Queue;					// The items, in the order they were visited.
+	std::vector<std::pair<int, const char*>> SortedCells;
+
+	long RenumberTime = 0;
+
+public:
+	// Returns the renumbered copy, which is valid until the next call or until the original
+	// problem changes:
+	const ExactCoverWithMultiplicitiesAndColors& reorder(const ExactCoverWithMultiplicitiesAndColors& problem);
+
+	// Sequence indices from the original problem to the renumbered one, e.g. forced sequences:
+	void toReordered(std::vector<int>* psequences) const;
+
+	// Solutions of the renumbered problem back to the original:
+	void toOriginal(std::vector<std::vector<int>>* presults) const;
+
+	// Of the last reorder, in microseconds:
+	long renumberTime() const { return RenumberTime; }
+};
@@ -8,8 +8,15 @@
 #include <cassert>
 #include <map>
 #include <chrono>
+#include <atomic>
+#include <sstream>
 
 #include "Common.h"
+#include "MStringValues.h"
+#include "SearchProfile.h"
+#include "PerfCounters.h"
+#include "Benchmark.h"
+#include "PageArena.h"
 using namespace std;
 ///////////////////////////////////////////////////////////////////////////////
 // Cell structure to match 7.2.2.1 Table 1:
@@ -41,20 +48,24 @@ struct Cell
 };
 
 ///////////////////////////////////////////////////////////////////////////////
-static const ExactCoverWithMultiplicitiesAndColors* pproblem;
+static const CompactExactCover* pproblem;
+static CompactExactCover converted;	// The last problem given with names, numbered.
 
 static  int nsequences;
 static  int nsequence_items;		// Total number of characters in all strings
 static  int nprimary_items;
 static  int nsecondary_items;
 
-static map<const char*, int, CmpSame>* pitem_indices = nullptr;
-static map<const char*, int, CmpSame>*pcolor_indices = nullptr;
+// The buffers below are kept between calls and only grow, so a program solving many
+// small problems isn't dominated by allocation. See free_exact_cover_with_multiplicities_and_colors_buffers.
+// They are laid out in one arena, which can be on huge pages. See PageArena.h.
+static PageArena arena;
+static int* cell_sequence;		// Sequence index for the first cell of each sequence, else -1.
+static int* sequence_starts;	// First cell of each sequence, the reverse of cell_sequence.
 
-static map<int, int> *psequence_map = nullptr;
-
-int max_item_len;
-char* pitem_buf;
+// Sequences forced into every solution:
+static const vector<int>* pforced_sequences;
+static int nforced;
 
 static int nheaders;
 static Header* headers;	
@@ -62,6 +73,11 @@ static int ncells;		// Total number of cells:
 static Cell* cells;
 
 static int max_depth;
+
+// What the problem uses, so the search can be compiled without the rest. See search:
+static bool has_multiplicities;	// Some primary item isn't used exactly once.
+static bool has_colors;			// Some sequence gives a secondary item a color.
+
 // This stores the index of our choice at each level.
 static int* x;
 // Array of first tweaks.
@@ -76,44 +92,34 @@ static long long loop_count;
 static long long level_count;
 static bool non_sharp_preference;
 
-static void get_counts()
-{
+// Set once the search is over, while we back out to level 0:
+static bool stopping;
+static bool cancelled;
 
-	pitem_indices = new map<const char*, int, CmpSame>();
-	pcolor_indices = new map<const char*, int, CmpSame>();
-	max_item_len = 0;
-	
-	nprimary_items = (int) pproblem->primary_options.size();
-	nsecondary_items = (int) pproblem->secondary_options.size();
+// Null unless the search is being profiled. level_counts holds the counts for the
+// current level. The functions that unlink and relink cells are compiled twice, with
+// and without counting:
+static SearchProfile* pprofile;
+static LevelCounts* level_counts;
 
-	max_depth = 0;
+// Null unless hardware counters are measuring the setup and search:
+static PerfCounters* pperf;
 
-	int item_id = 1; // Id's in Knuth's scheme start at 1.
-	for (auto primary : pproblem->primary_options)
-	{
-		max_item_len = max(max_item_len, (int) strlen(primary.pValue));
-		(*pitem_indices)[primary.pValue] = item_id++;
-		max_depth += primary.v;
-	}
+static void get_counts()
+{
+	nprimary_items = pproblem->PrimaryItems;
+	nsecondary_items = pproblem->secondaryItems();
 
-	int idx_color = 1;
-	for (auto color : pproblem->colors)
-	{
-		(*pcolor_indices)[color] = idx_color++;
-	}
+	nsequences = pproblem->sequences();
 
-	for (auto secondary : pproblem->secondary_options)
-	{
-		max_item_len = max(max_item_len, (int)strlen(secondary));
-		(*pitem_indices)[secondary] = item_id++;
-	}
+	// Each level takes one off an item's bound, and either uses a sequence or finishes the
+	// item without one, so a large multiplicity doesn't make the search any deeper:
+	long long max_bound = 0;
+	for (int i = 0; i < nprimary_items; i++)
+		max_bound += pproblem->Max[i];
+	max_depth = (int)min(max_bound, (long long)nsequences + nprimary_items);
 
-	nsequences = (int)pproblem->sequences.size();
-	nsequence_items = 0;
-	for (int i = 0; i < pproblem->sequences.size(); i++)
-	{
-		nsequence_items += (int) pproblem->sequences[i].size();
-	}
+	nsequence_items = pproblem->cells();
 
 	// Calculate the total number of cells needed. Not that this is different
 	// from Algorithm X
@@ -128,11 +134,99 @@ static void get_counts()
 // print more nicely:
 static const int unused = -99;
 
+// Links in the cells of each sequence as the problem emits them, each sequence followed
+// by a spacer:
+class CellLinker : public CellSink
+{
+	int index;				// The next cell to fill in.
+	int idx_seq = 0;
+	int idx_spacer = -1;
+	int prev_first;			// First node after the previous spacer.
+	bool first_in_sequence = true;
+
+public:
+	CellLinker(int first) : index(first), prev_first(first) {}
+
+	int sequences() const { return idx_seq; }
+	int filled() const { return index; }		// Cells, headers included.
+
+	void addCell(int item, int idx_color) override
+	{
+		// Id's in Knuth's scheme start at 1:
+		int idx_item = item + 1;
+		if (idx_color)
+			has_colors = true;
+
+		cells[index].x = index;
+		cells[index].top = idx_item;
+
+		assert(cells[idx_item].x == idx_item);
+		if (cells[idx_item].dlink < 0)	// list is empty
+		{
+			assert(cells[idx_item].len == 0);
+			cells[idx_item].dlink = index;
+			cells[idx_item].ulink = index;
+
+			cells[index].ulink = idx_item;
+			cells[index].dlink = idx_item;
+		}
+		else
+		{
+			cells[index].ulink = cells[idx_item].ulink;
+			cells[index].dlink = idx_item;
+
+			cells[cells[idx_item].ulink].dlink = index;
+			cells[idx_item].ulink = index;
+		}
+
+		cells[index].color = idx_color;
+
+		cells[idx_item].len++;
+
+		if (first_in_sequence)
+		{
+			cell_sequence[index] = idx_seq;
+			sequence_starts[idx_seq] = index;
+			first_in_sequence = false;
+		}
+
+		index++;
+	}
+
+	void endSequence() override
+	{
+		// Add the spacer at the end:
+		cells[index].x = index;
+		cells[index].top = idx_spacer--;
+		cells[index].ulink = prev_first;
+		cells[index].dlink = unused;
+		cells[index].color = 0;
+
+		cells[prev_first - 1].dlink = index - 1;
+
+		prev_first = index + 1;
+
+		index++;
+		idx_seq++;
+		first_in_sequence = true;
+	}
+};
+
 static void init_cells()
 {
-	headers = new Header[nheaders];
-	pitem_buf = new char[max_item_len + 1];
-	psequence_map = new map<int, int>();
+	// The levels too, so everything the search touches is in the arena:
+	int nlevels = max(max_depth, 1);
+	arena.begin(PageArena::bytesFor<Header>(nheaders) + PageArena::bytesFor<Cell>(ncells) +
+				PageArena::bytesFor<int>(ncells) + PageArena::bytesFor<int>(nsequences) + 2 * PageArena::bytesFor<int>(nlevels));
+	headers = arena.allocate<Header>(nheaders);
+	cells = arena.allocate<Cell>(ncells);
+	cell_sequence = arena.allocate<int>(ncells);
+	sequence_starts = arena.allocate<int>(nsequences);
+	x = arena.allocate<int>(nlevels);
+	ft = arena.allocate<int>(nlevels);
+
+	for (int i = 0; i < ncells; i++)
+		cell_sequence[i] = -1;
 
 	headers[0].i = 0;
 	headers[0].pName = "";
@@ -143,6 +237,8 @@ static void init_cells()
 
 	int index;
 
+	has_multiplicities = has_colors = false;
+
 	// Headers for primary options
 	for (int i = 0; i < nprimary_items; i++)
 	{
@@ -150,10 +246,12 @@ static void init_cells()
 		headers[index].i = index;
 		headers[index].llink = index - 1;
 		headers[index].rlink = (index + 1) % (nprimary_items + 1);
-		headers[index].pName = pproblem->primary_options[i].pValue;
-		headers[index].slack = pproblem->primary_options[i].v - pproblem->primary_options[i].u;
+		headers[index].pName = pproblem->ItemNames[i];
+		headers[index].slack = pproblem->Max[i] - pproblem->Min[i];
 		assert(headers[index].slack >= 0);
-		headers[index].bound = pproblem->primary_options[i].v;
+		headers[index].bound = pproblem->Max[i];
+		if (pproblem->Min[i] != 1 || pproblem->Max[i] != 1)
+			has_multiplicities = true;
 	}
 
 	// Headers for secondary options:
@@ -163,7 +261,7 @@ static void init_cells()
 		headers[index].i = index;
 		headers[index].llink = (i == 0) ? (nprimary_items + nsecondary_items + 1) : index - 1;
 		headers[index].rlink = index + 1;
-		headers[index].pName = pproblem->secondary_options[i];
+		headers[index].pName = pproblem->ItemNames[nprimary_items + i];
 		headers[index].slack = unused;
 		headers[index].bound = unused;
 	}
@@ -178,8 +276,6 @@ static void init_cells()
 	headers[index].bound = unused;
 
 	//First line of the cell data:
-	cells = new Cell[ncells];
-
 	// Special 0 element:
 	cells[0].x = 0;
 	cells[0].len = cells[0].ulink = cells[0].dlink = cells[0].color = unused;
@@ -214,98 +310,34 @@ static void init_cells()
 	cells[index].color = 0;
 	index++;
 
-	int idx_spacer = -1;
-	int prev_first = index;		// First node after the previous spacer.
+	// A streamed problem's cells only ever exist here:
+	CellLinker linker(index);
+	pproblem->emitCells(linker);
+	assert(linker.sequences() == nsequences && linker.filled() == ncells);
 
-	for (int idx_seq = 0; idx_seq < nsequences; idx_seq++)
+	// An item no sequence has is an empty list, which points to itself, as the search
+	// may still choose one with a minimum of 0 and cover it:
+	for (int idx_item = 1; idx_item <= nprimary_items + nsecondary_items; idx_item++)
 	{
-		const vector<const char*> &ptr_vec = pproblem->sequences[idx_seq];
-
-		bool first_in_sequence = true;
-		for (auto pc : ptr_vec)
-		{
-			// Look at the sequence item for the separator, which would indicate this item
-			// has an assigned color:
-			const char* sep = strchr(pc, ':');
-			int idx_item, idx_color;
-			if (sep)
-			{
-				int nc = (int) (sep - pc);
-				memcpy(pitem_buf, pc, nc);
-				pitem_buf[nc] = 0;
-				idx_item = (*pitem_indices)[pitem_buf];
-				idx_color = (*pcolor_indices)[sep + 1];
-			}
-			else
-			{
-				assert(pitem_indices->find(pc) != pitem_indices->end());
-				idx_item = (*pitem_indices)[pc];
-				idx_color = 0;
-			}
-
-			cells[index].x = index;
-			cells[index].top = idx_item;
-
-			assert(cells[idx_item].x == idx_item);
-			if (cells[idx_item].dlink < 0)	// list is empty
-			{
-				assert(cells[idx_item].len == 0);
-				cells[idx_item].dlink = index;
-				cells[idx_item].ulink = index;
-
-				cells[index].ulink = idx_item;
-				cells[index].dlink = idx_item;
-			}
-			else
-			{
-				cells[index].ulink = cells[idx_item].ulink;
-				cells[index].dlink = idx_item;
-
-				cells[cells[idx_item].ulink].dlink = index;
-				cells[idx_item].ulink = index;
-			}
-
-			cells[index].color = idx_color;
-
-			cells[idx_item].len++;
-
-			if (first_in_sequence)
-			{
-				(* psequence_map)[index] = idx_seq;
-				first_in_sequence = false;
-			}
-
-			index++;
-			pc++;
-		}
-
-		// Add the spacer at the end:
-		cells[index].x = index;
-		cells[index].top = idx_spacer--;
-		cells[index].ulink = prev_first;
-		cells[index].dlink = unused;
-		cells[index].color = 0;
-
-		cells[prev_first - 1].dlink = index - 1;
-
-		prev_first = index + 1;
-
-		index++;
+		if (cells[idx_item].dlink < 0)
+			cells[idx_item].ulink = cells[idx_item].dlink = idx_item;
 	}
 }
 ///////////////////////////////////////////////////////////////////////////////
-// Free any allocated memory:
+// Free the buffers kept between searches:
 static void destroy_cells()
 {
-	delete[] headers;
-	delete[] cells;
-	delete[] pitem_buf;
-	delete pitem_indices;
-	delete pcolor_indices;
-	delete psequence_map;
+	arena.release();
+	headers = nullptr;
+	cells = nullptr;
+	cell_sequence = sequence_starts = x = ft = nullptr;
+
+	converted = CompactExactCover();
 }
 ///////////////////////////////////////////////////////////////////////////////
-// hide/cover/uncover/unhide functions:
+// hide/cover/uncover/unhide functions. Only purify marks cells with color -1, so
+// without Colors there is nothing to check:
+template<bool Profiling, bool Colors = true>
 static void hide(int p)
 {
 	int q = p + 1;
@@ -321,11 +353,13 @@ static void hide(int p)
 		}
 		else
 		{
-			if (cells[q].color >= 0)
+			if (!Colors || cells[q].color >= 0)
 			{
 				cells[u].dlink = d;
 				cells[d].ulink = u;
 				cells[x].len--;
+				if (Profiling)
+					level_counts->CellsUnlinked++;
 			}
 
 			q++;
@@ -334,13 +368,14 @@ static void hide(int p)
 }
 
 
+template<bool Profiling, bool Colors = true>
 static void cover(int i)
 {
 	int p = cells[i].dlink;
 
 	while (p != i)
 	{
-		hide(p);
+		hide<Profiling, Colors>(p);
 		p = cells[p].dlink;
 	}
 
@@ -351,6 +386,7 @@ static void cover(int i)
 	headers[r].llink = l;
 }
 
+template<bool Profiling, bool Colors = true>
 static void unhide(int p)
 {
 	int q = p - 1;
@@ -367,17 +403,20 @@ static void unhide(int p)
 		}
 		else
 		{
-			if (cells[q].color >= 0)
+			if (!Colors || cells[q].color >= 0)
 			{
 				cells[u].dlink = q;
 				cells[d].ulink = q;
 				cells[x].len++;
+				if (Profiling)
+					level_counts->CellsRelinked++;
 			}
 			q--;
 		}
 	}
 }
 
+template<bool Profiling, bool Colors = true>
 static void uncover_p(int i)
 {
 	int l = headers[i].llink;
@@ -389,11 +428,12 @@ static void uncover_p(int i)
 	int p = cells[i].ulink;
 	while (p != i)
 	{
-		unhide(p);
+		unhide<Profiling, Colors>(p);
 		p = cells[p].ulink;
 	}
 }
 
+template<bool Profiling>
 void purify(int p)
 {
 	int c = cells[p].color;
@@ -410,26 +450,28 @@ void purify(int p)
 		}
 		else
 		{
-			hide(q);
+			hide<Profiling>(q);
 		}
 
 		q = cells[q].dlink;
 	}
 }
 
+template<bool Profiling>
 void commit(int p, int j)
 {
 	int c = cells[p].color;
 	if (c == 0)
 	{
-		cover(j);
+		cover<Profiling>(j);
 	}
 	else if (c > 0)
 	{
-		purify(p);
+		purify<Profiling>(p);
 	}
 }
 
+template<bool Profiling>
 void unpurify(int p)
 {
 	int c = cells[p].color;
@@ -444,36 +486,41 @@ void unpurify(int p)
 		}
 		else
 		{
-			unhide(q);
+			unhide<Profiling>(q);
 		}
 
 		q = cells[q].ulink;
 	}
 }
 
+template<bool Profiling>
 void uncommit(int p, int j)
 {
 	int c = cells[p].color;
 	if (c == 0)
 	{
-		uncover_p(j);
+		uncover_p<Profiling>(j);
 	}
 	else if (c > 0)
 	{
-		unpurify(p);
+		unpurify<Profiling>(p);
 	}
 }
 
+template<bool Profiling, bool Colors = true>
 void tweak(int x, int p)
 {
-	hide(x);					// Hide sequence x, and unlink the sequences before x from 
+	hide<Profiling, Colors>(x);			// Hide sequence x, and unlink the sequences before x from 
 	int d = cells[x].dlink;     // the list of sequences for item p.
 	cells[p].dlink = d;
 
 	cells[d].ulink = p;
 	cells[p].len--;
+	if (Profiling)
+		level_counts->CellsUnlinked++;
 }
 
+template<bool Profiling>
 void tweak_p(int x, int p)		// tweak'
 {
 	int d = cells[x].dlink;
@@ -481,8 +528,11 @@ void tweak_p(int x, int p)		// tweak'
 
 	cells[d].ulink = p;
 	cells[p].len--;
+	if (Profiling)
+		level_counts->CellsUnlinked++;
 }
 
+template<bool Profiling, bool Colors = true>
 void untweak(int l)
 {
 	int a = ft[l];
@@ -498,16 +548,19 @@ void untweak(int l)
 	{
 		cells[x].ulink = y;
 		k++;
-		unhide(x);
+		unhide<Profiling, Colors>(x);
 		y = x;
 		x = cells[x].dlink;
 	}
 
 	cells[z].ulink = y;
 	cells[p].len += k;
+	if (Profiling)
+		level_counts->CellsRelinked += k;
 
 }
 
+template<bool Profiling>
 void untweak_p(int l) // untweak'
 {
 	int a = ft[l];
@@ -529,8 +582,145 @@ void untweak_p(int l) // untweak'
 
 	cells[z].ulink = y;
 	cells[p].len += k;
+	if (Profiling)
+		level_counts->CellsRelinked += k;
 
-	uncover_p(p);
+	uncover_p<Profiling>(p);
+}
+///////////////////////////////////////////////////////////////////////////////
+// Forcing sequences into the solution before the search starts. The sequence
+// starting at cell p is used just as in M7, except there is no item i we chose it
+// for, so all its items are committed.
+//
+// A sequence that conflicts with the ones already forced has been hidden, unless
+// the conflict is in its only item. forced_colors holds the colors purified so far.
+static bool can_force(int p, const int* forced_colors)
+{
+	for (int q = p; cells[q].top > 0; q++)
+	{
+		int j = cells[q].top;
+		int c = cells[q].color;
+
+		if (c >= 0 && cells[cells[q].ulink].dlink != q)
+		{
+			return false;		// Hidden
+		}
+		if (j <= nprimary_items)
+		{
+			if (headers[j].bound == 0)
+				return false;
+		}
+		else if (c > 0 && forced_colors[j] > 0 && forced_colors[j] != c)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+static void force(int p)
+{
+	// Take the sequence out of its lists so it can't be chosen again:
+	int q;
+	for (q = p; cells[q].top > 0; q++)
+	{
+		if (cells[q].color >= 0)
+		{
+			int u = cells[q].ulink;
+			int d = cells[q].dlink;
+			cells[u].dlink = d;
+			cells[d].ulink = u;
+			cells[cells[q].top].len--;
+		}
+	}
+
+	for (q = p; cells[q].top > 0; q++)
+	{
+		int j = cells[q].top;
+		if (j <= nprimary_items)
+		{
+			headers[j].bound--;
+			if (headers[j].bound == 0)
+			{
+				cover<false>(j);
+			}
+		}
+		else
+		{
+			commit<false>(q, j);
+		}
+	}
+}
+
+static void unforce(int p)
+{
+	// Exactly the reverse of force:
+	int last = p;
+	while (cells[last + 1].top > 0)
+		last++;
+
+	int q;
+	for (q = last; q >= p; q--)
+	{
+		int j = cells[q].top;
+		if (j <= nprimary_items)
+		{
+			headers[j].bound++;
+			if (headers[j].bound == 1)
+			{
+				uncover_p<false>(j);
+			}
+		}
+		else
+		{
+			uncommit<false>(q, j);
+		}
+	}
+
+	for (q = last; q >= p; q--)
+	{
+		if (cells[q].color >= 0)
+		{
+			cells[cells[q].ulink].dlink = q;
+			cells[cells[q].dlink].ulink = q;
+			cells[cells[q].top].len++;
+		}
+	}
+}
+
+static bool force_sequences()
+{
+	vector<int> forced_colors(nheaders, 0);
+
+	for (auto idx_seq : *pforced_sequences)
+	{
+		assert(idx_seq >= 0 && idx_seq < nsequences);
+		int p = sequence_starts[idx_seq];
+
+		if (!can_force(p, forced_colors.data()))
+		{
+			return false;
+		}
+
+		force(p);
+		nforced++;
+
+		for (int q = p; cells[q].top > 0; q++)
+		{
+			if (cells[q].top > nprimary_items && cells[q].color > 0)
+				forced_colors[cells[q].top] = cells[q].color;
+		}
+	}
+	return true;
+}
+
+static void unforce_sequences()
+{
+	while (nforced > 0)
+	{
+		nforced--;
+		unforce(sequence_starts[(*pforced_sequences)[nforced]]);
+	}
 }
 ///////////////////////////////////////////////////////////////////////////////
 // Helper to output a table that looks like Table 2 in 7.2.2.1:
@@ -613,7 +803,7 @@ static void format(ostream& stream)
 			if (color <= 0)
 				stream << setw(5) << cells[line_start + n].color;
 			else
-				stream << setw(5) << pproblem->colors[cells[line_start + n].color - 1];
+				stream << setw(5) << pproblem->ColorNames[cells[line_start + n].color - 1];
 		}
 
 		stream << endl;
@@ -648,8 +838,8 @@ static const char *format_sequence(int q)
 {
 	q = sequence_start(q);
 
-	assert(psequence_map->find(q) != psequence_map->end());
-	int idx_seq = (* psequence_map)[q];
+	int idx_seq = cell_sequence[q];
+	assert(idx_seq >= 0);
 
 	const int bufsize = 2048;
 	static char buf[bufsize];
@@ -659,15 +849,7 @@ static const char *format_sequence(int q)
 	do
 	{
 		int idx_item = cells[q].top;
-		const char* pitem_name;
-		if (idx_item <= nprimary_items)
-		{
-			pitem_name = pproblem->primary_options[idx_item - 1].pValue;
-		}
-		else
-		{
-			pitem_name = pproblem->secondary_options[idx_item - nprimary_items - 1];
-		}
+		const char* pitem_name = pproblem->ItemNames[idx_item - 1];
 
 		auto n = strlen(pitem_name);
 
@@ -676,7 +858,7 @@ static const char *format_sequence(int q)
 		int color = cells[cells[q].top].color;
 		if (color > 0)
 		{
-			pcolor_name = pproblem->colors[color - 1];
+			pcolor_name = pproblem->ColorNames[color - 1];
 			nc = (int)strlen(pcolor_name) + 1;
 		}
 		else
@@ -721,37 +903,34 @@ static const char *format_sequence(int q)
 	return buf;
 }
 ///////////////////////////////////////////////////////////////////////////////
-///////////////////////////////////////////////////////////////////////////////
-bool exact_cover_with_multiplicities_and_colors(const ExactCoverWithMultiplicitiesAndColors& problem, 
-					vector<vector<int>> *presults, int max_results = 1, bool _non_sharp_preference = false)
+// The search itself, starting from the given state. With Profiling, it also counts
+// the work done at each level.
+//
+// Without Multiplicities, every primary item has u = v = 1, so bound is 1 until the
+// item is covered and slack is 0. That is Algorithm X, or C with Colors: there is no
+// tweaking, and the branching factor is just len. Without Colors, every secondary item
+// is committed by covering it, and hide doesn't look at colors.
+template<bool Profiling, bool Multiplicities, bool Colors>
+static bool search(vector<vector<int>>* presults, int max_results, const atomic<bool>* pcancel, AlgXStates state)
 {
-	//problem.print();
-	problem.assertValid();
-	assert(_CrtCheckMemory());
-	AlgXStates state = ax_Initialize;
-	non_sharp_preference = _non_sharp_preference;
-
-	pproblem = &problem;
-
-	start_time = std::chrono::high_resolution_clock::now();
-	get_counts();
-	init_cells();
-	setup_complete = std::chrono::high_resolution_clock::now();
-
-	solution_count = 0;
-	level_count = loop_count = 0;
-
-	//print();		// If you want to see Table 1.
-	int i, p, l = -1;
-
-	x = new int[max_depth];
-	ft = new int[max_depth];
+	int i = 0, p = 0, l = -1;
 
 	for (;;)
 	{
 		assert(l <= max_depth);
-		loop_count++;
+		if (!stopping)
+		{
+			loop_count++;	// Don't count backing out, so the stats reflect the search.
+
+			if (pcancel && pcancel->load(memory_order_relaxed))
+			{
+				// Back out just as if we had all the solutions we want:
+				stopping = cancelled = true;
+			}
+		}
 		TRACE("%lli:%i - %s\n", loop_count, l, StateName(state));
+		if (Profiling)
+			level_counts = &pprofile->level(max(l, 0));
 
 		switch (state)
 		{
@@ -761,7 +940,15 @@ bool exact_cover_with_multiplicities_and_colors(const ExactCoverWithMultipliciti
 			break;
 
 		case ax_EnterLevel:
+			if (stopping)
+			{
+				state = ax_LeaveLevel;
+				break;
+			}
 			level_count++;
+			if (Profiling)
+				level_counts->Entries++;
+
 			if (headers[0].rlink == 0)
 			{
 				state = ax_RecordSolution;
@@ -776,11 +963,11 @@ bool exact_cover_with_multiplicities_and_colors(const ExactCoverWithMultipliciti
 		{
 
 			int smallest_branch_factor = std::numeric_limits<int>::max();
-			int idx_smallest_branch;
+			int idx_smallest_branch = 0;
 
 			for (int j = headers[0].rlink; j !=0; j = headers[j].rlink)
 			{
-				int branch_factor = cells[j].len - (headers[j].bound - headers[j].slack) + 1;
+				int branch_factor = Multiplicities ? cells[j].len - (headers[j].bound - headers[j].slack) + 1 : cells[j].len;
 
 				// This implements the non-sharp preference heuristic.
 				// This is needed for the word rectangle problem, but not in general:
@@ -799,6 +986,16 @@ bool exact_cover_with_multiplicities_and_colors(const ExactCoverWithMultipliciti
 				}
 			}
 
+			if (Profiling)
+			{
+				level_counts->Choices++;
+				if (smallest_branch_factor <= 0)
+					level_counts->DeadEnds++;
+				else	// Without the heuristic's penalty:
+					level_counts->Branches += cells[idx_smallest_branch].len -
+						(headers[idx_smallest_branch].bound - headers[idx_smallest_branch].slack) + 1;
+			}
+
 			if (smallest_branch_factor <= 0)
 			{
 				state = ax_LeaveLevel;
@@ -815,12 +1012,12 @@ bool exact_cover_with_multiplicities_and_colors(const ExactCoverWithMultipliciti
 			x[l] = cells[i].dlink;
 			headers[i].bound--;
 
-			if (headers[i].bound == 0)
+			if (!Multiplicities || headers[i].bound == 0)
 			{
-				cover(i);
+				cover<Profiling, Colors>(i);
 			}
 
-			if (headers[i].bound != 0 || headers[i].slack != 0)
+			if (Multiplicities && (headers[i].bound != 0 || headers[i].slack != 0))
 			{
 				ft[l] = x[l];
 			}
@@ -829,7 +1026,7 @@ bool exact_cover_with_multiplicities_and_colors(const ExactCoverWithMultipliciti
 			break;
 
 		case ax_PossiblyTweak:
-			if (headers[i].bound == 0 && headers[i].slack == 0)  // In this case, we are like algorithm C
+			if (!Multiplicities || (headers[i].bound == 0 && headers[i].slack == 0))  // In this case, we are like algorithm C
 			{
 				if (x[l] != i)
 				{
@@ -841,20 +1038,23 @@ bool exact_cover_with_multiplicities_and_colors(const ExactCoverWithMultipliciti
 				}
 				continue;
 			}
-			if (cells[i].len < headers[i].bound - headers[i].slack) // Not enough items remain
+			if (cells[i].len <= headers[i].bound - headers[i].slack) // Not enough items remain
 			{
 				state = ax_Restore;
 				continue;
 			}
 			if (x[l] != i)
 			{
+				if (Profiling)
+					level_counts->Tweaks++;
+
 				if (headers[i].bound != 0)
 				{
-					tweak(x[l], i);
+					tweak<Profiling, Colors>(x[l], i);
 				}
 				else
 				{
-					tweak_p(x[l], i);
+					tweak_p<Profiling>(x[l], i);
 				}
 			}
 			else
@@ -888,14 +1088,18 @@ bool exact_cover_with_multiplicities_and_colors(const ExactCoverWithMultipliciti
 						if (j <= nprimary_items)
 						{
 							headers[j].bound--;
-							if (headers[j].bound == 0)
+							if (!Multiplicities || headers[j].bound == 0)
 							{
-								cover(j);
+								cover<Profiling, Colors>(j);
 							}
 						}
+						else if (!Colors)
+						{
+							cover<Profiling, Colors>(j);
+						}
 						else
 						{
-							commit(p, j);
+							commit<Profiling>(p, j);
 						}
 						p++;
 					}
@@ -921,37 +1125,48 @@ bool exact_cover_with_multiplicities_and_colors(const ExactCoverWithMultipliciti
 					if (j <= nprimary_items)
 					{
 						headers[j].bound++;
-						if (headers[j].bound == 1)
+						if (!Multiplicities || headers[j].bound == 1)
 						{
-							uncover_p(j);
+							uncover_p<Profiling, Colors>(j);
 						}
 					}
+					else if (!Colors)
+					{
+						uncover_p<Profiling, Colors>(j);
+					}
 					else
 					{
-						uncommit(p, j);
+						uncommit<Profiling>(p, j);
 					}
 					p--;
 				}
 			}
 
+			if (stopping)
+			{
+				// x[l] has been released, so Restore can undo this level without trying the rest:
+				state = ax_Restore;
+				break;
+			}
+
 			x[l] = cells[x[l]].dlink;
 			state = ax_PossiblyTweak;
 			break;
 
 		case ax_Restore:
-			if (headers[i].bound == 0 && headers[i].slack == 0)
+			if (!Multiplicities || (headers[i].bound == 0 && headers[i].slack == 0))
 			{
-				uncover_p(i);
+				uncover_p<Profiling, Colors>(i);
 			}
 			else
 			{
 				if (headers[i].bound != 0)
 				{
-					untweak(l);
+					untweak<Profiling, Colors>(l);
 				}
 				else
 				{
-					untweak_p(l);
+					untweak_p<Profiling>(l);
 				}
 			}
 			headers[i].bound++;
@@ -984,11 +1199,17 @@ bool exact_cover_with_multiplicities_and_colors(const ExactCoverWithMultipliciti
 
 		case ax_RecordSolution:
 		{
-			assert(l != 0);
+			assert(l != 0 || nforced > 0);
+			if (Profiling)
+				level_counts->Solutions++;
 			TRACE("Cover found:\n");
 			//print();
 			vector<int> result;
-			result.resize(l);
+			result.reserve(nforced + l);
+			for (int lout = 0; lout < nforced; lout++)
+			{
+				result.push_back((*pforced_sequences)[lout]);
+			}
 			for (int lout = 0; lout < l; lout++)
 			{
 				// c will be the cell index of a character in the string we chose.
@@ -996,46 +1217,126 @@ bool exact_cover_with_multiplicities_and_colors(const ExactCoverWithMultipliciti
 
 				if (c <= nprimary_items + nsecondary_items)
 				{
-					continue;
+					continue;	// The level chose not to use the item again, so there's no sequence.
 				}
 
 				TRACE("\t%s\n", format_sequence(c));
 
 				int seq_start = sequence_start(c);
 
-				assert(psequence_map->find(seq_start) != psequence_map->end());
-				int idx_seq = (*psequence_map)[seq_start];
-				result[lout] = idx_seq;
+				int idx_seq = cell_sequence[seq_start];
+				assert(idx_seq >= 0);
+				result.push_back(idx_seq);
 			}
 			presults->emplace_back(result);
 
-			if (presults->size() >= max_results)
-			{
-				state = ax_Cleanup;
-			}
-			else
+			if ((int)presults->size() >= max_results)
 			{
-				state = ax_LeaveLevel;
+				// Back out to level 0 rather than going straight to cleanup, so the
+				// forced sequences are released from the structure they were forced on:
+				stopping = true;
 			}
+			state = ax_LeaveLevel;
 			break;
 		}
 
 		case ax_Cleanup:
 
 			run_complete = std::chrono::high_resolution_clock::now();
+			if (pperf)
+				pperf->stop(&pperf->Search);
 
 			assert(_CrtCheckMemory());
 
-			destroy_cells();
-
-			delete[] ft;
-			delete[] x;
+			unforce_sequences();
 
 			solution_count = presults->size();
 			return solution_count != 0;
 		}
 	}
 }
+///////////////////////////////////////////////////////////////////////////////
+// Picks the search compiled for what the problem uses:
+template<bool Profiling>
+static bool search_kernel(vector<vector<int>>* presults, int max_results, const atomic<bool>* pcancel, AlgXStates state)
+{
+	if (has_multiplicities)
+	{
+		if (has_colors)
+			return search<Profiling, true, true>(presults, max_results, pcancel, state);
+		return search<Profiling, true, false>(presults, max_results, pcancel, state);
+	}
+	if (has_colors)
+		return search<Profiling, false, true>(presults, max_results, pcancel, state);
+	return search<Profiling, false, false>(presults, max_results, pcancel, state);
+}
+///////////////////////////////////////////////////////////////////////////////
+// Sets up and searches. The setup time and the counters started with the caller, which
+// may have converted the problem first:
+static bool solve(const CompactExactCover& problem, 
+					vector<vector<int>> *presults, int max_results, bool _non_sharp_preference,
+					const vector<int>* pforced, const atomic<bool>* pcancel, SearchProfile* _pprofile)
+{
+	assert(_CrtCheckMemory());
+	AlgXStates state = ax_Initialize;
+	non_sharp_preference = _non_sharp_preference;
+
+	pproblem = &problem;
+
+	get_counts();
+	init_cells();
+	setup_complete = std::chrono::high_resolution_clock::now();
+	if (pperf)
+	{
+		pperf->stop(&pperf->Setup);
+		pperf->start();
+	}
+
+	solution_count = 0;
+	level_count = loop_count = 0;
+	stopping = cancelled = false;
+
+	//print();		// If you want to see Table 1.
+
+	pforced_sequences = pforced;
+	nforced = 0;
+	if (pforced && !force_sequences())
+	{
+		// There can't be any solutions:
+		state = ax_Cleanup;
+	}
+
+	pprofile = _pprofile;
+	if (pprofile)
+		return search_kernel<true>(presults, max_results, pcancel, state);
+	return search_kernel<false>(presults, max_results, pcancel, state);
+}
+///////////////////////////////////////////////////////////////////////////////
+bool exact_cover_with_multiplicities_and_colors(const ExactCoverWithMultiplicitiesAndColors& problem, 
+					vector<vector<int>> *presults, int max_results, bool non_sharp_preference,
+					const vector<int>* pforced, const atomic<bool>* pcancel, SearchProfile* pprofile)
+{
+	//problem.print();
+	problem.assertValid();
+
+	start_time = std::chrono::high_resolution_clock::now();
+	if (pperf)
+		pperf->start();
+	converted.assign(problem);
+	return solve(converted, presults, max_results, non_sharp_preference, pforced, pcancel, pprofile);
+}
+///////////////////////////////////////////////////////////////////////////////
+bool exact_cover_with_multiplicities_and_colors(const CompactExactCover& problem, 
+					vector<vector<int>> *presults, int max_results, bool non_sharp_preference,
+					const vector<int>* pforced, const atomic<bool>* pcancel, SearchProfile* pprofile)
+{
+	problem.assertValid();
+
+	start_time = std::chrono::high_resolution_clock::now();
+	if (pperf)
+		pperf->start();
+	return solve(problem, presults, max_results, non_sharp_preference, pforced, pcancel, pprofile);
+}
 
 void print_exact_cover_with_multiplicities_and_colors_stats()
 {
@@ -1046,12 +1347,173 @@ void print_exact_cover_with_multiplicities_and_colors_stats()
 
 	if (non_sharp_preference)
 		cout << "\tThe non-sharp preference heuristic was used." << endl;
+	if (cancelled)
+		cout << "\tThe search was cancelled before it was complete." << endl;
 
 	cout << "\tTime used (microseconds): " << setup_dt.count() << " for setup and " <<
 		run_dt.count() << " to run." << endl;
 
 	cout << "\tLoop ran " << loop_count << " times with " << level_count << " level transitions." << endl;
+	arena.format(cout);
+	if (pperf)
+		pperf->format(level_count, cout);
+}
+///////////////////////////////////////////////////////////////////////////////
+void get_exact_cover_with_multiplicities_and_colors_stats(long* psetup_time, long* prun_time,
+	long long* ploop_count, long long* plevel_count, bool* pcancelled)
+{
+	*psetup_time = (long)std::chrono::duration_cast<std::chrono::microseconds>(setup_complete - start_time).count();
+	*prun_time = (long)std::chrono::duration_cast<std::chrono::microseconds>(run_complete - setup_complete).count();
+	*ploop_count = loop_count;
+	*plevel_count = level_count;
+	*pcancelled = cancelled;
+}
+///////////////////////////////////////////////////////////////////////////////
+void set_exact_cover_with_multiplicities_and_colors_perf_counters(PerfCounters* pcounters)
+{
+	pperf = pcounters;
+}
+///////////////////////////////////////////////////////////////////////////////
+void set_exact_cover_with_multiplicities_and_colors_huge_pages(HugePageMode mode, bool first_touch)
+{
+	arena.setHugePages(mode);
+	arena.setFirstTouch(first_touch);
 }
+///////////////////////////////////////////////////////////////////////////////
+// One sweep for the primitive benchmarks. Returns the number of calls. With setup_only,
+// only does what has to happen around the primitive:
+template<bool Profiling>
+static long long sweep_primitive(BenchmarkPrimitives primitive, bool setup_only)
+{
+	int nitems = nprimary_items + nsecondary_items;
+	long long calls = 0;
 
+	switch (primitive)
+	{
+		case bp_Cover:
+			for (int i = 1; i <= nitems && !setup_only; i++)
+			{
+				cover<Profiling>(i);
+				uncover_p<Profiling>(i);
+				calls++;
+			}
+			break;
 
+		case bp_Hide:
+			for (int p = nitems + 1; p < ncells && !setup_only; p++)
+			{
+				if (cells[p].top <= 0)
+					continue;	// A spacer.
+				hide<Profiling>(p);
+				unhide<Profiling>(p);
+				calls++;
+			}
+			break;
 
+		case bp_Color:
+			for (int p = nitems + 1; p < ncells; p++)
+			{
+				if (cells[p].top <= 0 || cells[p].color <= 0)
+					continue;
+
+				// In M7 the item x_l was chosen for is covered, which hides p, so purify
+				// doesn't find it in the item's list:
+				int i = cells[p].top;
+				int u = cells[p].ulink;
+				int d = cells[p].dlink;
+				int header_color = cells[i].color;
+				cells[u].dlink = d;
+				cells[d].ulink = u;
+				cells[i].len--;
+
+				if (!setup_only)
+				{
+					purify<Profiling>(p);
+					unpurify<Profiling>(p);
+				}
+
+				// purify leaves its color in the header, which is only read while the item is purified:
+				cells[i].color = header_color;
+				cells[u].dlink = p;
+				cells[d].ulink = p;
+				cells[i].len++;
+				calls++;
+			}
+			break;
+
+		case bp_Tweak:
+			// untweak takes the first tweaked cell from ft, as in the search:
+			for (int p = 1; p <= nprimary_items && !setup_only; p++)
+			{
+				if (cells[p].dlink == p)
+					continue;
+
+				ft[0] = cells[p].dlink;
+				for (int q = cells[p].dlink; q != p; q = cells[p].dlink)
+				{
+					tweak<Profiling>(q, p);
+					calls++;
+				}
+				untweak<Profiling>(0);
+			}
+			break;
+
+		default:
+			assert(0);
+	}
+	return calls;
+}
+///////////////////////////////////////////////////////////////////////////////
+bool benchmark_exact_cover_with_multiplicities_and_colors_primitives(const ExactCoverWithMultiplicitiesAndColors& problem,
+						int sweeps, vector<PrimitiveTiming>* ptimings)
+{
+	static const char* names[bp_Count] = { "cover+uncover", "hide+unhide", "purify+unpurify", "tweak+untweak" };
+
+	problem.assertValid();
+	converted.assign(problem);
+	pproblem = &converted;
+	get_counts();
+	init_cells();
+
+	ostringstream before;
+	format(before);
+	bool pass = true;
+
+	ptimings->clear();
+	for (int i = 0; i < bp_Count; i++)
+	{
+		BenchmarkPrimitives primitive = (BenchmarkPrimitives)i;
+		PrimitiveTiming timing;
+		timing.pName = names[i];
+
+		// Count the cells with the profiling version:
+		LevelCounts counts;
+		level_counts = &counts;
+		timing.Calls = sweep_primitive<true>(primitive, false);
+		timing.Cells = counts.CellsUnlinked + counts.CellsRelinked;
+		level_counts = nullptr;
+
+		timing.Nanoseconds = fastest_sweep(sweeps, [primitive]() { sweep_primitive<false>(primitive, false); }) -
+			fastest_sweep(sweeps, [primitive]() { sweep_primitive<false>(primitive, true); });
+		timing.Nanoseconds = timing.Calls > 0 ? max(0.0, timing.Nanoseconds) : 0;
+
+		// The same round trip check as AlgMPointer::testUncoverCover:
+		ostringstream after;
+		format(after);
+		timing.Restored = print_diff(before.str(), after.str());
+		pass = pass && timing.Restored;
+		ptimings->push_back(timing);
+	}
+	return pass;
+}
+///////////////////////////////////////////////////////////////////////////////
+std::mutex& exact_cover_with_multiplicities_and_colors_mutex()
+{
+	static std::mutex mutex;
+	return mutex;
+}
+///////////////////////////////////////////////////////////////////////////////
+void free_exact_cover_with_multiplicities_and_colors_buffers()
+{
+	destroy_cells();
+}
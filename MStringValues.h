@@ -0,0 +1,55 @@
+#pragma once
+
+// Functions from MStringValues.cpp, which follows Knuth as closely as possible.
+
+#include <vector>
+#include <atomic>
+#include <mutex>
+
+#include "PageArena.h"
+
+struct ExactCoverWithMultiplicitiesAndColors;
+struct CompactExactCover;
+class SearchProfile;
+class PerfCounters;
+struct PrimitiveTiming;
+
+// Solves the problem, returning up to max_results solutions. If pforced is supplied,
+// those sequences are part of every solution, as if they were chosen before the search
+// started. Returns false if there are no solutions, including when the forced sequences
+// conflict. If pcancel is supplied and gets set by another thread, the search stops and
+// returns the solutions found so far. If pprofile is supplied, the counts by level are
+// added to it (see SearchProfile.h).
+//
+// The state is kept in globals, so only one search can run at a time. Code that searches
+// from more than one thread holds exact_cover_with_multiplicities_and_colors_mutex.
+bool exact_cover_with_multiplicities_and_colors(const ExactCoverWithMultiplicitiesAndColors& problem,
+						std::vector<std::vector<int>>* presults, int max_results = 1, bool non_sharp_preference = false,
+						const std::vector<int>* pforced = nullptr, const std::atomic<bool>* pcancel = nullptr,
+						SearchProfile* pprofile = nullptr);
+// The same from the numbered form, which skips looking up the names:
+bool exact_cover_with_multiplicities_and_colors(const CompactExactCover& problem,
+						std::vector<std::vector<int>>* presults, int max_results = 1, bool non_sharp_preference = false,
+						const std::vector<int>* pforced = nullptr, const std::atomic<bool>* pcancel = nullptr,
+						SearchProfile* pprofile = nullptr);
+void print_exact_cover_with_multiplicities_and_colors_stats();
+// The stats from the last search. Times are in microseconds:
+void get_exact_cover_with_multiplicities_and_colors_stats(long* psetup_time, long* prun_time,
+						long long* ploop_count, long long* plevel_count, bool* pcancelled);
+// Measures the setup and search of later searches with the counters, and adds them to
+// the stats. Pass null to stop. See PerfCounters.h.
+void set_exact_cover_with_multiplicities_and_colors_perf_counters(PerfCounters* pcounters);
+// Puts the cells and the rest of the structure on huge pages from the next search, if
+// there are any. With first touch, the memory is mapped fresh for each setup, which runs
+// on the searching thread. See PageArena.h.
+void set_exact_cover_with_multiplicities_and_colors_huge_pages(HugePageMode mode, bool first_touch = false);
+// Times Knuth's cover, hide, purify and tweak, each with its inverse, over the whole problem,
+// taking the fastest of the sweeps. Returns false if any of them didn't restore the
+// structure. See Benchmark.h.
+bool benchmark_exact_cover_with_multiplicities_and_colors_primitives(const ExactCoverWithMultiplicitiesAndColors& problem,
+						int sweeps, std::vector<PrimitiveTiming>* ptimings);
+// The buffers are kept between searches so repeated small searches don't reallocate
+// them. This releases them, e.g. before checking for leaks at exit.
+void free_exact_cover_with_multiplicities_and_colors_buffers();
+// Protects the globals, including the stats, between threads:
+std::mutex& exact_cover_with_multiplicities_and_colors_mutex();
@@ -0,0 +1,241 @@
+
+#include <cstring>
+#include <cerrno>
+#include <cstdint>
+#include <fstream>
+#include <new>
+
+#include "PageArena.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+///////////////////////////////////////////////////////////////////////////////
+static const char* const huge_page_mode_names[] =
+{
+	"off",
+	"transparent",
+	"explicit",
+};
+///////////////////////////////////////////////////////////////////////////////
+const char* huge_page_mode_name(HugePageMode mode)
+{
+	return huge_page_mode_names[mode];
+}
+///////////////////////////////////////////////////////////////////////////////
+bool parse_huge_page_mode(const char* pname, HugePageMode* pmode)
+{
+	for (int i = 0; i <= hp_Explicit; i++)
+	{
+		if (strcmp(pname, huge_page_mode_names[i]) == 0)
+		{
+			*pmode = (HugePageMode)i;
+			return true;
+		}
+	}
+	return false;
+}
+///////////////////////////////////////////////////////////////////////////////
+static size_t round_up(size_t bytes, size_t unit)
+{
+	return (bytes + unit - 1) / unit * unit;
+}
+///////////////////////////////////////////////////////////////////////////////
+#ifdef _WIN32
+// Large pages need the "Lock pages in memory" privilege, which an administrator has to
+// grant and the process then has to enable:
+static bool enable_lock_memory_privilege(string* preason)
+{
+	HANDLE token;
+	if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token))
+	{
+		*preason = "the process token can't be opened";
+		return false;
+	}
+
+	TOKEN_PRIVILEGES privileges;
+	privileges.PrivilegeCount = 1;
+	privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+	bool b = LookupPrivilegeValueA(nullptr, "SeLockMemoryPrivilege", &privileges.Privileges[0].Luid) &&
+			AdjustTokenPrivileges(token, FALSE, &privileges, 0, nullptr, nullptr) &&
+			GetLastError() == ERROR_SUCCESS;	// It succeeds without the privilege, setting this.
+	CloseHandle(token);
+
+	if (!b)
+		*preason = "the process doesn't have the Lock pages in memory privilege";
+	return b;
+}
+#else
+// Transparent huge pages can be turned off for the whole system, in which case madvise
+// still succeeds:
+static bool transparent_huge_pages_enabled(string* preason)
+{
+	ifstream file("/sys/kernel/mm/transparent_hugepage/enabled");
+	string setting;
+	if (file && getline(file, setting) && setting.find("[never]") != string::npos)
+	{
+		*preason = "transparent huge pages are turned off";
+		return false;
+	}
+	return true;
+}
+
+static const size_t huge_page_size = 2 << 20;
+#endif
+///////////////////////////////////////////////////////////////////////////////
+void PageArena::map(size_t bytes)
+{
+	Pages = hp_Off;
+	MappedFor = Mode;
+	Reason.clear();
+
+#ifdef _WIN32
+	// There are no transparent huge pages, so both modes ask for large pages:
+	if (Mode != hp_Off)
+	{
+		size_t large_page_size = GetLargePageMinimum();
+		if (large_page_size == 0)
+		{
+			Reason = "large pages aren't supported";
+		}
+		else if (enable_lock_memory_privilege(&Reason))
+		{
+			size_t size = round_up(bytes, large_page_size);
+			pBase = (char*)VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+			if (pBase)
+			{
+				Capacity = size;
+				Pages = hp_Explicit;
+				return;
+			}
+			Reason = "there weren't enough free large pages";
+		}
+	}
+
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	size_t size = round_up(bytes, info.dwPageSize);
+	pBase = (char*)VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+	if (!pBase)
+		throw bad_alloc();
+	Capacity = size;
+#else
+	if (Mode == hp_Explicit)
+	{
+#ifdef MAP_HUGETLB
+		size_t size = round_up(bytes, huge_page_size);
+		void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (p != MAP_FAILED)
+		{
+			pBase = (char*)p;
+			Capacity = size;
+			Pages = hp_Explicit;
+			return;
+		}
+		Reason = string("no reserved huge pages (") + strerror(errno) + ")";
+#else
+		Reason = "reserved huge pages aren't supported";
+#endif
+	}
+
+#ifdef MADV_HUGEPAGE
+	if (Mode != hp_Off && transparent_huge_pages_enabled(&Reason))
+	{
+		// Huge pages start on a huge page boundary, so map one more and trim the ends:
+		size_t size = round_up(bytes, huge_page_size);
+		void* p = mmap(nullptr, size + huge_page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p == MAP_FAILED)
+			throw bad_alloc();
+
+		char* pstart = (char*)p;
+		char* paligned = (char*)round_up((uintptr_t)pstart, huge_page_size);
+		if (paligned > pstart)
+			munmap(pstart, paligned - pstart);
+		if (pstart + size + huge_page_size > paligned + size)
+			munmap(paligned + size, pstart + size + huge_page_size - (paligned + size));
+
+		pBase = paligned;
+		Capacity = size;
+		if (madvise(pBase, Capacity, MADV_HUGEPAGE) == 0)
+		{
+			Pages = hp_Transparent;
+			if (Mode == hp_Transparent)
+				Reason.clear();
+		}
+		else
+		{
+			Reason = string("madvise failed (") + strerror(errno) + ")";
+		}
+		return;
+	}
+#else
+	if (Mode != hp_Off)
+		Reason = "transparent huge pages aren't supported";
+#endif
+
+	size_t size = round_up(bytes, (size_t)sysconf(_SC_PAGESIZE));
+	void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED)
+		throw bad_alloc();
+	pBase = (char*)p;
+	Capacity = size;
+#endif
+}
+///////////////////////////////////////////////////////////////////////////////
+void PageArena::unmap()
+{
+	if (!pBase)
+		return;
+
+#ifdef _WIN32
+	VirtualFree(pBase, 0, MEM_RELEASE);
+#else
+	munmap(pBase, Capacity);
+#endif
+	pBase = nullptr;
+	Capacity = Used = 0;
+}
+///////////////////////////////////////////////////////////////////////////////
+void PageArena::begin(size_t bytes)
+{
+	// A fresh block has no pages yet, so whoever writes it first places them:
+	if (!pBase || bytes > Capacity || MappedFor != Mode || FirstTouch)
+	{
+		unmap();
+		map(bytes > 0 ? bytes : 1);
+	}
+	Used = 0;
+}
+///////////////////////////////////////////////////////////////////////////////
+void PageArena::format(std::ostream& stream) const
+{
+	if (Mode == hp_Off && !FirstTouch)
+		return;
+
+	stream << "\tThe items, cells and levels are in " << (Capacity + (1 << 20) - 1) / (1 << 20) << " MB of ";
+	switch (Pages)
+	{
+	case hp_Off:
+		stream << "regular pages";
+		break;
+	case hp_Transparent:
+		stream << "transparent huge pages";
+		break;
+	case hp_Explicit:
+		stream << "reserved huge pages";
+		break;
+	}
+	if (FirstTouch)
+		stream << ", mapped fresh so the thread that set up placed them";
+	stream << "." << endl;
+
+	if (!Reason.empty())
+		stream << "\tAsked for " << huge_page_mode_name(Mode) << " huge pages, but " << Reason << "." << endl;
+}
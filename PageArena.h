@@ -0,0 +1,94 @@
+#pragma once
+
+// One block of memory that an engine lays out its items, cells and levels in, so they can
+// be put on huge pages. Generated problems can have hundreds of MB of cells, and a search
+// jumps around them, so with regular pages most of its time can go on TLB misses.
+//
+// The block only grows, like reserve_buffer, and each setup carves it up again with
+// begin and allocate. Huge pages are asked for when the block is mapped; if the system
+// doesn't have them the arena falls back to regular pages, and pages() says what it got.
+//
+// Memory is placed on the NUMA node of the thread that first writes to it. The engines
+// write all of it when they set up, so with first touch the arena maps a fresh block for
+// each setup, and setting up on the thread that will search puts the pages next to it.
+
+#include <cstddef>
+#include <cassert>
+#include <string>
+#include <iostream>
+
+///////////////////////////////////////////////////////////////////////////////
+enum HugePageMode
+{
+	hp_Off,				// Regular pages.
+	hp_Transparent,		// Ask the kernel to back the block with transparent huge pages.
+	hp_Explicit,		// Huge pages reserved by the administrator, else transparent ones.
+};
+const char* huge_page_mode_name(HugePageMode mode);
+
+// Returns false if there is no mode with the name:
+bool parse_huge_page_mode(const char* pname, HugePageMode* pmode);
+///////////////////////////////////////////////////////////////////////////////
+class PageArena
+{
+	char* pBase = nullptr;
+	size_t Capacity = 0;
+	size_t Used = 0;
+
+	HugePageMode Mode = hp_Off;		// Asked for,
+	HugePageMode MappedFor = hp_Off;	// when the block was mapped,
+	HugePageMode Pages = hp_Off;	// and what it got.
+	bool FirstTouch = false;
+	std::string Reason;				// Why the block has fewer huge pages than asked for.
+
+	void map(size_t bytes);
+	void unmap();
+
+public:
+	// Each allocation starts on its own cache line:
+	static const size_t Alignment = 64;
+
+	PageArena() {}
+	~PageArena() { unmap(); }
+	PageArena(const PageArena&) = delete;
+	PageArena& operator=(const PageArena&) = delete;
+
+	// Both take effect at the next begin:
+	void setHugePages(HugePageMode mode) { Mode = mode; }
+	void setFirstTouch(bool first_touch) { FirstTouch = first_touch; }
+
+	HugePageMode hugePages() const { return Mode; }
+	bool firstTouch() const { return FirstTouch; }
+
+	// Gives the block back, e.g. before checking for leaks at exit:
+	void release() { unmap(); }
+
+	// Room for count Ts, which is what allocate takes from the block:
+	template<class T>
+	static size_t bytesFor(size_t count)
+	{
+		return (count * sizeof(T) + Alignment - 1) / Alignment * Alignment;
+	}
+
+	// Starts a new layout of the block, with room for at least bytes. Whatever was
+	// allocated from it before is gone, and the new memory isn't initialized.
+	void begin(size_t bytes);
+
+	template<class T>
+	T* allocate(size_t count)
+	{
+		size_t bytes = bytesFor<T>(count);
+		assert(Used + bytes <= Capacity);		// More than begin made room for.
+
+		T* p = (T*)(pBase + Used);
+		Used += bytes;
+		return p;
+	}
+
+	// What the block is on, once begin has mapped it:
+	HugePageMode pages() const { return Pages; }
+	size_t capacity() const { return Capacity; }
+
+	// A line for the stats, when huge pages or first touch were asked for:
+	void format(std::ostream& stream) const;
+};
@@ -5,6 +5,7 @@
 import matplotlib.pyplot as plt
 from matplotlib.patches import Rectangle
 import re
+import sys
 
 def read_file(file_name):
     with open(file_name) as f:
@@ -78,7 +79,9 @@ def plot_squares(maxval, sets):
         plt.axis('off')
     plt.show()
 
-m, squares = read_file(r"Partridge8.txt")
+# The output of a run, or of a solution log printed with solutionsdecode=:
+file_name = sys.argv[1] if len(sys.argv) > 1 else r"Partridge8.txt"
+m, squares = read_file(file_name)
 print("Read file successfully.")
 
 plot_squares(m, squares)
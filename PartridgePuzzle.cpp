@@ -3,7 +3,7 @@
 
 using namespace std;
 
-void PartridgePuzzle::generateProblem(ExactCoverWithMultiplicitiesAndColors* pproblem)
+void PartridgePuzzle::nameItems()
 {
 	int N = n * (n + 1) / 2;
 
@@ -11,20 +11,12 @@ void PartridgePuzzle::generateProblem(ExactCoverWithMultiplicitiesAndColors* ppr
 	squareIds.resize(n);
 	positionNames.resize(N * N);
 
-	pproblem->primary_options.resize(n + N * N);
-
-
 	char buf[64];
-	int i;
-	for (i = 0; i < n; i++)
+	for (int i = 0; i < n; i++)
 	{
 		sprintf_s(buf, "#%i", i + 1);
 		squareNames[i] = buf;
 		squareIds[i] = buf + 1;
-
-		pproblem->primary_options[i].pValue = squareNames[i].c_str();
-		pproblem->primary_options[i].u = i + 1;
-		pproblem->primary_options[i].v = i + 1;
 	}
 
 	for (int row = 0; row < N; row++)
@@ -32,15 +24,33 @@ void PartridgePuzzle::generateProblem(ExactCoverWithMultiplicitiesAndColors* ppr
 		for (int column = 0; column < N; column++)
 		{
 			sprintf_s(buf, "(%i,%i)", row, column);
+			positionNames[row * N + column] = buf;
+		}
+	}
+}
 
-			int idx = row * N + column;
-			positionNames[idx] = buf;
+void PartridgePuzzle::generateProblem(ExactCoverWithMultiplicitiesAndColors* pproblem)
+{
+	int N = n * (n + 1) / 2;
 
-			pproblem->primary_options[i].pValue = positionNames[idx].c_str();
-			pproblem->primary_options[i].u = 1;
-			pproblem->primary_options[i].v = 1;
-			i++;
-		}
+	nameItems();
+
+	pproblem->primary_options.resize(n + N * N);
+
+	int i;
+	for (i = 0; i < n; i++)
+	{
+		pproblem->primary_options[i].pValue = squareNames[i].c_str();
+		pproblem->primary_options[i].u = i + 1;
+		pproblem->primary_options[i].v = i + 1;
+	}
+
+	for (int idx = 0; idx < N * N; idx++)
+	{
+		pproblem->primary_options[i].pValue = positionNames[idx].c_str();
+		pproblem->primary_options[i].u = 1;
+		pproblem->primary_options[i].v = 1;
+		i++;
 	}
 
 	for (int i = 0; i < n; i++)
@@ -65,4 +75,68 @@ void PartridgePuzzle::generateProblem(ExactCoverWithMultiplicitiesAndColors* ppr
 		}
 	}
 
+}
+
+void PartridgePuzzle::generateItems(CompactExactCover* pproblem)
+{
+	int N = n * (n + 1) / 2;
+
+	nameItems();
+
+	// Square i is item i, and position (row, column) is item n + row * N + column:
+	pproblem->clear();
+	for (int i = 0; i < n; i++)
+		pproblem->addPrimary(squareNames[i].c_str(), i + 1, i + 1);
+	for (int idx = 0; idx < N * N; idx++)
+		pproblem->addPrimary(positionNames[idx].c_str());
+}
+
+void PartridgePuzzle::emitCells(CellSink& sink) const
+{
+	int N = n * (n + 1) / 2;
+
+	for (int i = 0; i < n; i++)
+	{
+		for (int row = 0; row < N - i; row++)
+		{
+			for (int column = 0; column < N - i; column++)
+			{
+				sink.addCell(i);
+
+				for (int y = 0; y <= i; y++)
+				{
+					for (int x = 0; x <= i; x++)
+					{
+						sink.addCell(n + (row + y) * N + column + x);
+					}
+				}
+				sink.endSequence();
+			}
+		}
+	}
+}
+
+void PartridgePuzzle::generateProblem(CompactExactCover* pproblem)
+{
+	int N = n * (n + 1) / 2;
+
+	generateItems(pproblem);
+
+	// Square i fits in (N - i)^2 places, and covers (i + 1)^2 positions in each:
+	int sequences = 0;
+	size_t cells = 0;
+	for (int i = 0; i < n; i++)
+	{
+		sequences += (N - i) * (N - i);
+		cells += (size_t)(N - i) * (N - i) * (1 + (i + 1) * (i + 1));
+	}
+	pproblem->reserve(sequences, cells);
+
+	emitCells(*pproblem);
+}
+
+void PartridgePuzzle::streamProblem(CompactExactCover* pproblem)
+{
+	generateItems(pproblem);
+	pproblem->stream([this](CellSink& sink) { emitCells(sink); });
 }
\ No newline at end of file
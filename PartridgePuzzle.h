@@ -2,6 +2,8 @@
 // https://www.mathpuzzle.com/partridge.html
 
 struct ExactCoverWithMultiplicitiesAndColors;
+struct CompactExactCover;
+struct CellSink;
 
 class PartridgePuzzle
 {
@@ -10,10 +12,17 @@ class PartridgePuzzle
 	std::vector<std::string> positionNames;
 	std::vector<std::string> squareIds;
 
+	void nameItems();
+	void generateItems(CompactExactCover* pproblem);
+	void emitCells(CellSink& sink) const;
 
 public:
 
 	PartridgePuzzle(int _n) : n(_n) {}
 
 	void generateProblem(ExactCoverWithMultiplicitiesAndColors* pproblem);
+	// The same problem numbered, so only the items get names:
+	void generateProblem(CompactExactCover* pproblem);
+	// Or streamed, so the engine sets up from the puzzle, which has to outlive the problem:
+	void streamProblem(CompactExactCover* pproblem);
 };
\ No newline at end of file
@@ -0,0 +1,209 @@
+
+#include <cstring>
+#include <cerrno>
+#include <iomanip>
+#include <cassert>
+#include <cstdint>
+
+#include "PerfCounters.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+///////////////////////////////////////////////////////////////////////////////
+void PerfSample::clear()
+{
+	for (int i = 0; i < pe_Count; i++)
+		Values[i] = -1;
+}
+///////////////////////////////////////////////////////////////////////////////
+const char* PerfCounters::EventName(PerfEvents event)
+{
+	switch (event)
+	{
+		case pe_Cycles:			return "cycles";
+		case pe_Instructions:	return "instructions";
+		case pe_L1Misses:		return "L1 misses";
+		case pe_LLCMisses:		return "LLC misses";
+		case pe_BranchMisses:	return "branch misses";
+
+		default:			assert(0); return "Error";
+	}
+}
+///////////////////////////////////////////////////////////////////////////////
+PerfCounters::PerfCounters()
+{
+	for (int i = 0; i < pe_Count; i++)
+	{
+		Fds[i] = -1;
+		StartValues[i] = StartEnabled[i] = StartRunning[i] = 0;
+	}
+
+#ifdef __linux__
+	for (int i = 0; i < pe_Count; i++)
+	{
+		perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		// With more counters than the hardware has, the kernel takes turns and we scale:
+		attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+		switch (i)
+		{
+			case pe_Cycles:
+				attr.type = PERF_TYPE_HARDWARE;
+				attr.config = PERF_COUNT_HW_CPU_CYCLES;
+				break;
+			case pe_Instructions:
+				attr.type = PERF_TYPE_HARDWARE;
+				attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+				break;
+			case pe_L1Misses:
+				attr.type = PERF_TYPE_HW_CACHE;
+				attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+								(PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+				break;
+			case pe_LLCMisses:
+				attr.type = PERF_TYPE_HARDWARE;
+				attr.config = PERF_COUNT_HW_CACHE_MISSES;
+				break;
+			case pe_BranchMisses:
+				attr.type = PERF_TYPE_HARDWARE;
+				attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+				break;
+		}
+
+		// This thread, on any CPU:
+		Fds[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+		if (Fds[i] < 0 && Reason.empty())
+			Reason = strerror(errno);
+	}
+#else
+	Reason = "not supported on this platform";
+#endif
+}
+///////////////////////////////////////////////////////////////////////////////
+PerfCounters::~PerfCounters()
+{
+#ifdef __linux__
+	for (int i = 0; i < pe_Count; i++)
+	{
+		if (Fds[i] >= 0)
+			close(Fds[i]);
+	}
+#endif
+}
+///////////////////////////////////////////////////////////////////////////////
+bool PerfCounters::isAvailable() const
+{
+	for (int i = 0; i < pe_Count; i++)
+	{
+		if (Fds[i] >= 0)
+			return true;
+	}
+	return false;
+}
+///////////////////////////////////////////////////////////////////////////////
+bool PerfCounters::read(int idx, long long* pvalue, long long* penabled, long long* prunning) const
+{
+#ifdef __linux__
+	if (Fds[idx] < 0)
+		return false;
+
+	uint64_t data[3];
+	if (::read(Fds[idx], data, sizeof(data)) != sizeof(data))
+		return false;
+
+	*pvalue = (long long)data[0];
+	*penabled = (long long)data[1];
+	*prunning = (long long)data[2];
+	return true;
+#else
+	return false;
+#endif
+}
+///////////////////////////////////////////////////////////////////////////////
+void PerfCounters::start()
+{
+	for (int i = 0; i < pe_Count; i++)
+	{
+		if (!read(i, &StartValues[i], &StartEnabled[i], &StartRunning[i]))
+			StartValues[i] = -1;
+	}
+}
+///////////////////////////////////////////////////////////////////////////////
+void PerfCounters::stop(PerfSample* psample)
+{
+	psample->clear();
+
+	for (int i = 0; i < pe_Count; i++)
+	{
+		long long value, enabled, running;
+		if (StartValues[i] < 0 || !read(i, &value, &enabled, &running))
+			continue;
+
+		long long count = value - StartValues[i];
+		long long enabled_time = enabled - StartEnabled[i];
+		long long running_time = running - StartRunning[i];
+
+		if (running_time <= 0)
+			continue;	// Never got a turn on the hardware, so we know nothing.
+		if (running_time < enabled_time)
+			count = (long long)((double)count * enabled_time / running_time);
+
+		psample->Values[i] = count;
+	}
+}
+///////////////////////////////////////////////////////////////////////////////
+static void format_sample(const char* pphase, const PerfSample& sample, long long level_count, ostream& stream)
+{
+	stream << "\t" << pphase << ":";
+	for (int i = 0; i < pe_Count; i++)
+	{
+		PerfEvents event = (PerfEvents)i;
+		stream << " " << (sample.has(event) ? to_string(sample.Values[i]) : string("n/a")) << " " <<
+			PerfCounters::EventName(event) << (i + 1 < pe_Count ? "," : ".");
+	}
+	stream << endl;
+
+	stream << fixed << setprecision(2);
+	if (sample.has(pe_Cycles) && sample.has(pe_Instructions) && sample.Values[pe_Cycles] > 0)
+		stream << "\t\tIPC " << (double)sample.Values[pe_Instructions] / sample.Values[pe_Cycles] << "." << endl;
+
+	if (level_count > 0)
+	{
+		string misses;
+		for (PerfEvents event : { pe_L1Misses, pe_LLCMisses, pe_BranchMisses })
+		{
+			if (sample.has(event))
+				misses += " " + to_string((double)sample.Values[event] / level_count) + " " + PerfCounters::EventName(event);
+		}
+		if (!misses.empty())
+			stream << "\t\tPer level transition:" << misses << "." << endl;
+	}
+}
+///////////////////////////////////////////////////////////////////////////////
+void PerfCounters::format(long long level_count, std::ostream& stream) const
+{
+	if (!isAvailable())
+	{
+		stream << "\tHardware counters are not available (" << Reason << "), so only times are reported." << endl;
+		return;
+	}
+
+	ios::fmtflags flags = stream.flags();
+	streamsize precision = stream.precision();
+
+	stream << "\tHardware counters, in user mode:" << endl;
+	format_sample("Setup", Setup, 0, stream);
+	format_sample("Search", Search, level_count, stream);
+
+	stream.flags(flags);
+	stream.precision(precision);
+}
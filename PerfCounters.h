@@ -0,0 +1,69 @@
+#pragma once
+
+// Hardware performance counters around the phases of a search, to see whether time goes
+// to cache misses or branch mispredictions. Uses perf_event_open on Linux. Elsewhere, or
+// when the counters can't be opened (e.g. in a container without permission), nothing
+// is counted and the engines just report their times as usual.
+//
+// The counters count the thread that created the PerfCounters, so the search has to
+// run on that thread.
+
+#include <iostream>
+#include <string>
+
+///////////////////////////////////////////////////////////////////////////////
+enum PerfEvents
+{
+	pe_Cycles,
+	pe_Instructions,
+	pe_L1Misses,		// L1 data cache read misses.
+	pe_LLCMisses,		// Last level cache misses.
+	pe_BranchMisses,
+
+	pe_Count,
+};
+///////////////////////////////////////////////////////////////////////////////
+struct PerfSample
+{
+	long long Values[pe_Count];		// -1 where the counter isn't available.
+
+	PerfSample() { clear(); }
+	void clear();
+	bool has(PerfEvents event) const { return Values[event] >= 0; }
+};
+///////////////////////////////////////////////////////////////////////////////
+class PerfCounters
+{
+	int Fds[pe_Count];		// -1 where the counter couldn't be opened.
+	std::string Reason;		// Why no counters could be opened.
+
+	// Raw readings when the current phase started:
+	long long StartValues[pe_Count];
+	long long StartEnabled[pe_Count];
+	long long StartRunning[pe_Count];
+
+	bool read(int idx, long long* pvalue, long long* penabled, long long* prunning) const;
+
+public:
+	PerfCounters();
+	~PerfCounters();
+
+	PerfCounters(const PerfCounters&) = delete;
+	PerfCounters& operator=(const PerfCounters&) = delete;
+
+	// True if at least one counter could be opened:
+	bool isAvailable() const;
+
+	// Counts from the last setup and search, set by the engines:
+	PerfSample Setup;
+	PerfSample Search;
+
+	// Counting a phase. stop sets *psample to the counts since start:
+	void start();
+	void stop(PerfSample* psample);
+
+	static const char* EventName(PerfEvents event);
+
+	// Lines for showStats, with IPC, and misses per level transition for the search:
+	void format(long long level_count, std::ostream& stream = std::cout) const;
+};
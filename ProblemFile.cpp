@@ -0,0 +1,352 @@
+
+#include <cstring>
+#include <cstdio>
+#include <climits>
+#include <fstream>
+
+#include "ProblemFile.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <direct.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+///////////////////////////////////////////////////////////////////////////////
+static const char ProblemMagic[8] = { 'D', 'L', 'X', 'P', 'R', 'O', 'B', 0 };
+static const int32_t ProblemVersion = 1;
+static const uint32_t ProblemByteOrder = 0x01020304;
+
+static_assert(sizeof(CompactExactCover::Cell) == 2 * sizeof(int32_t), "The cells are written as they are.");
+///////////////////////////////////////////////////////////////////////////////
+static uint64_t align8(uint64_t n)
+{
+	return (n + 7) & ~7ull;
+}
+///////////////////////////////////////////////////////////////////////////////
+bool write_problem_file(const char* pfile_name, const CompactExactCover& problem, uint64_t key)
+{
+	problem.assertValid();
+
+	int ncolors = (int)problem.ColorNames.size();
+
+	// The names, and where each starts:
+	vector<uint32_t> name_offsets;
+	string names;
+	for (const char* pc : problem.ItemNames)
+	{
+		name_offsets.push_back((uint32_t)names.size());
+		names.append(pc, strlen(pc) + 1);
+	}
+	for (const char* pc : problem.ColorNames)
+	{
+		name_offsets.push_back((uint32_t)names.size());
+		names.append(pc, strlen(pc) + 1);
+	}
+
+	ProblemFileHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.Magic, ProblemMagic, sizeof(ProblemMagic));
+	header.Version = ProblemVersion;
+	header.ByteOrder = ProblemByteOrder;
+	header.Key = key;
+	header.PrimaryItems = problem.PrimaryItems;
+	header.Items = problem.items();
+	header.Colors = ncolors;
+	header.Sequences = problem.sequences();
+	header.Cells = (int64_t)problem.Cells.size();
+	header.HasCosts = !problem.Costs.empty();
+
+	uint64_t offset = align8(sizeof(header));
+	header.MinOffset = offset;
+	offset = align8(offset + problem.PrimaryItems * sizeof(int32_t));
+	header.MaxOffset = offset;
+	offset = align8(offset + problem.PrimaryItems * sizeof(int32_t));
+	header.NameOffset = offset;
+	offset = align8(offset + name_offsets.size() * sizeof(uint32_t));
+	header.SequenceStartOffset = offset;
+	offset = align8(offset + problem.SequenceStarts.size() * sizeof(int32_t));
+	header.CellOffset = offset;
+	offset = align8(offset + problem.Cells.size() * sizeof(CompactExactCover::Cell));
+	header.CostOffset = offset;
+	offset = align8(offset + problem.Costs.size() * sizeof(int32_t));
+	header.StringOffset = offset;
+	header.StringBytes = names.size();
+	offset = align8(offset + names.size());
+	header.FileSize = offset;
+
+	// Laid out in memory, so the file is written at once:
+	vector<char> buffer((size_t)header.FileSize, 0);
+	memcpy(buffer.data(), &header, sizeof(header));
+	memcpy(buffer.data() + header.MinOffset, problem.Min.data(), problem.Min.size() * sizeof(int32_t));
+	memcpy(buffer.data() + header.MaxOffset, problem.Max.data(), problem.Max.size() * sizeof(int32_t));
+	memcpy(buffer.data() + header.NameOffset, name_offsets.data(), name_offsets.size() * sizeof(uint32_t));
+	memcpy(buffer.data() + header.SequenceStartOffset, problem.SequenceStarts.data(),
+		problem.SequenceStarts.size() * sizeof(int32_t));
+	memcpy(buffer.data() + header.CellOffset, problem.Cells.data(), problem.Cells.size() * sizeof(CompactExactCover::Cell));
+	memcpy(buffer.data() + header.CostOffset, problem.Costs.data(), problem.Costs.size() * sizeof(int32_t));
+	memcpy(buffer.data() + header.StringOffset, names.data(), names.size());
+
+	string temp_name = string(pfile_name) + ".tmp";
+	{
+		ofstream file(temp_name, ios::binary);
+		if (!file)
+		{
+			cout << "Couldn't create problem file " << temp_name << "." << endl;
+			return false;
+		}
+		file.write(buffer.data(), buffer.size());
+		if (!file)
+		{
+			cout << "Couldn't write problem file " << temp_name << "." << endl;
+			remove(temp_name.c_str());
+			return false;
+		}
+	}
+
+#ifdef _WIN32
+	// rename won't replace a file here:
+	remove(pfile_name);
+#endif
+	if (rename(temp_name.c_str(), pfile_name) != 0)
+	{
+		cout << "Couldn't rename " << temp_name << " to " << pfile_name << "." << endl;
+		remove(temp_name.c_str());
+		return false;
+	}
+	return true;
+}
+///////////////////////////////////////////////////////////////////////////////
+bool MappedProblem::fail(const char* pfile_name, const char* pwhy)
+{
+	close();
+	Error = string(pfile_name) + " " + pwhy;
+	return false;
+}
+///////////////////////////////////////////////////////////////////////////////
+void MappedProblem::close()
+{
+#ifdef _WIN32
+	if (pBase)
+		UnmapViewOfFile(pBase);
+	if (hMapping)
+		CloseHandle(hMapping);
+	if (hFile)
+		CloseHandle(hFile);
+	hMapping = hFile = nullptr;
+#else
+	if (pBase)
+		munmap((void*)pBase, Size);
+#endif
+	pBase = nullptr;
+	Size = 0;
+
+	// The names pointed into the file:
+	Problem.clear();
+}
+///////////////////////////////////////////////////////////////////////////////
+bool MappedProblem::open(const char* pfile_name, uint64_t key)
+{
+	close();
+	Error.clear();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(pfile_name, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return fail(pfile_name, "can't be opened.");
+	hFile = file;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size))
+		return fail(pfile_name, "can't be opened.");
+	if ((uint64_t)size.QuadPart < sizeof(ProblemFileHeader))
+		return fail(pfile_name, "is too short to be a problem file.");
+
+	hMapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (hMapping)
+		pBase = (const char*)MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+	if (!pBase)
+		return fail(pfile_name, "can't be mapped.");
+	Size = (size_t)size.QuadPart;
+#else
+	int fd = ::open(pfile_name, O_RDONLY);
+	if (fd < 0)
+		return fail(pfile_name, "can't be opened.");
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || (uint64_t)info.st_size < sizeof(ProblemFileHeader))
+	{
+		::close(fd);
+		return fail(pfile_name, "is too short to be a problem file.");
+	}
+
+	void* p = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (p == MAP_FAILED)
+		return fail(pfile_name, "can't be mapped.");
+	pBase = (const char*)p;
+	Size = (size_t)info.st_size;
+#endif
+
+	const ProblemFileHeader& header = *(const ProblemFileHeader*)pBase;
+	if (memcmp(header.Magic, ProblemMagic, sizeof(ProblemMagic)) != 0 || header.Version != ProblemVersion ||
+		header.ByteOrder != ProblemByteOrder)
+		return fail(pfile_name, "isn't a problem file this version can read.");
+	if (header.FileSize != Size)
+		return fail(pfile_name, "is truncated.");
+	if (key && header.Key != key)
+		return fail(pfile_name, "was generated from something else.");
+
+	if (header.PrimaryItems < 0 || header.PrimaryItems > header.Items || header.Colors < 0 ||
+		header.Sequences < 0 || header.Cells < 0 || header.Cells > INT_MAX)
+		return fail(pfile_name, "has impossible counts.");
+
+	// Each section has to be inside the file, and aligned for what is in it:
+	auto fits = [this](uint64_t offset, uint64_t count, uint64_t size)
+	{
+		return offset % 8 == 0 && offset <= Size && count <= (Size - offset) / size;
+	};
+	uint64_t nnames = (uint64_t)header.Items + header.Colors;
+	uint64_t ncosts = header.HasCosts ? header.Sequences : 0;
+	if (!fits(header.MinOffset, header.PrimaryItems, sizeof(int32_t)) ||
+		!fits(header.MaxOffset, header.PrimaryItems, sizeof(int32_t)) ||
+		!fits(header.NameOffset, nnames, sizeof(uint32_t)) ||
+		!fits(header.SequenceStartOffset, (uint64_t)header.Sequences + 1, sizeof(int32_t)) ||
+		!fits(header.CellOffset, header.Cells, sizeof(CompactExactCover::Cell)) ||
+		!fits(header.CostOffset, ncosts, sizeof(int32_t)) ||
+		!fits(header.StringOffset, header.StringBytes, 1))
+		return fail(pfile_name, "has a section outside the file.");
+
+	// The names have to end inside the strings:
+	const char* pstrings = pBase + header.StringOffset;
+	const uint32_t* pname_offsets = (const uint32_t*)(pBase + header.NameOffset);
+	if (nnames > 0 && (header.StringBytes == 0 || pstrings[header.StringBytes - 1] != 0))
+		return fail(pfile_name, "has names that aren't terminated.");
+	for (uint64_t i = 0; i < nnames; i++)
+	{
+		if (pname_offsets[i] >= header.StringBytes)
+			return fail(pfile_name, "has a name outside the file.");
+	}
+
+	Problem.PrimaryItems = header.PrimaryItems;
+	Problem.ItemNames.resize(header.Items);
+	for (int i = 0; i < header.Items; i++)
+		Problem.ItemNames[i] = pstrings + pname_offsets[i];
+	Problem.ColorNames.resize(header.Colors);
+	for (int i = 0; i < header.Colors; i++)
+		Problem.ColorNames[i] = pstrings + pname_offsets[header.Items + i];
+
+	const int32_t* pmin = (const int32_t*)(pBase + header.MinOffset);
+	const int32_t* pmax = (const int32_t*)(pBase + header.MaxOffset);
+	const int32_t* pstarts = (const int32_t*)(pBase + header.SequenceStartOffset);
+	const CompactExactCover::Cell* pcells = (const CompactExactCover::Cell*)(pBase + header.CellOffset);
+	const int32_t* pcosts = (const int32_t*)(pBase + header.CostOffset);
+
+	Problem.Min.assign(pmin, pmin + header.PrimaryItems);
+	Problem.Max.assign(pmax, pmax + header.PrimaryItems);
+	Problem.SequenceStarts.assign(pstarts, pstarts + header.Sequences + 1);
+	Problem.Cells.assign(pcells, pcells + header.Cells);
+	Problem.Costs.assign(pcosts, pcosts + ncosts);
+
+	// The checks assertValid makes, which a release build needs too for a file. An item
+	// can't be used more often than there are sequences, which also keeps the engines'
+	// level stacks, sized from the multiplicities, in proportion to the problem:
+	for (int i = 0; i < Problem.PrimaryItems; i++)
+	{
+		if (Problem.Min[i] < 0 || Problem.Min[i] > Problem.Max[i] || Problem.Max[i] > header.Sequences)
+			return fail(pfile_name, "has an item with impossible multiplicities.");
+	}
+	if (Problem.SequenceStarts[0] != 0 || Problem.SequenceStarts.back() != header.Cells)
+		return fail(pfile_name, "has sequences that don't cover the cells.");
+	for (int i = 0; i < header.Sequences; i++)
+	{
+		if (Problem.SequenceStarts[i] > Problem.SequenceStarts[i + 1])
+			return fail(pfile_name, "has sequences that don't cover the cells.");
+	}
+	for (auto& cell : Problem.Cells)
+	{
+		if (cell.Item < 0 || cell.Item >= header.Items || cell.Color < 0 || cell.Color > header.Colors ||
+			(cell.Item < header.PrimaryItems) != (cell.Color == 0))
+			return fail(pfile_name, "has a cell outside the items or colors.");
+	}
+
+	// The engines link each cell into its item's list, so an item twice in a sequence would
+	// corrupt the lists, and a sequence needs a primary item to ever be chosen:
+	vector<int> last_sequence(header.Items, -1);
+	for (int i = 0; i < header.Sequences; i++)
+	{
+		bool has_primary = false;
+		for (int c = Problem.SequenceStarts[i]; c < Problem.SequenceStarts[i + 1]; c++)
+		{
+			int item = Problem.Cells[c].Item;
+			if (last_sequence[item] == i)
+				return fail(pfile_name, "has a sequence with an item twice.");
+			last_sequence[item] = i;
+			has_primary |= item < header.PrimaryItems;
+		}
+		if (!has_primary)
+			return fail(pfile_name, "has a sequence without a primary item.");
+	}
+	for (auto cost : Problem.Costs)
+	{
+		if (cost < 0)
+			return fail(pfile_name, "has a negative cost.");
+	}
+	return true;
+}
+///////////////////////////////////////////////////////////////////////////////
+uint64_t hash_problem_key(uint64_t key, const void* p, size_t bytes)
+{
+	const unsigned char* pc = (const unsigned char*)p;
+	for (size_t i = 0; i < bytes; i++)
+	{
+		key ^= pc[i];
+		key *= 1099511628211ull;
+	}
+	return key;
+}
+///////////////////////////////////////////////////////////////////////////////
+uint64_t hash_problem_key(uint64_t key, const std::string& s)
+{
+	// Include the terminator so "ab","c" != "a","bc":
+	return hash_problem_key(key, s.c_str(), s.size() + 1);
+}
+///////////////////////////////////////////////////////////////////////////////
+std::string ProblemCache::fileName(uint64_t key) const
+{
+	char buf[32];
+	sprintf_s(buf, "%016llx", (unsigned long long)key);
+	return Directory + "/" + buf + ".problem";
+}
+///////////////////////////////////////////////////////////////////////////////
+bool ProblemCache::load(uint64_t key, MappedProblem* pmapped) const
+{
+	string file_name = fileName(key);
+	if (!ifstream(file_name))
+		return false;
+
+	if (!pmapped->open(file_name.c_str(), key))
+	{
+		cout << "Not using the cached problem, since " << pmapped->error() << endl;
+		return false;
+	}
+	return true;
+}
+///////////////////////////////////////////////////////////////////////////////
+bool ProblemCache::store(uint64_t key, const CompactExactCover& problem) const
+{
+	// It's fine if it is already there:
+#ifdef _WIN32
+	_mkdir(Directory.c_str());
+#else
+	mkdir(Directory.c_str(), 0777);
+#endif
+	return write_problem_file(fileName(key).c_str(), problem, key);
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+// A binary file of a CompactExactCover, which is mapped into memory rather than read and
+// parsed, and a cache of generated problems kept in such files. Generating a big problem
+// and looking up the names of its cells costs real time on every run; with the cache, a
+// repeat run maps the file and sets up from its arrays.
+//
+// File format, in native byte order, with every section starting on 8 bytes:
+//
+//	ProblemFileHeader
+//	int32 Min and int32 Max of each primary item
+//	uint32 offset into the names of each item, then of each color
+//	int32 start of each sequence, and one past the last
+//	the cells, an int32 item and an int32 color each (see CompactExactCover::Cell)
+//	int32 cost of each sequence, if the problem has costs
+//	the names, each 0 terminated
+//
+// The cells and the other arrays are copied out of the mapping, which is one memcpy each.
+// The names are used where they are, so they last as long as the MappedProblem.
+
+#include <string>
+#include <cstdint>
+
+#include "Common.h"
+
+///////////////////////////////////////////////////////////////////////////////
+struct ProblemFileHeader
+{
+	char Magic[8];				// "DLXPROB" and a 0.
+	int32_t Version;
+	uint32_t ByteOrder;			// 0x01020304 as written.
+	uint64_t Key;				// What the problem was generated from, or 0. See ProblemCache.
+	uint64_t FileSize;
+
+	int32_t PrimaryItems;
+	int32_t Items;
+	int32_t Colors;
+	int32_t Sequences;
+	int64_t Cells;
+	int32_t HasCosts;
+	int32_t Reserved;
+
+	// From the start of the file:
+	uint64_t MinOffset;
+	uint64_t MaxOffset;
+	uint64_t NameOffset;
+	uint64_t SequenceStartOffset;
+	uint64_t CellOffset;
+	uint64_t CostOffset;
+	uint64_t StringOffset;
+	uint64_t StringBytes;
+};
+///////////////////////////////////////////////////////////////////////////////
+// Writes the file next to the name and renames it, so a reader never maps half a file.
+// Prints why and returns false if it can't:
+bool write_problem_file(const char* pfile_name, const CompactExactCover& problem, uint64_t key = 0);
+///////////////////////////////////////////////////////////////////////////////
+class MappedProblem
+{
+	const char* pBase = nullptr;
+	size_t Size = 0;
+#ifdef _WIN32
+	void* hFile = nullptr;
+	void* hMapping = nullptr;
+#endif
+
+	CompactExactCover Problem;
+	std::string Error;
+
+	bool fail(const char* pfile_name, const char* pwhy);
+
+public:
+	MappedProblem() {}
+	~MappedProblem() { close(); }
+	MappedProblem(const MappedProblem&) = delete;
+	MappedProblem& operator=(const MappedProblem&) = delete;
+
+	// Maps the file and checks it: every cell in range, no item twice in a sequence, and
+	// no multiplicity above the number of sequences, so a damaged file can't crash a
+	// search. With a key, the file has to have been written with it.
+	// Returns false with the reason in error():
+	bool open(const char* pfile_name, uint64_t key = 0);
+	void close();
+
+	bool isOpen() const { return pBase != nullptr; }
+	const CompactExactCover& problem() const { return Problem; }
+	const std::string& error() const { return Error; }
+};
+///////////////////////////////////////////////////////////////////////////////
+// FNV-1a, like problem_hash. Keys hash what a generator was given, e.g. the words it
+// read and its limits, along with a version the generator bumps when its output changes:
+const uint64_t ProblemKeyBasis = 14695981039346656037ull;
+uint64_t hash_problem_key(uint64_t key, const void* p, size_t bytes);
+uint64_t hash_problem_key(uint64_t key, const std::string& s);
+///////////////////////////////////////////////////////////////////////////////
+// Problem files in a directory, named by their keys:
+class ProblemCache
+{
+	std::string Directory;
+
+public:
+	ProblemCache(const char* pdirectory) : Directory(pdirectory) {}
+
+	std::string fileName(uint64_t key) const;
+
+	// Maps the problem stored for the key. Returns false if there isn't one, or it can't
+	// be used, which is only printed when the file is there:
+	bool load(uint64_t key, MappedProblem* pmapped) const;
+
+	// Creates the directory if it has to:
+	bool store(uint64_t key, const CompactExactCover& problem) const;
+};
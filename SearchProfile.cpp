@@ -0,0 +1,77 @@
+
+#include <iomanip>
+#include <fstream>
+
+#include "SearchProfile.h"
+
+using namespace std;
+///////////////////////////////////////////////////////////////////////////////
+void LevelCounts::add(const LevelCounts& other)
+{
+	Entries += other.Entries;
+	Solutions += other.Solutions;
+	Choices += other.Choices;
+	DeadEnds += other.DeadEnds;
+	Branches += other.Branches;
+	CellsUnlinked += other.CellsUnlinked;
+	CellsRelinked += other.CellsRelinked;
+	Tweaks += other.Tweaks;
+}
+///////////////////////////////////////////////////////////////////////////////
+LevelCounts SearchProfile::totals() const
+{
+	LevelCounts total;
+	for (const LevelCounts& counts : Levels)
+		total.add(counts);
+	return total;
+}
+///////////////////////////////////////////////////////////////////////////////
+static void format_counts(const char* plabel, const LevelCounts& counts, ostream& stream)
+{
+	stream << setw(6) << plabel << setw(13) << counts.Entries << setw(10) << counts.Solutions <<
+		setw(13) << counts.Choices << setw(12) << counts.DeadEnds <<
+		setw(10) << fixed << setprecision(2) << counts.averageBranchingFactor() <<
+		setw(15) << counts.CellsUnlinked << setw(15) << counts.CellsRelinked << setw(12) << counts.Tweaks << endl;
+}
+///////////////////////////////////////////////////////////////////////////////
+void SearchProfile::format(std::ostream& stream) const
+{
+	ios::fmtflags flags = stream.flags();
+	streamsize precision = stream.precision();
+
+	stream << setw(6) << "Level" << setw(13) << "Entries" << setw(10) << "Solutions" <<
+		setw(13) << "Choices" << setw(12) << "Dead ends" << setw(10) << "Branching" <<
+		setw(15) << "Unlinked" << setw(15) << "Relinked" << setw(12) << "Tweaks" << endl;
+
+	for (int i = 0; i < Levels.size(); i++)
+		format_counts(to_string(i).c_str(), Levels[i], stream);
+	format_counts("Total", totals(), stream);
+
+	stream.flags(flags);
+	stream.precision(precision);
+}
+///////////////////////////////////////////////////////////////////////////////
+void SearchProfile::formatCsv(std::ostream& stream) const
+{
+	stream << "level,entries,solutions,choices,dead_ends,branches,average_branching,cells_unlinked,cells_relinked,tweaks" << endl;
+	for (int i = 0; i < Levels.size(); i++)
+	{
+		const LevelCounts& counts = Levels[i];
+		stream << i << "," << counts.Entries << "," << counts.Solutions << "," << counts.Choices << "," <<
+			counts.DeadEnds << "," << counts.Branches << "," << counts.averageBranchingFactor() << "," <<
+			counts.CellsUnlinked << "," << counts.CellsRelinked << "," << counts.Tweaks << endl;
+	}
+}
+///////////////////////////////////////////////////////////////////////////////
+bool SearchProfile::writeCsv(const char* pfile_name) const
+{
+	ofstream file(pfile_name);
+	if (!file)
+	{
+		cout << "Couldn't create profile file " << pfile_name << "." << endl;
+		return false;
+	}
+
+	formatCsv(file);
+	return (bool)file;
+}
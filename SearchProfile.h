@@ -0,0 +1,59 @@
+#pragma once
+
+// Counts of where the work of a search happens, by level. Both engines can fill one in
+// (see AlgMPointer::setProfile and exact_cover_with_multiplicities_and_colors). The
+// counting is compiled into a separate copy of the search loop, so searches without a
+// profile don't pay for it.
+//
+// The levels are numbered the same way in both engines, so their profiles can be
+// compared line by line.
+
+#include <vector>
+#include <iostream>
+
+///////////////////////////////////////////////////////////////////////////////
+struct LevelCounts
+{
+	long long Entries = 0;			// Times the level was entered.
+	long long Solutions = 0;		// Entries with nothing left to cover.
+	long long Choices = 0;			// Entries that chose an item to branch on.
+	long long DeadEnds = 0;			// Choices where the item's branching factor was <= 0.
+	long long Branches = 0;			// Sum of the branching factors of the other choices.
+	long long CellsUnlinked = 0;	// Cells removed from their item's list, including by tweaks.
+	long long CellsRelinked = 0;
+	long long Tweaks = 0;
+
+	double averageBranchingFactor() const
+	{
+		return Choices > DeadEnds ? (double)Branches / (Choices - DeadEnds) : 0;
+	}
+
+	void add(const LevelCounts& other);
+};
+///////////////////////////////////////////////////////////////////////////////
+class SearchProfile
+{
+	std::vector<LevelCounts> Levels;
+
+public:
+	// Searches add to the counts, so clear between searches to profile just one:
+	void clear() { Levels.clear(); }
+
+	LevelCounts& level(int idx_level)
+	{
+		if (idx_level >= (int)Levels.size())
+			Levels.resize(idx_level + 1);
+		return Levels[idx_level];
+	}
+
+	const std::vector<LevelCounts>& levels() const { return Levels; }
+	LevelCounts totals() const;
+
+	// A table with a line per level and the totals:
+	void format(std::ostream& stream = std::cout) const;
+	void print() const { format(); }
+
+	// The same table, with a header line, for a spreadsheet:
+	void formatCsv(std::ostream& stream) const;
+	bool writeCsv(const char* pfile_name) const;
+};
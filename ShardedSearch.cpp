@@ -0,0 +1,420 @@
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <cstdio>
+
+#include "Common.h"
+#include "AlgMPointer.h"
+#include "ShardedSearch.h"
+
+using namespace std;
+///////////////////////////////////////////////////////////////////////////////
+// FNV-1a, which is plenty to catch a worker using the wrong problem:
+static void hash_bytes(unsigned long long* phash, const void* p, size_t n)
+{
+	const unsigned char* pc = (const unsigned char*)p;
+	for (size_t i = 0; i < n; i++)
+	{
+		*phash ^= pc[i];
+		*phash *= 1099511628211ull;
+	}
+}
+
+static void hash_string(unsigned long long* phash, const char* pc)
+{
+	hash_bytes(phash, pc, strlen(pc) + 1);	// Include the terminator so "ab","c" != "a","bc"
+}
+
+unsigned long long problem_hash(const ExactCoverWithMultiplicitiesAndColors& problem)
+{
+	unsigned long long hash = 14695981039346656037ull;
+
+	for (auto& opt : problem.primary_options)
+	{
+		hash_string(&hash, opt.pValue);
+		hash_bytes(&hash, &opt.u, sizeof(opt.u));
+		hash_bytes(&hash, &opt.v, sizeof(opt.v));
+	}
+	for (auto pc : problem.secondary_options)
+		hash_string(&hash, pc);
+	for (auto pc : problem.colors)
+		hash_string(&hash, pc);
+	for (int i = 0; i < problem.sequences.size(); i++)
+	{
+		for (auto pc : problem.sequences[i])
+			hash_string(&hash, pc);
+
+		int cost = problem.sequenceCost(i);
+		hash_bytes(&hash, &cost, sizeof(cost));
+	}
+	return hash;
+}
+
+// Hashes each cell as it would be written, e.g. "30:p", so a streamed problem hashes the
+// same as one with its cells:
+struct CellHasher : CellSink
+{
+	const CompactExactCover& Problem;
+	unsigned long long* pHash;
+	int Sequence = 0;
+
+	CellHasher(const CompactExactCover& problem, unsigned long long* phash) : Problem(problem), pHash(phash) {}
+
+	void addCell(int item, int color) override
+	{
+		if (color)
+		{
+			const char* pname = Problem.ItemNames[item];
+			hash_bytes(pHash, pname, strlen(pname));
+			hash_bytes(pHash, ":", 1);
+			hash_string(pHash, Problem.ColorNames[color - 1]);
+		}
+		else
+		{
+			hash_string(pHash, Problem.ItemNames[item]);
+		}
+	}
+
+	void endSequence() override
+	{
+		int cost = Problem.sequenceCost(Sequence++);
+		hash_bytes(pHash, &cost, sizeof(cost));
+	}
+};
+
+unsigned long long problem_hash(const CompactExactCover& problem)
+{
+	unsigned long long hash = 14695981039346656037ull;
+
+	for (int i = 0; i < problem.PrimaryItems; i++)
+	{
+		hash_string(&hash, problem.ItemNames[i]);
+		hash_bytes(&hash, &problem.Min[i], sizeof(problem.Min[i]));
+		hash_bytes(&hash, &problem.Max[i], sizeof(problem.Max[i]));
+	}
+	for (int i = problem.PrimaryItems; i < problem.items(); i++)
+		hash_string(&hash, problem.ItemNames[i]);
+	for (auto pc : problem.ColorNames)
+		hash_string(&hash, pc);
+
+	CellHasher hasher(problem, &hash);
+	problem.emitCells(hasher);
+	return hash;
+}
+///////////////////////////////////////////////////////////////////////////////
+std::string manifest_file_name(const char* pbase_name)
+{
+	return string(pbase_name) + ".manifest";
+}
+
+std::string shard_file_name(const char* pbase_name, int idx_shard)
+{
+	return string(pbase_name) + ".shard" + to_string(idx_shard);
+}
+///////////////////////////////////////////////////////////////////////////////
+// Other processes may be watching for our files, so write to a temporary file
+// and rename it when it is complete:
+static bool commit_file(const string& temp_name, const char* pfile_name)
+{
+	remove(pfile_name);
+	if (rename(temp_name.c_str(), pfile_name) != 0)
+	{
+		cout << "Could not rename " << temp_name << " to " << pfile_name << endl;
+		return false;
+	}
+	return true;
+}
+
+static void write_indices(ostream& stream, const vector<int>& indices)
+{
+	stream << indices.size();
+	for (auto i : indices)
+		stream << " " << i;
+	stream << "\n";
+}
+
+static bool read_indices(istream& stream, vector<int>* pindices)
+{
+	size_t n;
+	if (!(stream >> n))
+		return false;
+
+	pindices->resize(n);
+	for (size_t i = 0; i < n; i++)
+	{
+		if (!(stream >> (*pindices)[i]))
+			return false;
+	}
+	return true;
+}
+
+static bool expect(istream& stream, const char* pword)
+{
+	string word;
+	stream >> word;
+	return word == pword;
+}
+///////////////////////////////////////////////////////////////////////////////
+//
+// ShardManifest
+//
+///////////////////////////////////////////////////////////////////////////////
+bool ShardManifest::write(const char* pfile_name) const
+{
+	string temp_name = string(pfile_name) + ".tmp";
+	{
+		ofstream outfile(temp_name);
+		if (!outfile.is_open())
+		{
+			cout << "Could not create " << temp_name << endl;
+			return false;
+		}
+
+		outfile << "ShardManifest 2\n";
+		outfile << "problem " << ProblemHash << "\n";
+		outfile << "depth " << Depth << "\n";
+		outfile << "max_results " << MaxResults << "\n";
+		outfile << "options " << NonSharpPreference << " " << MinimizeCost << "\n";
+		outfile << "shards " << Prefixes.size() << "\n";
+		for (auto& prefix : Prefixes)
+			write_indices(outfile, prefix);
+
+		if (!outfile.good())
+			return false;
+	}
+	return commit_file(temp_name, pfile_name);
+}
+///////////////////////////////////////////////////////////////////////////////
+bool ShardManifest::read(const char* pfile_name)
+{
+	ifstream infile(pfile_name);
+	if (!infile.is_open())
+	{
+		cout << "Could not open shard manifest " << pfile_name << endl;
+		return false;
+	}
+
+	int version;
+	size_t nshards;
+	bool ok = expect(infile, "ShardManifest") && (infile >> version) && version == 2 &&
+		expect(infile, "problem") && (infile >> ProblemHash) &&
+		expect(infile, "depth") && (infile >> Depth) &&
+		expect(infile, "max_results") && (infile >> MaxResults) &&
+		expect(infile, "options") && (infile >> NonSharpPreference >> MinimizeCost) &&
+		expect(infile, "shards") && (infile >> nshards);
+
+	if (ok)
+	{
+		Prefixes.resize(nshards);
+		for (size_t i = 0; ok && i < nshards; i++)
+		{
+			ok = read_indices(infile, &Prefixes[i]);
+		}
+	}
+
+	if (!ok)
+		cout << "Shard manifest " << pfile_name << " is not valid." << endl;
+	return ok;
+}
+///////////////////////////////////////////////////////////////////////////////
+//
+// ShardResults
+//
+///////////////////////////////////////////////////////////////////////////////
+bool ShardResults::write(const char* pfile_name) const
+{
+	string temp_name = string(pfile_name) + ".tmp";
+	{
+		ofstream outfile(temp_name);
+		if (!outfile.is_open())
+		{
+			cout << "Could not create " << temp_name << endl;
+			return false;
+		}
+
+		outfile << "ShardResults 1\n";
+		outfile << "loops " << LoopCount << "\n";
+		outfile << "levels " << LevelCount << "\n";
+		outfile << "runtime " << RunTime << "\n";
+		outfile << "solutions " << Results.size() << " " << (Costs.empty() ? 0 : 1) << "\n";
+		for (int i = 0; i < Results.size(); i++)
+		{
+			if (!Costs.empty())
+				outfile << Costs[i] << " ";
+			write_indices(outfile, Results[i]);
+		}
+
+		if (!outfile.good())
+			return false;
+	}
+	return commit_file(temp_name, pfile_name);
+}
+///////////////////////////////////////////////////////////////////////////////
+bool ShardResults::read(const char* pfile_name)
+{
+	ifstream infile(pfile_name);
+	if (!infile.is_open())
+	{
+		cout << "Could not open shard results " << pfile_name << endl;
+		return false;
+	}
+
+	int version, has_costs;
+	size_t nresults;
+	bool ok = expect(infile, "ShardResults") && (infile >> version) && version == 1 &&
+		expect(infile, "loops") && (infile >> LoopCount) &&
+		expect(infile, "levels") && (infile >> LevelCount) &&
+		expect(infile, "runtime") && (infile >> RunTime) &&
+		expect(infile, "solutions") && (infile >> nresults >> has_costs);
+
+	if (ok)
+	{
+		Results.resize(nresults);
+		Costs.resize(has_costs ? nresults : 0);
+		for (size_t i = 0; ok && i < nresults; i++)
+		{
+			if (has_costs)
+				ok = (bool)(infile >> Costs[i]);
+			ok = ok && read_indices(infile, &Results[i]);
+		}
+	}
+
+	if (!ok)
+		cout << "Shard results " << pfile_name << " are not valid." << endl;
+	return ok;
+}
+///////////////////////////////////////////////////////////////////////////////
+bool write_shard_manifest(AlgMPointer& alg, const ExactCoverWithMultiplicitiesAndColors& problem,
+	int depth, int max_results, const char* pbase_name)
+{
+	ShardManifest manifest;
+	manifest.ProblemHash = problem_hash(problem);
+	manifest.Depth = depth;
+	manifest.MaxResults = max_results;
+	manifest.NonSharpPreference = alg.heuristic();
+	manifest.MinimizeCost = alg.minimizeCost();
+
+	alg.enumeratePrefixes(depth, &manifest.Prefixes);
+
+	string file_name = manifest_file_name(pbase_name);
+	if (!manifest.write(file_name.c_str()))
+		return false;
+
+	cout << "Wrote " << manifest.Prefixes.size() << " shards of depth " << depth << " to " << file_name << "." << endl;
+	return true;
+}
+///////////////////////////////////////////////////////////////////////////////
+bool solve_shards(AlgMPointer& alg, const ExactCoverWithMultiplicitiesAndColors& problem,
+	int worker, int worker_count, const char* pbase_name)
+{
+	assert(worker >= 0 && worker < worker_count);
+
+	ShardManifest manifest;
+	if (!manifest.read(manifest_file_name(pbase_name).c_str()))
+		return false;
+
+	if (manifest.ProblemHash != problem_hash(problem))
+	{
+		cout << "The shard manifest was made for a different problem." << endl;
+		return false;
+	}
+	if (manifest.NonSharpPreference != alg.heuristic() || manifest.MinimizeCost != alg.minimizeCost())
+	{
+		cout << "The shard manifest was made with" << (manifest.NonSharpPreference ? "" : "out") << " nonsharp and with" <<
+			(manifest.MinimizeCost ? "" : "out") << " mincost, which the workers need too." << endl;
+		return false;
+	}
+
+	int solved = 0;
+	for (int idx_shard = worker; idx_shard < manifest.Prefixes.size(); idx_shard += worker_count)
+	{
+		ShardResults shard;
+		alg.exactCoverFromPrefix(manifest.Prefixes[idx_shard], &shard.Results, manifest.MaxResults);
+		if (alg.PrefixMismatch)
+		{
+			cout << "Shard " << idx_shard << " doesn't fit the problem, so the manifest is damaged." << endl;
+			return false;
+		}
+
+		shard.Costs = alg.SolutionCosts;
+		shard.LoopCount = alg.loopCount;
+		shard.LevelCount = alg.levelCount;
+		shard.RunTime = alg.runTime;
+
+		if (!shard.write(shard_file_name(pbase_name, idx_shard).c_str()))
+			return false;
+		solved++;
+	}
+
+	cout << "Worker " << worker << " of " << worker_count << " solved " << solved << " shards." << endl;
+	return true;
+}
+///////////////////////////////////////////////////////////////////////////////
+bool merge_shards(const ExactCoverWithMultiplicitiesAndColors& problem, const char* pbase_name,
+	std::vector<std::vector<int>>* presults, std::vector<long long>* pcosts, std::ostream& stream)
+{
+	assert(presults->size() == 0);
+	pcosts->clear();
+
+	ShardManifest manifest;
+	if (!manifest.read(manifest_file_name(pbase_name).c_str()))
+		return false;
+
+	if (manifest.ProblemHash != problem_hash(problem))
+	{
+		stream << "The shard manifest was made for a different problem." << endl;
+		return false;
+	}
+
+	vector<long long> costs;
+	long long loop_count = 0, level_count = 0;
+	long long total_time = 0;
+	long max_time = 0;
+
+	for (int idx_shard = 0; idx_shard < manifest.Prefixes.size(); idx_shard++)
+	{
+		ShardResults shard;
+		if (!shard.read(shard_file_name(pbase_name, idx_shard).c_str()))
+			return false;
+
+		presults->insert(presults->end(), shard.Results.begin(), shard.Results.end());
+		costs.insert(costs.end(), shard.Costs.begin(), shard.Costs.end());
+
+		loop_count += shard.LoopCount;
+		level_count += shard.LevelCount;
+		total_time += shard.RunTime;
+		max_time = max(max_time, shard.RunTime);
+	}
+
+	if (!costs.empty())
+	{
+		// Each shard kept its own cheapest solutions. Keep the cheapest overall, with
+		// ties in search order, just as a single minimum cost search would:
+		assert(costs.size() == presults->size());
+		vector<int> order(costs.size());
+		for (int i = 0; i < order.size(); i++)
+			order[i] = i;
+		stable_sort(order.begin(), order.end(), [&](int a, int b) { return costs[a] < costs[b]; });
+
+		vector<vector<int>> sorted;
+		for (auto i : order)
+		{
+			sorted.emplace_back((*presults)[i]);
+			pcosts->push_back(costs[i]);
+		}
+		presults->swap(sorted);
+	}
+
+	if (presults->size() > manifest.MaxResults)
+	{
+		presults->resize(manifest.MaxResults);
+		if (!pcosts->empty())
+			pcosts->resize(manifest.MaxResults);
+	}
+
+	stream << "Merged " << manifest.Prefixes.size() << " shards with " << presults->size() << " solutions." << endl;
+	stream << "\tTime used (microseconds): " << total_time << " over all shards, " << max_time << " for the slowest." << endl;
+	stream << "\tLoop ran " << loop_count << " times with " << level_count << " level transitions." << endl;
+	return true;
+}
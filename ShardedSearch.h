@@ -0,0 +1,70 @@
+#pragma once
+
+// Support for splitting one search across several processes, possibly on
+// different machines that share a file system.
+//
+// 1) One process enumerates the choice prefixes down to some depth and writes
+//    them to a manifest.
+// 2) Any number of worker processes read the manifest and search the shards
+//    assigned to them. Shard k goes to worker k % worker_count. Each shard's
+//    results go to their own file.
+// 3) A merge step reads the shard files in manifest order and combines them.
+//
+// Since the prefixes are in the order AlgMPointer visits them, the merged
+// solutions are the same, in the same order, as a single process run.
+
+#include <vector>
+#include <string>
+#include <iostream>
+
+struct ExactCoverWithMultiplicitiesAndColors;
+struct CompactExactCover;
+class AlgMPointer;
+
+///////////////////////////////////////////////////////////////////////////////
+struct ShardManifest
+{
+	// Used to make sure workers are solving the same problem as the manifest:
+	unsigned long long ProblemHash;
+	int Depth;
+	int MaxResults;
+	// The options that shape the search tree, which the prefixes depend on:
+	bool NonSharpPreference;
+	bool MinimizeCost;
+	std::vector<std::vector<int>> Prefixes;
+
+	bool write(const char* pfile_name) const;
+	bool read(const char* pfile_name);
+};
+///////////////////////////////////////////////////////////////////////////////
+struct ShardResults
+{
+	std::vector<std::vector<int>> Results;
+	std::vector<long long> Costs;	// Only if the search minimized cost.
+	long long LoopCount;
+	long long LevelCount;
+	long RunTime;
+
+	bool write(const char* pfile_name) const;
+	bool read(const char* pfile_name);
+};
+///////////////////////////////////////////////////////////////////////////////
+unsigned long long problem_hash(const ExactCoverWithMultiplicitiesAndColors& problem);
+// The same hash as the problem with names it was numbered from:
+unsigned long long problem_hash(const CompactExactCover& problem);
+
+// File names are all derived from a base name, e.g. "partridge.manifest" and
+// "partridge.shard12".
+std::string manifest_file_name(const char* pbase_name);
+std::string shard_file_name(const char* pbase_name, int idx_shard);
+
+// Step 1:
+bool write_shard_manifest(AlgMPointer& alg, const ExactCoverWithMultiplicitiesAndColors& problem,
+						int depth, int max_results, const char* pbase_name);
+// Step 2. The engine has to have the options the manifest was written with:
+bool solve_shards(AlgMPointer& alg, const ExactCoverWithMultiplicitiesAndColors& problem,
+						int worker, int worker_count, const char* pbase_name);
+// Step 3. The costs are only filled in if the search minimized cost:
+bool merge_shards(const ExactCoverWithMultiplicitiesAndColors& problem, const char* pbase_name,
+						std::vector<std::vector<int>>* presults, std::vector<long long>* pcosts,
+						std::ostream& stream = std::cout);
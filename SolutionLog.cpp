@@ -0,0 +1,219 @@
+
+#include <cstring>
+#include <cassert>
+#include <iostream>
+
+#include "SolutionLog.h"
+
+using namespace std;
+
+static const char SolutionLogMagic[8] = { 'D', 'L', 'X', 'S', 'O', 'L', 'N', 'S' };
+static const int32_t SolutionLogVersion = 1;
+
+///////////////////////////////////////////////////////////////////////////////
+void SolutionLogWriter::putVarint(uint32_t value)
+{
+	while (value >= 0x80)
+	{
+		Buffer.push_back((char)(value | 0x80));
+		value >>= 7;
+	}
+	Buffer.push_back((char)value);
+}
+///////////////////////////////////////////////////////////////////////////////
+bool SolutionLogWriter::flush()
+{
+	File.write(Buffer.data(), Buffer.size());
+	Bytes += Buffer.size();
+	Buffer.clear();
+
+	if (!File)
+	{
+		cout << "Couldn't write solution log " << FileName << "." << endl;
+		return false;
+	}
+	return true;
+}
+///////////////////////////////////////////////////////////////////////////////
+bool SolutionLogWriter::open(const char* pfile_name, unsigned long long problem_hash, int sequences)
+{
+	close();
+
+	FileName = pfile_name;
+	File.open(pfile_name, ios::binary);
+	if (!File)
+	{
+		cout << "Couldn't create solution log " << pfile_name << "." << endl;
+		return false;
+	}
+
+	Buffer.clear();
+	Buffer.reserve(BufferSize + 1024);
+	Previous.clear();
+	Solutions = Bytes = 0;
+
+	int32_t n = sequences;
+	uint64_t hash = problem_hash;
+	Buffer.append(SolutionLogMagic, sizeof(SolutionLogMagic));
+	Buffer.append((const char*)&SolutionLogVersion, sizeof(SolutionLogVersion));
+	Buffer.append((const char*)&n, sizeof(n));
+	Buffer.append((const char*)&hash, sizeof(hash));
+	return true;
+}
+///////////////////////////////////////////////////////////////////////////////
+bool SolutionLogWriter::add(const std::vector<int>& solution)
+{
+	assert(File.is_open());
+
+	size_t shared = 0;
+	while (shared < solution.size() && shared < Previous.size() && solution[shared] == Previous[shared])
+		shared++;
+
+	putVarint((uint32_t)shared);
+	putVarint((uint32_t)(solution.size() - shared));
+	for (size_t i = shared; i < solution.size(); i++)
+	{
+		assert(solution[i] >= 0);
+		putVarint((uint32_t)solution[i]);
+	}
+
+	Previous = solution;
+	Solutions++;
+	return Buffer.size() < BufferSize || flush();
+}
+///////////////////////////////////////////////////////////////////////////////
+bool SolutionLogWriter::close()
+{
+	if (!File.is_open())
+		return true;
+
+	bool b = flush();
+	File.close();
+	return b;
+}
+///////////////////////////////////////////////////////////////////////////////
+bool SolutionLogReader::fail(const char* pwhy)
+{
+	Error = "Solution log " + FileName + " " + pwhy;
+	return false;
+}
+///////////////////////////////////////////////////////////////////////////////
+bool SolutionLogReader::fill()
+{
+	// Only called when the buffer has been used up:
+	assert(Pos == End);
+	File.read(Buffer.data(), Buffer.size());
+	Pos = 0;
+	End = (size_t)File.gcount();
+	return End > 0;
+}
+///////////////////////////////////////////////////////////////////////////////
+bool SolutionLogReader::getVarint(int* pvalue)
+{
+	uint32_t value = 0;
+	for (int shift = 0; shift < 32; shift += 7)
+	{
+		if (Pos == End && !fill())
+			return false;
+
+		uint8_t byte = (uint8_t)Buffer[Pos++];
+		if (shift == 28 && byte > 0x0f)
+			return false;
+		value |= (uint32_t)(byte & 0x7f) << shift;
+		if (!(byte & 0x80))
+		{
+			if (value > INT32_MAX)
+				return false;
+			*pvalue = (int)value;
+			return true;
+		}
+	}
+	return false;
+}
+///////////////////////////////////////////////////////////////////////////////
+bool SolutionLogReader::open(const char* pfile_name)
+{
+	FileName = pfile_name;
+	Error.clear();
+	Solution.clear();
+	Pos = End = 0;
+
+	File.close();
+	File.clear();
+	File.open(pfile_name, ios::binary);
+	if (!File)
+		return fail("can't be opened.");
+
+	char magic[sizeof(SolutionLogMagic)];
+	int32_t version = 0, sequences = 0;
+	uint64_t hash = 0;
+
+	File.read(magic, sizeof(magic));
+	File.read((char*)&version, sizeof(version));
+	File.read((char*)&sequences, sizeof(sequences));
+	File.read((char*)&hash, sizeof(hash));
+
+	if (!File || memcmp(magic, SolutionLogMagic, sizeof(magic)) != 0 || version != SolutionLogVersion || sequences < 0)
+		return fail("isn't one this version can read.");
+
+	ProblemHash = hash;
+	Sequences = sequences;
+	Buffer.resize(1 << 20);
+	return true;
+}
+///////////////////////////////////////////////////////////////////////////////
+bool SolutionLogReader::next(std::vector<int>* psolution)
+{
+	// The end of the file is only expected before a solution:
+	if (Pos == End && !fill())
+		return false;
+
+	int shared, added;
+	if (!getVarint(&shared) || !getVarint(&added))
+		return fail("is truncated or damaged.");
+
+	// A solution uses each sequence at most once:
+	if (shared > (int)Solution.size() || added > Sequences - shared)
+		return fail("is damaged.");
+
+	Solution.resize(shared + added);
+	for (int i = shared; i < shared + added; i++)
+	{
+		if (!getVarint(&Solution[i]))
+			return fail("is truncated or damaged.");
+		if (Solution[i] >= Sequences)
+			return fail("has a sequence the problem doesn't.");
+	}
+
+	*psolution = Solution;
+	return true;
+}
+///////////////////////////////////////////////////////////////////////////////
+bool read_solution_log(const char* pfile_name, unsigned long long problem_hash, int sequences,
+					std::vector<std::vector<int>>* presults)
+{
+	presults->clear();
+
+	SolutionLogReader reader;
+	if (!reader.open(pfile_name))
+	{
+		cout << reader.error() << endl;
+		return false;
+	}
+	if (reader.problemHash() != problem_hash || reader.sequences() != sequences)
+	{
+		cout << "Solution log " << pfile_name << " was written for a different problem." << endl;
+		return false;
+	}
+
+	vector<int> solution;
+	while (reader.next(&solution))
+		presults->push_back(solution);
+
+	if (!reader.error().empty())
+	{
+		cout << reader.error() << endl;
+		return false;
+	}
+	return true;
+}
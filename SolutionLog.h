@@ -0,0 +1,90 @@
+#pragma once
+
+// Binary log of a search's solutions, instead of printing each one. A depth first search
+// finds solutions that share their first sequences, so each solution is stored as how
+// many sequences it shares with the one before, then the ones that are new, as varints.
+// A partridge solution printed takes several KB; logged after the first, it's mostly a
+// few bytes for each sequence that changed.
+//
+// The log only holds sequence indices. read_solution_log turns it back into the results
+// a search returns, given the problem, which is regenerated from the same arguments, so
+// the solutions can be printed as usual, e.g. for PartridgePlotter.py. Costs aren't kept.
+//
+// File format, in native byte order: the magic "DLXSOLNS", int32 version, int32 sequences
+// in the problem, uint64 problem hash (see problem_hash), then for each solution, in
+// LEB128 varints: the sequences shared with the previous solution, the number of new
+// ones, and each new sequence index.
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <fstream>
+
+///////////////////////////////////////////////////////////////////////////////
+class SolutionLogWriter
+{
+	std::ofstream File;
+	std::string FileName;
+	std::string Buffer;		// Written when it passes BufferSize.
+	std::vector<int> Previous;
+	uint64_t Solutions = 0;
+	uint64_t Bytes = 0;
+
+	static const size_t BufferSize = 1 << 20;
+
+	void putVarint(uint32_t value);
+	bool flush();
+
+public:
+	SolutionLogWriter() {}
+	~SolutionLogWriter() { close(); }
+	SolutionLogWriter(const SolutionLogWriter&) = delete;
+	SolutionLogWriter& operator=(const SolutionLogWriter&) = delete;
+
+	// Prints why and returns false if it can't:
+	bool open(const char* pfile_name, unsigned long long problem_hash, int sequences);
+	bool add(const std::vector<int>& solution);
+	bool close();
+
+	uint64_t solutions() const { return Solutions; }
+	uint64_t bytes() const { return Bytes; }
+};
+///////////////////////////////////////////////////////////////////////////////
+class SolutionLogReader
+{
+	std::ifstream File;
+	std::vector<char> Buffer;
+	size_t Pos = 0;
+	size_t End = 0;
+	std::vector<int> Solution;		// The last one read, which the next one starts from.
+	unsigned long long ProblemHash = 0;
+	int Sequences = 0;
+	std::string FileName;
+	std::string Error;
+
+	bool fill();
+	// Returns false at the end of the file, or if the varint doesn't fit in an int:
+	bool getVarint(int* pvalue);
+	bool fail(const char* pwhy);
+
+public:
+	SolutionLogReader() {}
+	SolutionLogReader(const SolutionLogReader&) = delete;
+	SolutionLogReader& operator=(const SolutionLogReader&) = delete;
+
+	// Returns false with the reason in error():
+	bool open(const char* pfile_name);
+
+	// The next solution. Returns false at the end of the log, or if it's damaged, which
+	// leaves the reason in error():
+	bool next(std::vector<int>* psolution);
+
+	unsigned long long problemHash() const { return ProblemHash; }
+	int sequences() const { return Sequences; }
+	const std::string& error() const { return Error; }
+};
+///////////////////////////////////////////////////////////////////////////////
+// Reads every solution in the log, checking that it was written for a problem with the hash
+// and number of sequences. Prints why and returns false if it can't:
+bool read_solution_log(const char* pfile_name, unsigned long long problem_hash, int sequences,
+					std::vector<std::vector<int>>* presults);
@@ -0,0 +1,463 @@
+
+#include <cstring>
+#include <functional>
+#include <mutex>
+
+#include "Common.h"
+#include "Solver.h"
+#include "AlgMPointer.h"
+#include "MStringValues.h"
+#include "Locality.h"
+#include "ValueOrder.h"
+
+using namespace std;
+///////////////////////////////////////////////////////////////////////////////
+long long Solver::count(const ExactCoverWithMultiplicitiesAndColors& problem, int max_count)
+{
+	vector<vector<int>> results;
+	solve(problem, &results, max_count);
+	return results.size();
+}
+///////////////////////////////////////////////////////////////////////////////
+const std::vector<long long>& Solver::solutionCosts() const
+{
+	static const vector<long long> none;
+	return none;
+}
+///////////////////////////////////////////////////////////////////////////////
+// The copies of the problem an engine searches instead, when the options ask for them:
+struct ProblemOrders
+{
+	LocalityOrder Locality;
+	ValueOrder Values;
+};
+///////////////////////////////////////////////////////////////////////////////
+// Runs the search on the problem, or on a renumbered and sorted copy as the options ask,
+// with the forced sequences and the solutions mapped between them. A trace records the
+// indices the engine sees, so it gets the problem as it is:
+static bool search_reordered(const SolverOptions& options, ProblemOrders& orders,
+	const ExactCoverWithMultiplicitiesAndColors& problem, std::vector<std::vector<int>>* presults,
+	const std::vector<int>* pforced,
+	const function<bool(const ExactCoverWithMultiplicitiesAndColors&, const std::vector<int>*)>& search)
+{
+	if (options.pTrace)
+		return search(problem, pforced);
+
+	const ExactCoverWithMultiplicitiesAndColors* pproblem = &problem;
+	vector<int> forced;
+	if (pforced)
+		forced = *pforced;
+
+	if (options.Locality)
+	{
+		pproblem = &orders.Locality.reorder(*pproblem);
+		orders.Locality.toReordered(&forced);
+	}
+	if (options.Ordering != vo_Input)
+	{
+		pproblem = &orders.Values.reorder(*pproblem, options.Ordering, options.OrderingSeed);
+		orders.Values.toReordered(&forced);
+	}
+
+	bool b = search(*pproblem, pforced ? &forced : nullptr);
+
+	if (options.Ordering != vo_Input)
+		orders.Values.toOriginal(presults);
+	if (options.Locality)
+		orders.Locality.toOriginal(presults);
+	return b;
+}
+///////////////////////////////////////////////////////////////////////////////
+static void show_reorder_stats(const SolverOptions& options, const ProblemOrders& orders, std::ostream& stream)
+{
+	if (options.pTrace)
+		return;
+	if (options.Locality)
+		stream << "\tRenumbered for locality in " << orders.Locality.renumberTime() << " microseconds." << endl;
+	if (options.Ordering != vo_Input)
+		stream << "\tSorted the sequences by the " << value_order_name(options.Ordering) << " policy in " <<
+			orders.Values.orderTime() << " microseconds." << endl;
+}
+///////////////////////////////////////////////////////////////////////////////
+//
+// pointer
+//
+///////////////////////////////////////////////////////////////////////////////
+class PointerSolver : public Solver
+{
+	// Reset for each problem, so its buffers are reused:
+	AlgMPointer Alg;
+	ProblemOrders Orders;
+	bool DefaultRestoreCheck;	// Alg's own, which is on in a debug build.
+
+public:
+	PointerSolver()
+	{
+		DefaultRestoreCheck = Alg.restoreCheck();
+		setOptions(Options);
+	}
+
+	const char* name() const override { return "pointer"; }
+
+	void setOptions(const SolverOptions& options) override
+	{
+		Solver::setOptions(options);
+
+		Alg.setHeuristic(options.NonSharpPreference);
+		Alg.setMinimizeCost(options.MinimizeCost);
+		Alg.setRestoreCheck(options.RestoreCheck || DefaultRestoreCheck);
+		Alg.setVerbose(options.Verbose);
+		Alg.setCancellation(options.pCancel);
+		Alg.setProfile(options.pProfile);
+		Alg.setPerfCounters(options.pPerf);
+		Alg.setTrace(options.pTrace);
+		Alg.setHugePages(options.HugePages);
+		Alg.setFirstTouch(options.FirstTouch);
+	}
+
+	bool canMinimizeCost() const override { return true; }
+	bool canTrace() const override { return true; }
+
+	bool solve(const ExactCoverWithMultiplicitiesAndColors& problem, std::vector<std::vector<int>>* presults,
+				int max_results, const std::vector<int>* pforced) override
+	{
+		presults->clear();
+		return search_reordered(Options, Orders, problem, presults, pforced,
+			[this, presults, max_results](const ExactCoverWithMultiplicitiesAndColors& problem,
+											const std::vector<int>* pforced)
+			{
+				// Alg keeps a pointer to the problem, which Orders keeps until the next search:
+				Alg.reset(problem);
+				if (pforced && !Alg.forceSequences(*pforced))
+					return false;
+				return Alg.exactCover(presults, max_results);
+			});
+	}
+
+	bool solve(const CompactExactCover& problem, std::vector<std::vector<int>>* presults,
+				int max_results, const std::vector<int>* pforced) override
+	{
+		presults->clear();
+		Alg.reset(problem);
+		if (pforced && !Alg.forceSequences(*pforced))
+			return false;
+		return Alg.exactCover(presults, max_results);
+	}
+
+	SolverStats stats() const override
+	{
+		SolverStats stats;
+		stats.SetupTime = Alg.setupTime;
+		stats.RunTime = Alg.runTime;
+		stats.LoopCount = Alg.loopCount;
+		stats.LevelCount = Alg.levelCount;
+		stats.Cancelled = Alg.Cancelled;
+		return stats;
+	}
+
+	const std::vector<long long>& solutionCosts() const override { return Alg.SolutionCosts; }
+
+	void showStats(std::ostream& stream) const override
+	{
+		Alg.showStats(stream);
+		show_reorder_stats(Options, Orders, stream);
+	}
+};
+///////////////////////////////////////////////////////////////////////////////
+//
+// basic
+//
+///////////////////////////////////////////////////////////////////////////////
+class BasicSolver : public Solver
+{
+	SolverStats Stats;
+	ProblemOrders Orders;
+
+public:
+	const char* name() const override { return "basic"; }
+
+	bool solve(const ExactCoverWithMultiplicitiesAndColors& problem, std::vector<std::vector<int>>* presults,
+				int max_results, const std::vector<int>* pforced) override
+	{
+		presults->clear();
+
+		// The engine keeps its state in globals:
+		lock_guard<mutex> lock(exact_cover_with_multiplicities_and_colors_mutex());
+
+		set_exact_cover_with_multiplicities_and_colors_perf_counters(Options.pPerf);
+		set_exact_cover_with_multiplicities_and_colors_huge_pages(Options.HugePages, Options.FirstTouch);
+		bool b = search_reordered(Options, Orders, problem, presults, pforced,
+			[this, presults, max_results](const ExactCoverWithMultiplicitiesAndColors& problem,
+											const std::vector<int>* pforced)
+			{
+				return exact_cover_with_multiplicities_and_colors(problem, presults, max_results,
+					Options.NonSharpPreference, pforced, Options.pCancel, Options.pProfile);
+			});
+
+		get_exact_cover_with_multiplicities_and_colors_stats(&Stats.SetupTime, &Stats.RunTime, &Stats.LoopCount,
+			&Stats.LevelCount, &Stats.Cancelled);
+		return b;
+	}
+
+	bool solve(const CompactExactCover& problem, std::vector<std::vector<int>>* presults,
+				int max_results, const std::vector<int>* pforced) override
+	{
+		presults->clear();
+
+		lock_guard<mutex> lock(exact_cover_with_multiplicities_and_colors_mutex());
+
+		set_exact_cover_with_multiplicities_and_colors_perf_counters(Options.pPerf);
+		set_exact_cover_with_multiplicities_and_colors_huge_pages(Options.HugePages, Options.FirstTouch);
+		bool b = exact_cover_with_multiplicities_and_colors(problem, presults, max_results,
+			Options.NonSharpPreference, pforced, Options.pCancel, Options.pProfile);
+
+		get_exact_cover_with_multiplicities_and_colors_stats(&Stats.SetupTime, &Stats.RunTime, &Stats.LoopCount,
+			&Stats.LevelCount, &Stats.Cancelled);
+		return b;
+	}
+
+	SolverStats stats() const override { return Stats; }
+
+	// The engine only prints to cout, and only the last search's stats, whoever ran it:
+	void showStats(std::ostream& stream) const override
+	{
+		lock_guard<mutex> lock(exact_cover_with_multiplicities_and_colors_mutex());
+		print_exact_cover_with_multiplicities_and_colors_stats();
+		show_reorder_stats(Options, Orders, stream);
+	}
+};
+///////////////////////////////////////////////////////////////////////////////
+//
+// auto
+//
+///////////////////////////////////////////////////////////////////////////////
+class AutoSolver : public Solver
+{
+	// Created the first time they are chosen, and kept so their buffers are reused:
+	vector<unique_ptr<Solver>> Solvers;
+	Solver* pLast = nullptr;
+	ProblemStats Stats;		// Of the last problem,
+	string Reason;			// and why pLast was chosen for it.
+
+	template<class Problem>
+	Solver* solverFor(const Problem& problem)
+	{
+		Stats = ProblemStats::of(problem);
+		const char* pname = choose_solver(Stats, Options, &Reason);
+		for (auto& psolver : Solvers)
+		{
+			if (strcmp(psolver->name(), pname) == 0)
+				return psolver.get();
+		}
+
+		Solvers.push_back(create_solver(pname));
+		Solvers.back()->setOptions(Options);
+		return Solvers.back().get();
+	}
+
+public:
+	const char* name() const override { return "auto"; }
+
+	void setOptions(const SolverOptions& options) override
+	{
+		Solver::setOptions(options);
+		for (auto& psolver : Solvers)
+			psolver->setOptions(options);
+	}
+
+	// choose_solver picks an engine that can when the options ask for it:
+	bool canMinimizeCost() const override { return true; }
+	bool canTrace() const override { return true; }
+
+	bool solve(const ExactCoverWithMultiplicitiesAndColors& problem, std::vector<std::vector<int>>* presults,
+				int max_results, const std::vector<int>* pforced) override
+	{
+		pLast = solverFor(problem);
+		return pLast->solve(problem, presults, max_results, pforced);
+	}
+
+	bool solve(const CompactExactCover& problem, std::vector<std::vector<int>>* presults,
+				int max_results, const std::vector<int>* pforced) override
+	{
+		pLast = solverFor(problem);
+		return pLast->solve(problem, presults, max_results, pforced);
+	}
+
+	SolverStats stats() const override { return pLast ? pLast->stats() : SolverStats(); }
+
+	const std::vector<long long>& solutionCosts() const override
+	{
+		return pLast ? pLast->solutionCosts() : Solver::solutionCosts();
+	}
+
+	void showStats(std::ostream& stream) const override
+	{
+		if (!pLast)
+			return;
+		stream << "Auto chose the " << pLast->name() << " version, since " << Reason << ", for ";
+		Stats.format(stream);
+		pLast->showStats(stream);
+	}
+};
+///////////////////////////////////////////////////////////////////////////////
+//
+// Choosing
+//
+///////////////////////////////////////////////////////////////////////////////
+ProblemStats ProblemStats::of(const ExactCoverWithMultiplicitiesAndColors& problem)
+{
+	ProblemStats stats;
+	stats.PrimaryItems = (int)problem.primary_options.size();
+	stats.SecondaryItems = (int)problem.secondary_options.size();
+	stats.Colors = (int)problem.colors.size();
+	stats.Sequences = (int)problem.sequences.size();
+	stats.Costs = !problem.costs.empty();
+
+	for (auto& option : problem.primary_options)
+	{
+		if (option.v > 1)
+			stats.Multiplicities = true;
+	}
+
+	for (auto& seq : problem.sequences)
+	{
+		stats.Cells += seq.size();
+
+		// Every use of a secondary item has a color:
+		if (!stats.Colored)
+		{
+			for (auto pc : seq)
+			{
+				if (strchr(pc, ':'))
+				{
+					stats.Colored = true;
+					break;
+				}
+			}
+		}
+	}
+	return stats;
+}
+///////////////////////////////////////////////////////////////////////////////
+// Whether any cell has a color, from the cells held or streamed:
+struct ColorFinder : CellSink
+{
+	bool Colored = false;
+
+	void addCell(int, int color) override { Colored |= color != 0; }
+	void endSequence() override {}
+};
+
+ProblemStats ProblemStats::of(const CompactExactCover& problem)
+{
+	ProblemStats stats;
+	stats.PrimaryItems = problem.PrimaryItems;
+	stats.SecondaryItems = problem.secondaryItems();
+	stats.Colors = (int)problem.ColorNames.size();
+	stats.Sequences = problem.sequences();
+	stats.Cells = problem.cells();
+	stats.Costs = !problem.Costs.empty();
+
+	for (int v : problem.Max)
+	{
+		if (v > 1)
+			stats.Multiplicities = true;
+	}
+
+	ColorFinder finder;
+	problem.emitCells(finder);
+	stats.Colored = finder.Colored;
+	return stats;
+}
+///////////////////////////////////////////////////////////////////////////////
+void ProblemStats::format(std::ostream& stream) const
+{
+	stream << PrimaryItems << " primary and " << SecondaryItems << " secondary items, " << Colors << " colors, " <<
+		Sequences << " sequences with " << Cells << " cells (" << cellsPerSequence() << " per sequence, density " <<
+		density() << ")." << endl;
+	if (Multiplicities)
+		stream << "\tSome items can be used more than once." << endl;
+	if (Costs)
+		stream << "\tThe sequences have costs." << endl;
+}
+///////////////////////////////////////////////////////////////////////////////
+// The rules come from "benchmark" and from random problems of 10 to 120 items, in a
+// release build. The basic version was faster on nearly all of them, including the
+// setup, so the pointer version is only chosen for what only it can do. An engine that
+// wins somewhere gets a rule here.
+const char* choose_solver(const ProblemStats& stats, const SolverOptions& options, std::string* preason)
+{
+	const char* pname = "basic";
+	const char* pwhy;
+
+	if (options.MinimizeCost && stats.Costs)
+	{
+		pname = "pointer";
+		pwhy = "only it can minimize cost";
+	}
+	else if (options.pTrace || options.RestoreCheck)
+	{
+		pname = "pointer";
+		pwhy = "only it can trace or check restores";
+	}
+	else if (stats.Cells > 100000)
+	{
+		pwhy = "its setup is about a third faster on big problems";
+	}
+	else if (stats.Multiplicities)
+	{
+		pwhy = "it was 1.2 to 2 times faster with multiplicities";
+	}
+	else if (stats.Colored)
+	{
+		pwhy = "it was up to 40% faster with colors";
+	}
+	else
+	{
+		pwhy = "it was up to 30% faster on exact covers, and no more than a few percent slower";
+	}
+
+	if (preason)
+		*preason = pwhy;
+	return pname;
+}
+///////////////////////////////////////////////////////////////////////////////
+//
+// Registry
+//
+///////////////////////////////////////////////////////////////////////////////
+struct SolverEntry
+{
+	const char* pName;
+	function<unique_ptr<Solver>()> Create;
+};
+
+// New engines go here, before auto:
+static const vector<SolverEntry>& solver_entries()
+{
+	static const vector<SolverEntry> entries =
+	{
+		{ "pointer",	[]() { return unique_ptr<Solver>(new PointerSolver()); } },
+		{ "basic",		[]() { return unique_ptr<Solver>(new BasicSolver()); } },
+		{ "auto",		[]() { return unique_ptr<Solver>(new AutoSolver()); } },
+	};
+	return entries;
+}
+///////////////////////////////////////////////////////////////////////////////
+std::vector<std::string> solver_names()
+{
+	vector<string> names;
+	for (auto& entry : solver_entries())
+		names.push_back(entry.pName);
+	return names;
+}
+///////////////////////////////////////////////////////////////////////////////
+std::unique_ptr<Solver> create_solver(const std::string& name)
+{
+	for (auto& entry : solver_entries())
+	{
+		if (name == entry.pName)
+			return entry.Create();
+	}
+	return nullptr;
+}
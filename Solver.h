@@ -0,0 +1,143 @@
+#pragma once
+
+// A common interface to the engines, so code that solves problems doesn't need to know
+// which one it is using, and a registry to create them by name:
+//
+//	pointer		AlgMPointer.
+//	basic		The MStringValues engine, which follows Knuth.
+//	auto		Picks one of the others for each problem, from cheap statistics about the
+//				problem. See choose_solver.
+//
+// A new engine implements Solver and adds itself to the list in Solver.cpp.
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <atomic>
+#include <iostream>
+
+#include "ValueOrder.h"
+#include "PageArena.h"
+
+struct ExactCoverWithMultiplicitiesAndColors;
+struct CompactExactCover;
+class SearchProfile;
+class PerfCounters;
+class TraceBuffer;
+
+///////////////////////////////////////////////////////////////////////////////
+// Engines ignore the options they don't support:
+struct SolverOptions
+{
+	bool NonSharpPreference = false;
+	bool MinimizeCost = false;		// Keep the cheapest solutions instead of the first ones.
+	bool RestoreCheck = false;		// Check backtracking in a release build too.
+	bool Verbose = true;			// Print small problems before searching them.
+	// Renumber the problem for locality at setup, see Locality.h, and sort each item's
+	// sequences, see ValueOrder.h. Neither is done with a trace, whose records need the
+	// original numbers:
+	bool Locality = false;
+	ValueOrderPolicy Ordering = vo_Input;
+	unsigned OrderingSeed = 1;			// For vo_Random.
+
+	// Where the engine keeps its cells, see PageArena.h. With first touch, the memory is
+	// mapped fresh when each search sets up, on the thread that searches:
+	HugePageMode HugePages = hp_Off;
+	bool FirstTouch = false;
+
+	// Once *pCancel is set, the search backs out and returns the solutions found so far,
+	// with Cancelled set in the stats. See AsyncSolve.h.
+	const std::atomic<bool>* pCancel = nullptr;
+	SearchProfile* pProfile = nullptr;		// See SearchProfile.h.
+	PerfCounters* pPerf = nullptr;			// See PerfCounters.h.
+	TraceBuffer* pTrace = nullptr;			// See Trace.h.
+};
+///////////////////////////////////////////////////////////////////////////////
+// From the last search. Times are in microseconds:
+struct SolverStats
+{
+	long SetupTime = 0;
+	long RunTime = 0;
+	long long LoopCount = 0;
+	long long LevelCount = 0;
+	bool Cancelled = false;
+};
+///////////////////////////////////////////////////////////////////////////////
+class Solver
+{
+protected:
+	SolverOptions Options;
+
+public:
+	virtual ~Solver() {}
+
+	virtual const char* name() const = 0;
+
+	// Kept for every later search:
+	virtual void setOptions(const SolverOptions& options) { Options = options; }
+	const SolverOptions& options() const { return Options; }
+
+	// Whether the options that only some engines support are:
+	virtual bool canMinimizeCost() const { return false; }
+	virtual bool canTrace() const { return false; }
+
+	// Solves the problem, returning up to max_results solutions. If pforced is supplied,
+	// those sequences are part of every solution. Returns false if there are no solutions,
+	// including when the forced sequences conflict.
+	virtual bool solve(const ExactCoverWithMultiplicitiesAndColors& problem, std::vector<std::vector<int>>* presults,
+						int max_results, const std::vector<int>* pforced = nullptr) = 0;
+	// The same from the numbered form, e.g. mapped from a file (see ProblemFile.h). It is
+	// searched as it is, so the locality and ordering options don't apply:
+	virtual bool solve(const CompactExactCover& problem, std::vector<std::vector<int>>* presults,
+						int max_results, const std::vector<int>* pforced = nullptr) = 0;
+
+	// Counts the solutions, stopping at max_count. The engines still build each solution,
+	// so this only saves the caller keeping them.
+	virtual long long count(const ExactCoverWithMultiplicitiesAndColors& problem, int max_count);
+
+	virtual SolverStats stats() const = 0;
+
+	// When minimizing cost, the cost of each solution from the last search, cheapest first.
+	// Otherwise empty:
+	virtual const std::vector<long long>& solutionCosts() const;
+
+	virtual void showStats(std::ostream& stream = std::cout) const = 0;
+};
+///////////////////////////////////////////////////////////////////////////////
+// What auto looks at. All of it comes from one pass over the problem, which is much
+// cheaper than setting up either engine:
+struct ProblemStats
+{
+	int PrimaryItems = 0;
+	int SecondaryItems = 0;
+	int Colors = 0;
+	int Sequences = 0;
+	long long Cells = 0;
+
+	bool Multiplicities = false;	// Some primary item can be used more than once.
+	bool Colored = false;			// Some sequence gives a secondary item a color.
+	bool Costs = false;
+
+	double cellsPerSequence() const { return Sequences > 0 ? (double)Cells / Sequences : 0; }
+
+	// The fraction of the items an average sequence uses:
+	double density() const
+	{
+		int items = PrimaryItems + SecondaryItems;
+		return items > 0 ? cellsPerSequence() / items : 0;
+	}
+
+	static ProblemStats of(const ExactCoverWithMultiplicitiesAndColors& problem);
+	static ProblemStats of(const CompactExactCover& problem);
+	void format(std::ostream& stream = std::cout) const;
+};
+///////////////////////////////////////////////////////////////////////////////
+// The registry. Names are in the order listed in Solver.cpp, with auto last:
+std::vector<std::string> solver_names();
+
+// Returns null if there is no engine with the name:
+std::unique_ptr<Solver> create_solver(const std::string& name);
+
+// The engine auto uses for the problem, with the reason for the choice if preason is
+// supplied:
+const char* choose_solver(const ProblemStats& stats, const SolverOptions& options, std::string* preason = nullptr);
@@ -0,0 +1,807 @@
+
+#include <iostream>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <string>
+#include <cstdio>
+#include <cstring>
+
+#include "Common.h"
+#include "AlgMPointer.h"
+#include "SolverDaemon.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <winsock2.h>
+#include <afunix.h>
+#pragma comment(lib, "Ws2_32.lib")
+
+typedef SOCKET socket_t;
+static const int SendFlags = 0;
+static void close_socket(socket_t s) { closesocket(s); }
+#else
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+typedef int socket_t;
+static const socket_t INVALID_SOCKET = -1;
+#ifdef MSG_NOSIGNAL
+static const int SendFlags = MSG_NOSIGNAL;	// A client hanging up shouldn't kill the daemon.
+#else
+static const int SendFlags = 0;
+#endif
+static void close_socket(socket_t s) { close(s); }
+#endif
+
+using namespace std;
+///////////////////////////////////////////////////////////////////////////////
+//
+// Sockets
+//
+///////////////////////////////////////////////////////////////////////////////
+static bool init_sockets()
+{
+#ifdef _WIN32
+	static bool initialized = false;
+	if (!initialized)
+	{
+		WSADATA data;
+		if (WSAStartup(MAKEWORD(2, 2), &data) != 0)
+		{
+			cout << "Could not initialize Winsock." << endl;
+			return false;
+		}
+		initialized = true;
+	}
+#endif
+	return true;
+}
+
+static bool make_address(const char* psocket_path, sockaddr_un* paddr)
+{
+	memset(paddr, 0, sizeof(*paddr));
+	paddr->sun_family = AF_UNIX;
+	size_t len = strlen(psocket_path);
+	if (len >= sizeof(paddr->sun_path))
+	{
+		cout << "Socket path " << psocket_path << " is too long." << endl;
+		return false;
+	}
+	memcpy(paddr->sun_path, psocket_path, len + 1);
+	return true;
+}
+
+// Makes recv give up if nothing arrives for that long:
+static void set_receive_timeout(socket_t s, int milliseconds)
+{
+#ifdef _WIN32
+	DWORD timeout = milliseconds;
+#else
+	timeval timeout = { milliseconds / 1000, (milliseconds % 1000) * 1000 };
+#endif
+	setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+}
+
+static socket_t connect_to_daemon(const char* psocket_path)
+{
+	sockaddr_un addr;
+	if (!init_sockets() || !make_address(psocket_path, &addr))
+		return INVALID_SOCKET;
+
+	socket_t s = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (s == INVALID_SOCKET)
+		return INVALID_SOCKET;
+
+	if (connect(s, (sockaddr*)&addr, sizeof(addr)) != 0)
+	{
+		cout << "Could not connect to the solver daemon at " << psocket_path << "." << endl;
+		close_socket(s);
+		return INVALID_SOCKET;
+	}
+	return s;
+}
+
+static bool send_all(socket_t s, const char* pdata, size_t n)
+{
+	while (n > 0)
+	{
+		int sent = send(s, pdata, (int)min(n, (size_t)(1 << 30)), SendFlags);
+		if (sent <= 0)
+			return false;
+		pdata += sent;
+		n -= sent;
+	}
+	return true;
+}
+
+static bool recv_all(socket_t s, char* pdata, size_t n)
+{
+	while (n > 0)
+	{
+		int received = recv(s, pdata, (int)min(n, (size_t)(1 << 30)), 0);
+		if (received <= 0)
+			return false;
+		pdata += received;
+		n -= received;
+	}
+	return true;
+}
+
+static bool send_frame(socket_t s, DaemonMessages type, const vector<char>& payload)
+{
+	int32_t header[2] = { type, (int32_t)payload.size() };
+	return send_all(s, (const char*)header, sizeof(header)) &&
+		send_all(s, payload.data(), payload.size());
+}
+
+static bool recv_frame(socket_t s, int* ptype, vector<char>* ppayload)
+{
+	int32_t header[2];
+	if (!recv_all(s, (char*)header, sizeof(header)) || header[1] < 0)
+		return false;
+
+	*ptype = header[0];
+	ppayload->resize(header[1]);
+	return recv_all(s, ppayload->data(), ppayload->size());
+}
+
+static void send_error(socket_t s, const char* pmessage)
+{
+	vector<char> payload(pmessage, pmessage + strlen(pmessage) + 1);
+	send_frame(s, dm_Error, payload);
+}
+///////////////////////////////////////////////////////////////////////////////
+//
+// Wire format
+//
+///////////////////////////////////////////////////////////////////////////////
+class WireWriter
+{
+	vector<char>* pBuffer;
+public:
+	WireWriter(vector<char>* pbuffer) : pBuffer(pbuffer) { pBuffer->clear(); }
+
+	template<class T> void put(T value)
+	{
+		const char* pc = (const char*)&value;
+		pBuffer->insert(pBuffer->end(), pc, pc + sizeof(value));
+	}
+	void putString(const char* pc)
+	{
+		pBuffer->insert(pBuffer->end(), pc, pc + strlen(pc) + 1);
+	}
+};
+///////////////////////////////////////////////////////////////////////////////
+// Reads a payload, failing instead of reading past the end:
+class WireReader
+{
+	const char* pCur;
+	const char* pEnd;
+public:
+	WireReader(const vector<char>& payload) : pCur(payload.data()), pEnd(payload.data() + payload.size()) {}
+
+	template<class T> bool get(T* pvalue)
+	{
+		if (pEnd - pCur < (ptrdiff_t)sizeof(T))
+			return false;
+		memcpy(pvalue, pCur, sizeof(T));
+		pCur += sizeof(T);
+		return true;
+	}
+
+	// Checks a count read from the payload before anything is sized from it:
+	bool getCount(int32_t* pcount, size_t min_size_each)
+	{
+		return get(pcount) && *pcount >= 0 && (size_t)*pcount * min_size_each <= (size_t)(pEnd - pCur);
+	}
+
+	const char* getString()
+	{
+		const char* pc = pCur;
+		const char* pterminator = (const char*)memchr(pCur, 0, pEnd - pCur);
+		if (!pterminator)
+			return nullptr;
+		pCur = pterminator + 1;
+		return pc;
+	}
+
+	const char* position() const { return pCur; }
+	void seek(const char* pc) { pCur = pc; }
+};
+///////////////////////////////////////////////////////////////////////////////
+bool encode_problem(const ExactCoverWithMultiplicitiesAndColors& problem, int max_results, int flags,
+	std::vector<char>* ppayload)
+{
+	WireWriter out(ppayload);
+
+	out.put<int32_t>(max_results);
+	out.put<int32_t>(flags);
+
+	out.put<int32_t>((int32_t)problem.primary_options.size());
+	for (auto& opt : problem.primary_options)
+	{
+		out.put<int32_t>(opt.u);
+		out.put<int32_t>(opt.v);
+	}
+	out.put<int32_t>((int32_t)problem.secondary_options.size());
+	out.put<int32_t>((int32_t)problem.colors.size());
+	out.put<int32_t>((int32_t)problem.sequences.size());
+	out.put<int32_t>((int32_t)problem.costs.size());
+	for (auto cost : problem.costs)
+		out.put<int32_t>(cost);
+
+	int nprimary = (int)problem.primary_options.size();
+	map<const char*, int, CmpSame> items;
+	map<const char*, int, CmpSame> colors;
+	for (int i = 0; i < nprimary; i++)
+	{
+		items[problem.primary_options[i].pValue] = i;
+		out.putString(problem.primary_options[i].pValue);
+	}
+	for (int i = 0; i < (int)problem.secondary_options.size(); i++)
+	{
+		items[problem.secondary_options[i]] = nprimary + i;
+		out.putString(problem.secondary_options[i]);
+	}
+	for (int i = 0; i < (int)problem.colors.size(); i++)
+	{
+		colors[problem.colors[i]] = i;
+		out.putString(problem.colors[i]);
+	}
+
+	string name;
+	for (auto& seq : problem.sequences)
+	{
+		out.put<int32_t>((int32_t)seq.size());
+		for (auto pc : seq)
+		{
+			// Secondary items always have a color, e.g. "r1c2:A":
+			const char* sep = strchr(pc, ':');
+			name.assign(pc, sep ? sep - pc : strlen(pc));
+
+			auto item = items.find(name.c_str());
+			if (item == items.end() || (sep != nullptr) != (item->second >= nprimary))
+			{
+				cout << "Can't encode " << pc << ", which is not an item in the problem." << endl;
+				return false;
+			}
+			out.put<int32_t>(item->second);
+
+			if (sep)
+			{
+				auto color = colors.find(sep + 1);
+				if (color == colors.end())
+				{
+					cout << "Can't encode " << pc << ", which does not have a valid color." << endl;
+					return false;
+				}
+				out.put<int32_t>(color->second);
+			}
+		}
+	}
+	return true;
+}
+///////////////////////////////////////////////////////////////////////////////
+bool decode_problem(const std::vector<char>& payload, ExactCoverWithMultiplicitiesAndColors* pproblem,
+	int* pmax_results, int* pflags, std::vector<char>* pnames)
+{
+	WireReader in(payload);
+
+	int32_t nprimary = 0, nsecondary = 0, ncolors = 0, nsequences = 0, ncosts = 0;
+	if (!in.get(pmax_results) || !in.get(pflags) || !in.getCount(&nprimary, 2 * sizeof(int32_t)))
+		return false;
+
+	// The same checks as DlxReader, so anything decoded can be given to reset:
+	if (nprimary == 0)
+		return false;
+	pproblem->primary_options.resize(nprimary);
+	for (auto& opt : pproblem->primary_options)
+	{
+		if (!in.get(&opt.u) || !in.get(&opt.v) || opt.u < 0 || opt.u > opt.v || opt.v == 0)
+			return false;
+	}
+
+	if (!in.getCount(&nsecondary, 1) || !in.getCount(&ncolors, 1) ||
+		!in.getCount(&nsequences, sizeof(int32_t)) || !in.getCount(&ncosts, sizeof(int32_t)) ||
+		(ncosts != 0 && ncosts != nsequences))
+		return false;
+
+	pproblem->costs.resize(ncosts);
+	for (auto& cost : pproblem->costs)
+	{
+		if (!in.get(&cost) || cost < 0)
+			return false;
+	}
+
+	// The names can point straight into the payload:
+	for (auto& opt : pproblem->primary_options)
+	{
+		if (!(opt.pValue = in.getString()))
+			return false;
+	}
+	pproblem->secondary_options.resize(nsecondary);
+	for (auto& pc : pproblem->secondary_options)
+	{
+		if (!(pc = in.getString()))
+			return false;
+	}
+	pproblem->colors.resize(ncolors);
+	for (auto& pc : pproblem->colors)
+	{
+		if (!(pc = in.getString()))
+			return false;
+	}
+
+	// Names are looked up by the engines, so they have to be unique, and an item's can't
+	// have the colon that separates it from a color:
+	unordered_set<string> names;
+	for (auto& opt : pproblem->primary_options)
+	{
+		if (!*opt.pValue || strchr(opt.pValue, ':') || !names.insert(opt.pValue).second)
+			return false;
+	}
+	for (auto pc : pproblem->secondary_options)
+	{
+		if (!*pc || strchr(pc, ':') || !names.insert(pc).second)
+			return false;
+	}
+	names.clear();
+	for (auto pc : pproblem->colors)
+	{
+		if (!*pc || !names.insert(pc).second)
+			return false;
+	}
+
+	// The "item:color" strings for secondary items have to be built. The first pass checks
+	// the sequences and works out where each string goes, so *pnames is only sized once
+	// and the pointers into it stay valid. Each pair is only stored once:
+	const char* psequences = in.position();
+	unordered_map<long long, size_t> pair_offsets;
+	size_t names_size = 0;
+	int32_t nitems = nprimary + nsecondary;
+	vector<int> last_sequence(nitems, -1);		// To catch an item listed twice.
+
+	for (int i = 0; i < nsequences; i++)
+	{
+		// Each sequence needs a primary item, and can only list an item once:
+		int32_t n = 0, item = 0, color = 0;
+		if (!in.getCount(&n, sizeof(int32_t)) || n < 1)
+			return false;
+		bool primary = false;
+		for (int j = 0; j < n; j++)
+		{
+			if (!in.get(&item) || item < 0 || item >= nitems || last_sequence[item] == i)
+				return false;
+			last_sequence[item] = i;
+			if (item < nprimary)
+			{
+				primary = true;
+				continue;
+			}
+
+			if (!in.get(&color) || color < 0 || color >= ncolors)
+				return false;
+
+			long long key = (long long)(item - nprimary) * ncolors + color;
+			if (pair_offsets.find(key) == pair_offsets.end())
+			{
+				pair_offsets[key] = names_size;
+				names_size += strlen(pproblem->secondary_options[item - nprimary]) + strlen(pproblem->colors[color]) + 2;
+			}
+		}
+		if (!primary)
+			return false;
+	}
+
+	pnames->resize(names_size);
+	for (auto& pair : pair_offsets)
+	{
+		char* pc = pnames->data() + pair.second;
+		sprintf_s(pc, names_size - pair.second, "%s:%s", pproblem->secondary_options[pair.first / ncolors], pproblem->colors[pair.first % ncolors]);
+	}
+
+	in.seek(psequences);
+	pproblem->sequences.resize(nsequences);
+	for (auto& seq : pproblem->sequences)
+	{
+		int32_t n = 0, item = 0, color = 0;
+		in.get(&n);
+		seq.resize(n);		// Keeps the capacity from earlier requests.
+		for (auto& pc : seq)
+		{
+			in.get(&item);
+			if (item < nprimary)
+			{
+				pc = pproblem->primary_options[item].pValue;
+			}
+			else
+			{
+				in.get(&color);
+				pc = pnames->data() + pair_offsets[(long long)(item - nprimary) * ncolors + color];
+			}
+		}
+	}
+	return true;
+}
+///////////////////////////////////////////////////////////////////////////////
+static void write_stats(const RemoteStats& stats, vector<char>* ppayload)
+{
+	WireWriter out(ppayload);
+	out.put(stats.QueueTime);
+	out.put(stats.SetupTime);
+	out.put(stats.RunTime);
+	out.put(stats.Latency);
+	out.put(stats.LoopCount);
+	out.put<int32_t>(stats.Solutions);
+	out.put<int32_t>(stats.Cancelled);
+}
+
+static bool read_stats(const vector<char>& payload, RemoteStats* pstats)
+{
+	WireReader in(payload);
+	int32_t solutions = 0, cancelled = 0;
+	bool ok = in.get(&pstats->QueueTime) && in.get(&pstats->SetupTime) && in.get(&pstats->RunTime) &&
+		in.get(&pstats->Latency) && in.get(&pstats->LoopCount) && in.get(&solutions) && in.get(&cancelled);
+	pstats->Solutions = solutions;
+	pstats->Cancelled = cancelled != 0;
+	return ok;
+}
+
+static void write_status(const DaemonStatus& status, vector<char>* ppayload)
+{
+	WireWriter out(ppayload);
+	out.put<int32_t>(status.QueueDepth);
+	out.put<int32_t>(status.MaxQueueDepth);
+	out.put<int32_t>(status.BusyWorkers);
+	out.put<int32_t>(status.Workers);
+	out.put(status.Completed);
+	out.put(status.Failed);
+	out.put(status.TotalLatency);
+	out.put(status.MaxLatency);
+}
+
+static bool read_status(const vector<char>& payload, DaemonStatus* pstatus)
+{
+	WireReader in(payload);
+	return in.get(&pstatus->QueueDepth) && in.get(&pstatus->MaxQueueDepth) &&
+		in.get(&pstatus->BusyWorkers) && in.get(&pstatus->Workers) &&
+		in.get(&pstatus->Completed) && in.get(&pstatus->Failed) &&
+		in.get(&pstatus->TotalLatency) && in.get(&pstatus->MaxLatency);
+}
+
+static long long microseconds_since(chrono::steady_clock::time_point start)
+{
+	return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+}
+///////////////////////////////////////////////////////////////////////////////
+void DaemonStatus::format(std::ostream& stream) const
+{
+	stream << "Solver daemon with " << Workers << " workers, " << BusyWorkers << " busy." << endl;
+	stream << "\tQueue depth " << QueueDepth << ", at most " << MaxQueueDepth << "." << endl;
+	stream << "\t" << Completed << " requests completed, " << Failed << " failed." << endl;
+	if (Completed > 0)
+		stream << "\tLatency (microseconds): " << TotalLatency / Completed << " average, " <<
+			MaxLatency << " at most." << endl;
+}
+///////////////////////////////////////////////////////////////////////////////
+//
+// SolverDaemon
+//
+///////////////////////////////////////////////////////////////////////////////
+// How long the daemon waits for a connection to send its request, in milliseconds:
+static const int RequestTimeout = 1000;
+
+SolverDaemon::SolverDaemon(const char* psocket_path, int worker_count) :
+	pSocketPath(psocket_path)
+{
+	assert(worker_count > 0);
+	ListenSocket = INVALID_SOCKET;
+	Stopping = false;
+	Cancel = false;
+	Status.Workers = worker_count;
+}
+///////////////////////////////////////////////////////////////////////////////
+bool SolverDaemon::run()
+{
+	sockaddr_un addr;
+	if (!init_sockets() || !make_address(pSocketPath, &addr))
+		return false;
+
+	socket_t listen_socket = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listen_socket == INVALID_SOCKET)
+	{
+		cout << "Could not create a socket." << endl;
+		return false;
+	}
+
+	remove(pSocketPath);		// Left over from an earlier daemon.
+	if (bind(listen_socket, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(listen_socket, SOMAXCONN) != 0)
+	{
+		cout << "Could not listen on " << pSocketPath << "." << endl;
+		close_socket(listen_socket);
+		return false;
+	}
+	ListenSocket = listen_socket;
+
+	for (int i = 0; i < Status.Workers; i++)
+		Workers.emplace_back(&SolverDaemon::workerLoop, this);
+
+	cout << "Solver daemon listening on " << pSocketPath << " with " << Status.Workers << " workers." << endl;
+
+	// Clients are local and send their request as soon as they connect, so it's simplest
+	// to read it here. One that goes quiet is dropped after RequestTimeout, so it can't
+	// hold up everyone else. Status requests are answered straight away, without queueing.
+	vector<char> payload;
+	for (;;)
+	{
+		socket_t s = accept(listen_socket, nullptr, nullptr);
+		if (s == INVALID_SOCKET)
+			continue;
+
+		set_receive_timeout(s, RequestTimeout);
+
+		int type = 0;
+		if (!recv_frame(s, &type, &payload))
+		{
+			close_socket(s);
+			continue;
+		}
+
+		if (type == dm_Solve)
+		{
+			lock_guard<mutex> lock(QueueMutex);
+			Queue.push_back({ (intptr_t)s, move(payload), chrono::steady_clock::now() });
+			Status.QueueDepth = (int)Queue.size();
+			Status.MaxQueueDepth = max(Status.MaxQueueDepth, Status.QueueDepth);
+			QueueReady.notify_one();
+			continue;
+		}
+
+		if (type == dm_Status)
+		{
+			DaemonStatus status;
+			{
+				lock_guard<mutex> lock(QueueMutex);
+				status = Status;
+			}
+			write_status(status, &payload);
+			send_frame(s, dm_StatusReply, payload);
+		}
+		else if (type == dm_Stop)
+		{
+			payload.clear();
+			send_frame(s, dm_Done, payload);
+			close_socket(s);
+			break;
+		}
+		else
+		{
+			send_error(s, "Unknown request.");
+		}
+		close_socket(s);
+	}
+
+	// Searches in progress, and any still queued, end straight away with the solutions
+	// they have:
+	cout << "Solver daemon stopping." << endl;
+	Cancel = true;
+	{
+		lock_guard<mutex> lock(QueueMutex);
+		Stopping = true;
+	}
+	QueueReady.notify_all();
+	for (auto& worker : Workers)
+		worker.join();
+	Workers.clear();
+
+	close_socket(listen_socket);
+	ListenSocket = INVALID_SOCKET;
+	remove(pSocketPath);
+	return true;
+}
+///////////////////////////////////////////////////////////////////////////////
+void SolverDaemon::workerLoop()
+{
+	// Each worker keeps its buffers between requests, so they stop allocating once
+	// they have seen the largest problem:
+	AlgMPointer alg;
+	alg.setVerbose(false);
+	ExactCoverWithMultiplicitiesAndColors problem;
+	vector<char> names;
+	vector<vector<int>> results;
+	vector<char> reply;
+
+	for (;;)
+	{
+		Request request;
+		{
+			unique_lock<mutex> lock(QueueMutex);
+			QueueReady.wait(lock, [this] { return Stopping || !Queue.empty(); });
+			if (Queue.empty())
+				return;
+
+			request = move(Queue.front());
+			Queue.pop_front();
+			Status.QueueDepth = (int)Queue.size();
+			Status.BusyWorkers++;
+		}
+
+		solve(request, &alg, &problem, &names, &results, &reply);
+		close_socket((socket_t)request.Socket);
+	}
+}
+///////////////////////////////////////////////////////////////////////////////
+void SolverDaemon::solve(Request& request, AlgMPointer* palg, ExactCoverWithMultiplicitiesAndColors* pproblem,
+	std::vector<char>* pnames, std::vector<std::vector<int>>* presults, std::vector<char>* preply)
+{
+	socket_t s = (socket_t)request.Socket;
+
+	RemoteStats stats;
+	stats.QueueTime = microseconds_since(request.Arrived);
+
+	int max_results = 0, flags = 0;
+	if (!decode_problem(request.Payload, pproblem, &max_results, &flags, pnames) || max_results < 1)
+	{
+		send_error(s, "The problem could not be decoded.");
+		finished(false, 0);
+		return;
+	}
+
+	// One frame per solution: the cost, then the sequence indices.
+	bool sent = true;
+	auto send_solution = [s, preply, &sent](const vector<int>& result, long long cost)
+	{
+		WireWriter out(preply);
+		out.put<long long>(cost);
+		out.put<int32_t>((int32_t)result.size());
+		for (auto idx_seq : result)
+			out.put<int32_t>(idx_seq);
+		sent = send_frame(s, dm_Solution, *preply);
+		return sent;
+	};
+
+	presults->clear();
+	AlgMPointer& alg = *palg;
+	bool minimize_cost = (flags & df_MinimizeCost) != 0;
+	alg.reset(*pproblem);
+	alg.setHeuristic((flags & df_NonSharpPreference) != 0);
+	alg.setMinimizeCost(minimize_cost);
+	alg.setCancellation(&Cancel);
+
+	// Each solution goes out as soon as it is found, and a client that hung up ends the
+	// search. The cheapest solutions are only known at the end, so those are sent then:
+	if (!minimize_cost)
+		alg.setSolutionSink([&send_solution](const vector<int>& result) { return send_solution(result, 0); });
+	alg.exactCover(presults, max_results);
+	alg.setSolutionSink(nullptr);
+
+	if (minimize_cost)
+	{
+		for (int i = 0; sent && i < (int)presults->size(); i++)
+			send_solution((*presults)[i], i < (int)alg.SolutionCosts.size() ? alg.SolutionCosts[i] : 0);
+	}
+
+	stats.SetupTime = alg.setupTime;
+	stats.RunTime = alg.runTime;
+	stats.LoopCount = alg.loopCount;
+	stats.Solutions = (int)presults->size();
+	stats.Cancelled = alg.Cancelled;
+	stats.Latency = microseconds_since(request.Arrived);
+
+	write_stats(stats, preply);
+	if (sent)
+		send_frame(s, dm_Done, *preply);
+
+	// A client that hung up still counts, since the work was done:
+	finished(true, stats.Latency);
+}
+///////////////////////////////////////////////////////////////////////////////
+void SolverDaemon::finished(bool ok, long long latency)
+{
+	lock_guard<mutex> lock(QueueMutex);
+	Status.BusyWorkers--;
+	if (ok)
+	{
+		Status.Completed++;
+		Status.TotalLatency += latency;
+		Status.MaxLatency = max(Status.MaxLatency, latency);
+	}
+	else
+	{
+		Status.Failed++;
+	}
+}
+///////////////////////////////////////////////////////////////////////////////
+//
+// Client
+//
+///////////////////////////////////////////////////////////////////////////////
+bool solve_remote(const char* psocket_path, const ExactCoverWithMultiplicitiesAndColors& problem,
+	int max_results, int flags, std::vector<std::vector<int>>* presults,
+	std::vector<long long>* pcosts, RemoteStats* pstats)
+{
+	assert(presults->size() == 0);
+
+	vector<char> payload;
+	if (!encode_problem(problem, max_results, flags, &payload))
+		return false;
+
+	socket_t s = connect_to_daemon(psocket_path);
+	if (s == INVALID_SOCKET)
+		return false;
+
+	bool ok = send_frame(s, dm_Solve, payload);
+	int type = 0;
+	while (ok && (ok = recv_frame(s, &type, &payload)))
+	{
+		if (type == dm_Solution)
+		{
+			WireReader in(payload);
+			long long cost = 0;
+			int32_t n = 0;
+			ok = in.get(&cost) && in.getCount(&n, sizeof(int32_t));
+			if (ok)
+			{
+				vector<int> result(n);
+				for (auto& idx_seq : result)
+					in.get(&idx_seq);
+				presults->emplace_back(move(result));
+				if (pcosts && (flags & df_MinimizeCost))
+					pcosts->push_back(cost);
+			}
+		}
+		else if (type == dm_Done)
+		{
+			RemoteStats stats;
+			ok = read_stats(payload, &stats);
+			if (pstats)
+				*pstats = stats;
+			break;
+		}
+		else
+		{
+			if (type == dm_Error && payload.size() > 0)
+				cout << "Solver daemon: " << payload.data() << endl;
+			ok = false;
+		}
+	}
+
+	if (!ok)
+		cout << "The solver daemon did not complete the request." << endl;
+
+	close_socket(s);
+	return ok;
+}
+///////////////////////////////////////////////////////////////////////////////
+bool query_daemon(const char* psocket_path, DaemonStatus* pstatus)
+{
+	socket_t s = connect_to_daemon(psocket_path);
+	if (s == INVALID_SOCKET)
+		return false;
+
+	vector<char> payload;
+	int type = 0;
+	bool ok = send_frame(s, dm_Status, payload) && recv_frame(s, &type, &payload) &&
+		type == dm_StatusReply && read_status(payload, pstatus);
+
+	close_socket(s);
+	return ok;
+}
+///////////////////////////////////////////////////////////////////////////////
+bool stop_daemon(const char* psocket_path)
+{
+	socket_t s = connect_to_daemon(psocket_path);
+	if (s == INVALID_SOCKET)
+		return false;
+
+	vector<char> payload;
+	int type = 0;
+	bool ok = send_frame(s, dm_Stop, payload) && recv_frame(s, &type, &payload) && type == dm_Done;
+
+	close_socket(s);
+	return ok;
+}
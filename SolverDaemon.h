@@ -0,0 +1,143 @@
+#pragma once
+
+// A long running local solver, so small problems don't pay for process startup.
+//
+// The daemon listens on a Unix domain socket (AF_UNIX, which Windows 10 supports as
+// well). Each connection carries one request, which has to arrive promptly, since the
+// daemon reads requests one at a time:
+//
+// - Solve: the client sends the problem in the compact format below. The request is
+//   queued and solved by the next free worker, which streams back one frame per
+//   solution as it is found (when minimizing cost, once the search is over) and then
+//   a frame with the stats for the request.
+// - Status: returns the queue depth and latency totals.
+// - Stop: cancels any searches in progress, finishes the queue and exits.
+//
+// Every message is a frame: an int32 type from DaemonMessages, an int32 payload length
+// and the payload. Numbers are in the native byte order, since both ends are on the
+// same machine.
+//
+// Problem payload, all int32 unless noted:
+//   max_results, flags (DaemonFlags)
+//   primary count, then the u and v of each primary item
+//   secondary count, color count, sequence count, cost count (0 or sequence count)
+//   the costs
+//   the names of the primary items, secondary items and colors, each 0 terminated
+//   for each sequence, its item count, then the index of each item. Primary items are
+//   numbered first, then secondary items, which are followed by the index of their color.
+//
+// Names are sent once and sequences only use indices, which keeps large problems small.
+
+#include <vector>
+#include <cstdint>
+#include <iostream>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <deque>
+#include <chrono>
+
+struct ExactCoverWithMultiplicitiesAndColors;
+class AlgMPointer;
+
+///////////////////////////////////////////////////////////////////////////////
+enum DaemonMessages
+{
+	dm_Solve = 1,
+	dm_Status,
+	dm_Stop,
+
+	// Replies:
+	dm_Solution,
+	dm_Done,
+	dm_StatusReply,
+	dm_Error,
+};
+
+enum DaemonFlags
+{
+	df_NonSharpPreference = 1,
+	df_MinimizeCost = 2,
+};
+///////////////////////////////////////////////////////////////////////////////
+// Sent after the solutions for each request. Times are in microseconds:
+struct RemoteStats
+{
+	long long QueueTime = 0;		// Waiting for a worker.
+	long long SetupTime = 0;
+	long long RunTime = 0;
+	long long Latency = 0;			// From the request arriving to the last solution being sent.
+	long long LoopCount = 0;
+	int Solutions = 0;
+	bool Cancelled = false;
+};
+///////////////////////////////////////////////////////////////////////////////
+struct DaemonStatus
+{
+	int QueueDepth = 0;			// Requests waiting for a worker.
+	int MaxQueueDepth = 0;
+	int BusyWorkers = 0;
+	int Workers = 0;
+
+	long long Completed = 0;
+	long long Failed = 0;		// Requests that could not be decoded.
+	long long TotalLatency = 0;	// Over all completed requests, in microseconds.
+	long long MaxLatency = 0;
+
+	void format(std::ostream& stream) const;
+};
+///////////////////////////////////////////////////////////////////////////////
+// Wire format helpers, exposed so a client can build a request once and send it
+// many times. Decoding returns false for a malformed payload, or a problem the engines
+// can't be given, e.g. with a sequence that has no primary item. The decoded problem
+// points into the payload and into *pnames, which holds the "item:color" strings
+// and can be reused between requests.
+bool encode_problem(const ExactCoverWithMultiplicitiesAndColors& problem, int max_results, int flags,
+						std::vector<char>* ppayload);
+bool decode_problem(const std::vector<char>& payload, ExactCoverWithMultiplicitiesAndColors* pproblem,
+						int* pmax_results, int* pflags, std::vector<char>* pnames);
+///////////////////////////////////////////////////////////////////////////////
+class SolverDaemon
+{
+	struct Request
+	{
+		std::intptr_t Socket;
+		std::vector<char> Payload;
+		std::chrono::steady_clock::time_point Arrived;
+	};
+
+	const char* pSocketPath;
+	std::intptr_t ListenSocket;
+
+	std::mutex QueueMutex;
+	std::condition_variable QueueReady;
+	std::deque<Request> Queue;
+	bool Stopping;
+
+	// Set on stop, so searches in progress end early:
+	std::atomic<bool> Cancel;
+
+	std::vector<std::thread> Workers;
+
+	DaemonStatus Status;	// Protected by QueueMutex.
+
+	void workerLoop();
+	void solve(Request& request, AlgMPointer* palg, ExactCoverWithMultiplicitiesAndColors* pproblem,
+				std::vector<char>* pnames, std::vector<std::vector<int>>* presults, std::vector<char>* preply);
+	void finished(bool ok, long long latency);
+
+public:
+	SolverDaemon(const char* psocket_path, int worker_count);
+
+	// Serves requests until a stop request arrives. Returns false if the socket can't be opened.
+	bool run();
+};
+///////////////////////////////////////////////////////////////////////////////
+// Client side. The solutions are in the order the daemon found them. Costs are only
+// returned if the search minimized cost.
+bool solve_remote(const char* psocket_path, const ExactCoverWithMultiplicitiesAndColors& problem,
+					int max_results, int flags, std::vector<std::vector<int>>* presults,
+					std::vector<long long>* pcosts = nullptr, RemoteStats* pstats = nullptr);
+bool query_daemon(const char* psocket_path, DaemonStatus* pstatus);
+bool stop_daemon(const char* psocket_path);
@@ -0,0 +1,179 @@
+
+#include <fstream>
+#include <cstring>
+#include <algorithm>
+
+#include "Common.h"
+#include "Trace.h"
+#include "AlgMPointer.h"
+#include "ShardedSearch.h"
+
+using namespace std;
+
+static const char TraceMagic[8] = { 'D', 'L', 'X', 'T', 'R', 'A', 'C', 'E' };
+static const int32_t TraceVersion = 2;		// 2 added ag_Skip and ag_Unskip.
+
+///////////////////////////////////////////////////////////////////////////////
+void TraceBuffer::start(size_t capacity, int min_level, int max_level)
+{
+	size_t size = 1;
+	while (size < capacity)
+		size *= 2;
+
+	Records.assign(size, TraceRecord());
+	Mask = size - 1;
+	Count = 0;
+	MinLevel = min_level;
+	MaxLevel = max_level;
+}
+///////////////////////////////////////////////////////////////////////////////
+void TraceBuffer::stop()
+{
+	Records.clear();
+	Records.shrink_to_fit();
+	Mask = 0;
+	Count = 0;
+}
+///////////////////////////////////////////////////////////////////////////////
+void TraceBuffer::snapshot(std::vector<TraceRecord>* precords) const
+{
+	precords->clear();
+	if (Records.empty())
+		return;
+
+	uint64_t kept = min<uint64_t>(Count, Records.size());
+	for (uint64_t i = Count - kept; i < Count; i++)
+		precords->push_back(Records[i & Mask]);
+}
+///////////////////////////////////////////////////////////////////////////////
+bool TraceBuffer::write(const char* pfile_name, unsigned long long problem_hash) const
+{
+	vector<TraceRecord> records;
+	snapshot(&records);
+
+	ofstream file(pfile_name, ios::binary);
+	if (!file)
+	{
+		cout << "Couldn't create trace file " << pfile_name << "." << endl;
+		return false;
+	}
+
+	int32_t record_size = sizeof(TraceRecord);
+	uint64_t hash = problem_hash;
+	uint64_t count = records.size();
+
+	file.write(TraceMagic, sizeof(TraceMagic));
+	file.write((const char*) &TraceVersion, sizeof(TraceVersion));
+	file.write((const char*) &record_size, sizeof(record_size));
+	file.write((const char*) &hash, sizeof(hash));
+	file.write((const char*) &Count, sizeof(Count));
+	file.write((const char*) &count, sizeof(count));
+	if (count > 0)
+		file.write((const char*) records.data(), count * sizeof(TraceRecord));
+
+	if (!file)
+	{
+		cout << "Couldn't write trace file " << pfile_name << "." << endl;
+		return false;
+	}
+	return true;
+}
+///////////////////////////////////////////////////////////////////////////////
+bool read_trace(const char* pfile_name, std::vector<TraceRecord>* precords,
+				unsigned long long* pproblem_hash, uint64_t* precorded)
+{
+	ifstream file(pfile_name, ios::binary);
+	if (!file)
+	{
+		cout << "Couldn't open trace file " << pfile_name << "." << endl;
+		return false;
+	}
+
+	char magic[sizeof(TraceMagic)];
+	int32_t version = 0, record_size = 0;
+	uint64_t hash = 0, recorded = 0, count = 0;
+
+	file.read(magic, sizeof(magic));
+	file.read((char*) &version, sizeof(version));
+	file.read((char*) &record_size, sizeof(record_size));
+	file.read((char*) &hash, sizeof(hash));
+	file.read((char*) &recorded, sizeof(recorded));
+	file.read((char*) &count, sizeof(count));
+
+	if (!file || memcmp(magic, TraceMagic, sizeof(magic)) != 0 ||
+		version != TraceVersion || record_size != sizeof(TraceRecord))
+	{
+		cout << pfile_name << " isn't a trace file this version can read." << endl;
+		return false;
+	}
+
+	precords->resize(count);
+	if (count > 0)
+		file.read((char*) precords->data(), count * sizeof(TraceRecord));
+	if (!file)
+	{
+		cout << "Trace file " << pfile_name << " is truncated." << endl;
+		return false;
+	}
+
+	*pproblem_hash = hash;
+	*precorded = recorded;
+	return true;
+}
+///////////////////////////////////////////////////////////////////////////////
+bool decode_trace(const char* pfile_name, const ExactCoverWithMultiplicitiesAndColors& problem,
+				std::ostream& stream)
+{
+	vector<TraceRecord> records;
+	unsigned long long hash;
+	uint64_t recorded;
+	if (!read_trace(pfile_name, &records, &hash, &recorded))
+		return false;
+
+	if (hash != problem_hash(problem))
+	{
+		cout << "Trace file " << pfile_name << " was recorded for a different problem." << endl;
+		return false;
+	}
+
+	// AlgMPointer lays out the items as the primary items followed by the secondary
+	// ones, and one cell per entry of each sequence, in order:
+	size_t total_items = problem.primary_options.size() + problem.secondary_options.size();
+	vector<size_t> sequence_ends;
+	size_t total_cells = 0;
+	for (const auto& seq : problem.sequences)
+	{
+		total_cells += seq.size();
+		sequence_ends.push_back(total_cells);
+	}
+
+	stream << recorded << " events were recorded, " << records.size() << " are in the trace." << endl;
+
+	for (const TraceRecord& rec : records)
+	{
+		if (rec.Action < ag_Init || rec.Action > ag_Done)
+		{
+			cout << "Trace file " << pfile_name << " has an unknown action." << endl;
+			return false;
+		}
+		stream << rec.Loop << ":" << rec.Level << " - " << AlgMPointer::ActionName((AgActions) rec.Action);
+
+		if (rec.Item >= 0 && rec.Item < total_items)
+		{
+			size_t nprimary = problem.primary_options.size();
+			stream << " " << (rec.Item < nprimary ? problem.primary_options[rec.Item].pValue :
+								problem.secondary_options[rec.Item - nprimary]);
+		}
+
+		if (rec.Cell >= 0 && rec.Cell < total_cells)
+		{
+			size_t idx_seq = upper_bound(sequence_ends.begin(), sequence_ends.end(), (size_t) rec.Cell) -
+								sequence_ends.begin();
+			stream << " cell:";
+			problem.format_sequence((int) idx_seq, stream);
+		}
+		else
+			stream << endl;
+	}
+	return true;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+// Binary event trace of the AlgMPointer search, cheap enough to leave compiled into
+// release builds. The search records into a ring buffer of fixed size records, so it
+// never formats text or takes a lock, and the buffer holds the most recent events when
+// the search ends. A buffer is only used by one search at a time, so each thread gets
+// its own. Without a buffer, tracing costs a test per loop.
+//
+// Records only hold indices. decode_trace turns them back into item names and
+// sequences using the problem, which is regenerated from the same arguments.
+//
+// File format, in native byte order: the magic "DLXTRACE", int32 version, int32 record
+// size, uint64 problem hash (see problem_hash), uint64 events recorded, uint64 record
+// count, then the records, oldest first. More events than records means the oldest
+// were overwritten.
+
+#include <vector>
+#include <cstdint>
+#include <iostream>
+#include <climits>
+
+struct ExactCoverWithMultiplicitiesAndColors;
+
+///////////////////////////////////////////////////////////////////////////////
+struct TraceRecord
+{
+	int64_t Loop;
+	int32_t Level;
+	int32_t Action;		// From AgActions.
+	int32_t Item;		// Index of the item chosen at this level, or -1.
+	int32_t Cell;		// Index of the cell being tried, or -1.
+};
+///////////////////////////////////////////////////////////////////////////////
+class TraceBuffer
+{
+	std::vector<TraceRecord> Records;	// The size is a power of 2.
+	size_t Mask;
+	uint64_t Count;		// Events recorded since the buffer was started.
+	int MinLevel;
+	int MaxLevel;
+
+public:
+	TraceBuffer() : Mask(0), Count(0), MinLevel(0), MaxLevel(INT_MAX) {}
+
+	// Capacity is rounded up to a power of 2. Only levels in [min_level, max_level] are recorded:
+	void start(size_t capacity, int min_level = 0, int max_level = INT_MAX);
+	void stop();
+	bool isActive() const { return !Records.empty(); }
+
+	void record(long long loop, int level, int action, int item, int cell)
+	{
+		if (level < MinLevel || level > MaxLevel)
+			return;
+
+		TraceRecord& rec = Records[Count++ & Mask];
+		rec.Loop = loop;
+		rec.Level = level;
+		rec.Action = action;
+		rec.Item = item;
+		rec.Cell = cell;
+	}
+
+	uint64_t recorded() const { return Count; }
+	size_t capacity() const { return Records.size(); }
+
+	// The records still in the buffer, oldest first:
+	void snapshot(std::vector<TraceRecord>* precords) const;
+
+	bool write(const char* pfile_name, unsigned long long problem_hash) const;
+};
+///////////////////////////////////////////////////////////////////////////////
+// Decoder side:
+bool read_trace(const char* pfile_name, std::vector<TraceRecord>* precords,
+				unsigned long long* pproblem_hash, uint64_t* precorded);
+
+// Writes one line per record: the loop, level, action, item name and the sequence
+// of the cell. Returns false if the trace doesn't match the problem.
+bool decode_trace(const char* pfile_name, const ExactCoverWithMultiplicitiesAndColors& problem,
+				std::ostream& stream = std::cout);
@@ -0,0 +1,147 @@
+
+#include <chrono>
+#include <cstring>
+#include <random>
+#include <algorithm>
+
+#include "ValueOrder.h"
+
+using namespace std;
+///////////////////////////////////////////////////////////////////////////////
+static const char* const value_order_names[] =
+{
+	"input",
+	"fewest",
+	"constraining",
+	"score",
+	"random",
+};
+///////////////////////////////////////////////////////////////////////////////
+const char* value_order_name(ValueOrderPolicy policy)
+{
+	return value_order_names[policy];
+}
+///////////////////////////////////////////////////////////////////////////////
+bool parse_value_order(const char* pname, ValueOrderPolicy* ppolicy)
+{
+	for (int i = 0; i <= vo_Random; i++)
+	{
+		if (strcmp(pname, value_order_names[i]) == 0)
+		{
+			*ppolicy = (ValueOrderPolicy)i;
+			return true;
+		}
+	}
+	return false;
+}
+///////////////////////////////////////////////////////////////////////////////
+// Choosing a sequence rules out every other sequence that uses one of its primary items,
+// at least until an item with multiplicities runs out. So a sequence's key is minus the
+// number of other uses of its primary items, putting the most constraining first.
+void ValueOrder::rankByConstraint(const ExactCoverWithMultiplicitiesAndColors& problem)
+{
+	PrimaryUses.clear();
+	for (auto& option : problem.primary_options)
+		PrimaryUses[option.pValue] = 0;
+
+	// Primary items never have a color:
+	for (auto& seq : problem.sequences)
+	{
+		for (const char* pc : seq)
+		{
+			auto it = PrimaryUses.find(pc);
+			if (it != PrimaryUses.end())
+				it->second++;
+		}
+	}
+
+	for (size_t i = 0; i < problem.sequences.size(); i++)
+	{
+		long long others = 0;
+		for (const char* pc : problem.sequences[i])
+		{
+			auto it = PrimaryUses.find(pc);
+			if (it != PrimaryUses.end())
+				others += it->second - 1;
+		}
+		Keys[i] = -others;
+	}
+}
+///////////////////////////////////////////////////////////////////////////////
+const ExactCoverWithMultiplicitiesAndColors& ValueOrder::reorder(const ExactCoverWithMultiplicitiesAndColors& problem,
+	ValueOrderPolicy policy, unsigned seed)
+{
+	auto start_time = std::chrono::high_resolution_clock::now();
+
+	int nsequences = (int)problem.sequences.size();
+
+	OriginalSequence.resize(nsequences);
+	for (int i = 0; i < nsequences; i++)
+		OriginalSequence[i] = i;
+
+	Keys.assign(nsequences, 0);
+	switch (policy)
+	{
+	case vo_Input:
+		break;
+	case vo_FewestItems:
+		for (int i = 0; i < nsequences; i++)
+			Keys[i] = problem.sequences[i].size();
+		break;
+	case vo_MostConstraining:
+		rankByConstraint(problem);
+		break;
+	case vo_Score:
+		for (int i = 0; i < nsequences; i++)
+			Keys[i] = problem.sequenceCost(i);
+		break;
+	case vo_Random:
+		shuffle(OriginalSequence.begin(), OriginalSequence.end(), mt19937(seed));
+		break;
+	}
+
+	if (policy != vo_Random)
+	{
+		stable_sort(OriginalSequence.begin(), OriginalSequence.end(), [this](int i1, int i2)
+		{
+			return Keys[i1] < Keys[i2];
+		});
+	}
+
+	ReorderedSequence.resize(nsequences);
+	for (int i = 0; i < nsequences; i++)
+		ReorderedSequence[OriginalSequence[i]] = i;
+
+	Reordered.primary_options = problem.primary_options;
+	Reordered.secondary_options = problem.secondary_options;
+	Reordered.colors = problem.colors;
+
+	// Resizing keeps the buffers of the sequences from the last problem:
+	Reordered.sequences.resize(nsequences);
+	Reordered.costs.resize(problem.costs.size());
+	for (int i = 0; i < nsequences; i++)
+	{
+		Reordered.sequences[i] = problem.sequences[OriginalSequence[i]];
+		if (!problem.costs.empty())
+			Reordered.costs[i] = problem.costs[OriginalSequence[i]];
+	}
+
+	auto end_time = std::chrono::high_resolution_clock::now();
+	OrderTime = (long)std::chrono::duration_cast<std::chrono::microseconds>(end_time - start_time).count();
+	return Reordered;
+}
+///////////////////////////////////////////////////////////////////////////////
+void ValueOrder::toReordered(std::vector<int>* psequences) const
+{
+	for (int& seq : *psequences)
+		seq = ReorderedSequence[seq];
+}
+///////////////////////////////////////////////////////////////////////////////
+void ValueOrder::toOriginal(std::vector<std::vector<int>>* presults) const
+{
+	for (auto& solution : *presults)
+	{
+		for (int& seq : solution)
+			seq = OriginalSequence[seq];
+	}
+}
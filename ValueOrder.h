@@ -0,0 +1,63 @@
+#pragma once
+
+// Static value ordering. Both engines link each sequence at the bottom of its items' lists,
+// so every item tries its sequences in the order they are listed in the problem. That
+// doesn't change which solutions there are, but it decides which are found first, and
+// so how long a search for the first solution, or the first few, takes.
+//
+// A ValueOrder sorts the sequences by a policy before setup, which sorts every item's
+// list the same way. Ties keep their order, so the input order is the default and the
+// search is unchanged unless a policy is chosen. Solutions are mapped back to the
+// original sequence indices.
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+
+#include "Common.h"
+
+///////////////////////////////////////////////////////////////////////////////
+enum ValueOrderPolicy
+{
+	vo_Input,				// As listed.
+	vo_FewestItems,			// Shortest sequences first.
+	vo_MostConstraining,	// Sequences that rule out the most others first.
+	vo_Score,				// Cheapest first, by the problem's costs, e.g. word frequency.
+	vo_Random,				// Shuffled with a seed, so a run can be repeated.
+};
+const char* value_order_name(ValueOrderPolicy policy);
+
+// Returns false if there is no policy with the name:
+bool parse_value_order(const char* pname, ValueOrderPolicy* ppolicy);
+///////////////////////////////////////////////////////////////////////////////
+class ValueOrder
+{
+	// The sorted copy. It points at the original problem's strings:
+	ExactCoverWithMultiplicitiesAndColors Reordered;
+
+	std::vector<int> OriginalSequence;		// Of each reordered sequence.
+	std::vector<int> ReorderedSequence;		// Of each original sequence.
+
+	// Kept so their buffers are reused:
+	std::vector<long long> Keys;			// Of each original sequence, smallest first.
+	std::unordered_map<std::string, int> PrimaryUses;
+
+	long OrderTime = 0;
+
+	void rankByConstraint(const ExactCoverWithMultiplicitiesAndColors& problem);
+
+public:
+	// Returns the sorted copy, which is valid until the next call or until the original
+	// problem changes:
+	const ExactCoverWithMultiplicitiesAndColors& reorder(const ExactCoverWithMultiplicitiesAndColors& problem,
+		ValueOrderPolicy policy, unsigned seed = 1);
+
+	// Sequence indices from the original problem to the sorted one, e.g. forced sequences:
+	void toReordered(std::vector<int>* psequences) const;
+
+	// Solutions of the sorted problem back to the original:
+	void toOriginal(std::vector<std::vector<int>>* presults) const;
+
+	// Of the last reorder, in microseconds:
+	long orderTime() const { return OrderTime; }
+};
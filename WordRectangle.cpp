@@ -1,5 +1,6 @@
 #include "Common.h"
 #include "WordRectangle.h"
+#include "ProblemFile.h"
 #include <fstream>
 #include <direct.h>
 #include <iostream>
@@ -251,6 +252,7 @@ void WordRectangle::generateProblem(ExactCoverWithMultiplicitiesAndColors* pprob
 				ptr_vec.push_back(letterUsage(c, true));
 			}
 			pproblem->sequences.emplace_back(ptr_vec);
+			pproblem->costs.push_back(i);	// The word list is in frequency order.
 		}
 	}
 
@@ -275,6 +277,7 @@ void WordRectangle::generateProblem(ExactCoverWithMultiplicitiesAndColors* pprob
 				ptr_vec.push_back(letterUsage(c, true));
 			}
 			pproblem->sequences.emplace_back(ptr_vec);
+			pproblem->costs.push_back(i);
 		}
 	}
 
@@ -287,6 +290,7 @@ void WordRectangle::generateProblem(ExactCoverWithMultiplicitiesAndColors* pprob
 			ptr_vec.push_back(hash_letter(c));
 			ptr_vec.push_back(letterUsage(c, false));
 			pproblem->sequences.emplace_back(ptr_vec);
+			pproblem->costs.push_back(0);
 		}
 		{
 			std::vector<const char*> ptr_vec;
@@ -294,6 +298,7 @@ void WordRectangle::generateProblem(ExactCoverWithMultiplicitiesAndColors* pprob
 			ptr_vec.push_back(letterUsage(c, true));
 			ptr_vec.push_back(hash);
 			pproblem->sequences.emplace_back(ptr_vec);
+			pproblem->costs.push_back(0);
 		}
 	}
 
@@ -304,38 +309,157 @@ void WordRectangle::generateProblem(ExactCoverWithMultiplicitiesAndColors* pprob
 	}
 }
 ///////////////////////////////////////////////////////////////////////////////
+// Numbered in the order the problem with names lists them:
+void WordRectangle::generateItems(CompactExactCover* pproblem)
+{
+	pproblem->clear();
+	for (int row = 0; row < height; row++)
+		pproblem->addPrimary(rowNames + row * 3);
+	for (int column = 0; column < width; column++)
+		pproblem->addPrimary(columnNames + column * 3);
+	for (char c = 'a'; c <= 'z'; c++)
+		pproblem->addPrimary(hash_letter(c));
+	pproblem->addPrimary(hash, 1, 8);
+
+	for (int row = 0; row < height; row++)
+	{
+		for (int column = 0; column < width; column++)
+			pproblem->addSecondary(pos(row, column));
+	}
+	for (char c = 'a'; c <= 'z'; c++)
+		pproblem->addSecondary(letter(c));
+
+	for (int i = 0; i < 28; i++)
+		pproblem->addColor(colors + i * 2);
+
+	// Each of a word's sequences costs its index in the list, in the order emitCells gives them:
+	pproblem->Costs.reserve(Words4.size() * width + Words5.size() * height + 26 * 2);
+	for (int i = 0; i < Words4.size(); i++)
+		pproblem->Costs.insert(pproblem->Costs.end(), width, i);
+	for (int i = 0; i < Words5.size(); i++)
+		pproblem->Costs.insert(pproblem->Costs.end(), height, i);
+	pproblem->Costs.insert(pproblem->Costs.end(), 26 * 2, 0);
+}
+///////////////////////////////////////////////////////////////////////////////
+void WordRectangle::emitCells(CellSink& sink) const
+{
+	const int first_column = height;
+	const int first_hash_letter = first_column + width;
+	const int hash_item = first_hash_letter + 26;
+	const int first_position = hash_item + 1;
+	const int first_letter = first_position + width * height;
+	const int color_0 = 26 + 1;		// After the letters.
+	const int color_1 = 26 + 2;
+
+	for (int i = 0; i < Words4.size(); i++)
+	{
+		const string& word = Words4[i];
+		const string& letters = Words4Letters[i];
+
+		for (int column = 0; column < width; column++)
+		{
+			sink.addCell(first_column + column);
+			for (int row = 0; row < height; row++)
+				sink.addCell(first_position + row * width + column, word[row] - 'a' + 1);
+			for (auto c : letters)
+				sink.addCell(first_letter + c - 'a', color_1);
+			sink.endSequence();
+		}
+	}
+
+	for (int i = 0; i < Words5.size(); i++)
+	{
+		const string& word = Words5[i];
+		const string& letters = Words5Letters[i];
+
+		for (int row = 0; row < height; row++)
+		{
+			sink.addCell(row);
+			for (int column = 0; column < width; column++)
+				sink.addCell(first_position + row * width + column, word[column] - 'a' + 1);
+			for (auto c : letters)
+				sink.addCell(first_letter + c - 'a', color_1);
+			sink.endSequence();
+		}
+	}
+
+	for (char c = 'a'; c <= 'z'; c++)
+	{
+		sink.addCell(first_hash_letter + c - 'a');
+		sink.addCell(first_letter + c - 'a', color_0);
+		sink.endSequence();
+
+		sink.addCell(first_hash_letter + c - 'a');
+		sink.addCell(first_letter + c - 'a', color_1);
+		sink.addCell(hash_item);
+		sink.endSequence();
+	}
+}
+///////////////////////////////////////////////////////////////////////////////
+void WordRectangle::generateProblem(CompactExactCover* pproblem)
+{
+	generateItems(pproblem);
+
+	// Count first, so the arrays are only allocated once:
+	int sequences = (int)(Words4.size() * width + Words5.size() * height) + 26 * 2;
+	size_t cells = 26 * (2 + 3);
+	for (auto& letters : Words4Letters)
+		cells += width * (1 + height + letters.size());
+	for (auto& letters : Words5Letters)
+		cells += height * (1 + width + letters.size());
+	pproblem->reserve(sequences, cells);
+
+	emitCells(*pproblem);
+
+	assert(pproblem->sequences() == sequences && pproblem->Cells.size() == cells);
+	pproblem->assertValid();
+}
+///////////////////////////////////////////////////////////////////////////////
+void WordRectangle::streamProblem(CompactExactCover* pproblem)
+{
+	generateItems(pproblem);
+	pproblem->stream([this](CellSink& sink) { emitCells(sink); });
+	pproblem->assertValid();
+}
+///////////////////////////////////////////////////////////////////////////////
+// Bump this when generateProblem changes what it makes, so cached problems aren't used:
+static const int GeneratorVersion = 1;
+
+unsigned long long WordRectangle::problemKey() const
+{
+	int parameters[] = { GeneratorVersion, width, height, lim4, lim5, (int)Words4.size(), (int)Words5.size() };
+	uint64_t key = hash_problem_key(ProblemKeyBasis, parameters, sizeof(parameters));
+	for (auto& word : Words4)
+		key = hash_problem_key(key, word);
+	for (auto& word : Words5)
+		key = hash_problem_key(key, word);
+	return key;
+}
+///////////////////////////////////////////////////////////////////////////////
 void WordRectangle::writeRectangle(const ExactCoverWithMultiplicitiesAndColors& problem,
 	const std::vector<int> results,
 	std::ostream& stream,
 	int xspacing, int yspacing
 )
 {
-
-	char* ppad = (char*)alloca(xspacing + 1);
-	memset(ppad, ' ', xspacing);
-	ppad[xspacing] = 0;
-
-	char* vpad = (char*)alloca(yspacing + 1);
-	memset(vpad, '\n', yspacing);
-	vpad[yspacing] = 0;
-
-	int horizontal_sequences[height];
-	memset(horizontal_sequences, -1, sizeof(horizontal_sequences));
+	string rows[height];
 
 	// Look the the sequences selected in the results. Since we created the sequence,
 	// we can rely on the "A0" item being at the front and so forth.
 	int found = 0;
 	for (int i = 0; i < results.size(); i++)
 	{
-		auto seq = problem.sequences[results[i]];
+		auto& seq = problem.sequences[results[i]];
 		auto pfirst_item = seq[0];
 
 		if (pfirst_item[0] == 'A')
 		{
 			int row = pfirst_item[1] - '0';
 
-			assert(horizontal_sequences[row] == -1);
-			horizontal_sequences[row] = results[i];
+			assert(rows[row].empty());
+			assert(seq.size() > width);
+			for (int j = 0; j < width; j++)
+				rows[row].push_back(seq[j + 1][3]);	// will look like 30:p or whatever
 			found++;
 
 			if (found == height)
@@ -344,21 +468,64 @@ void WordRectangle::writeRectangle(const ExactCoverWithMultiplicitiesAndColors&
 	}
 	assert(found == height);
 
+	writeRows(rows, stream, xspacing, yspacing);
+}
+///////////////////////////////////////////////////////////////////////////////
+void WordRectangle::writeRectangle(const CompactExactCover& problem,
+	const std::vector<int> results,
+	std::ostream& stream,
+	int xspacing, int yspacing
+)
+{
+	string rows[height];
+
+	// The same, with the letter as the color of each position:
+	int found = 0;
+	for (int i = 0; i < results.size(); i++)
+	{
+		int start = problem.SequenceStarts[results[i]];
+		const char* pfirst_item = problem.ItemNames[problem.Cells[start].Item];
+
+		if (pfirst_item[0] == 'A')
+		{
+			int row = pfirst_item[1] - '0';
+
+			assert(rows[row].empty());
+			assert(problem.SequenceStarts[results[i] + 1] - start > width);
+			for (int j = 0; j < width; j++)
+				rows[row].push_back(problem.ColorNames[problem.Cells[start + j + 1].Color - 1][0]);
+			found++;
+
+			if (found == height)
+				break;
+		}
+	}
+	assert(found == height);
+
+	writeRows(rows, stream, xspacing, yspacing);
+}
+///////////////////////////////////////////////////////////////////////////////
+void WordRectangle::writeRows(const std::string rows[height], std::ostream& stream, int xspacing, int yspacing)
+{
+	char* ppad = (char*)alloca(xspacing + 1);
+	memset(ppad, ' ', xspacing);
+	ppad[xspacing] = 0;
+
+	char* vpad = (char*)alloca(yspacing + 1);
+	memset(vpad, '\n', yspacing);
+	vpad[yspacing] = 0;
+
 	bool used_letters[26] = { false };
 	int used_count = 0;
 
 	for (int i = 0; i < height; i++)
 	{
-		auto seq = problem.sequences[horizontal_sequences[i]];
-		assert(seq.size() > width);
-
 		if (i > 0)
 			stream << vpad;
 
 		for (int j = 0; j < width; j++)
 		{
-			const char* pc = seq[j + 1];	// will look like 30:p or whatever
-			char letter = pc[3];
+			char letter = rows[i][j];
 
 			if (j > 0)
 				stream << ppad;
@@ -2,6 +2,8 @@
 
 
 struct ExactCoverWithMultiplicitiesAndColors;
+struct CompactExactCover;
+struct CellSink;
 
 class WordRectangle
 {
@@ -59,6 +61,12 @@ class WordRectangle
 		return letterUsages + idx;
 	}
 
+	void generateItems(CompactExactCover* pproblem);
+	void emitCells(CellSink& sink) const;
+
+	// The letters of each row, which both writeRectangles find:
+	void writeRows(const std::string rows[height], std::ostream& stream, int xspacing, int yspacing);
+
 public:
 
 	WordRectangle();
@@ -66,6 +74,14 @@ public:
 	bool readWords(const char *pfile_name);
 
 	void generateProblem(ExactCoverWithMultiplicitiesAndColors* pproblem);
+	// The same problem numbered, with the cells added one at a time rather than a vector
+	// of names for each sequence. assign would give the same from the one above:
+	void generateProblem(CompactExactCover* pproblem);
+	// Or streamed, so the engine sets up from the words, and this has to outlive the problem:
+	void streamProblem(CompactExactCover* pproblem);
+
+	// What generateProblem makes from the words read, for ProblemCache (see ProblemFile.h):
+	unsigned long long problemKey() const;
 
 	// Once we have a solution, write the result:
 	void writeRectangle(const ExactCoverWithMultiplicitiesAndColors& problem,
@@ -73,4 +89,10 @@ public:
 					std::ostream& stream = std::cout,
 					int xspacing = 1, int yspacing = 1
 					);
+	// The same for the problem numbered, e.g. loaded from the cache:
+	void writeRectangle(const CompactExactCover& problem,
+					const std::vector<int> results,
+					std::ostream& stream = std::cout,
+					int xspacing = 1, int yspacing = 1
+					);
 };
\ No newline at end of file
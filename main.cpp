@@ -3,8 +3,22 @@
 
 #include "AlgMPointer.h"
 #include "Common.h"
+#include "MStringValues.h"
 #include "PartridgePuzzle.h"
 #include "WordRectangle.h"
+#include "ShardedSearch.h"
+#include "AsyncSolve.h"
+#include "SolverDaemon.h"
+#include "BatchSolve.h"
+#include "Trace.h"
+#include "SearchProfile.h"
+#include "PerfCounters.h"
+#include "Benchmark.h"
+#include "DifferentialFuzz.h"
+#include "Solver.h"
+#include "ProblemFile.h"
+#include "DlxFormat.h"
+#include "SolutionLog.h"
 using namespace std;
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -14,44 +28,97 @@ using namespace std;
 #include <cassert>
 
 
-static bool UsePointerVersion = true;
+static const char* EngineName = "pointer";		// See Solver.h.
 static bool NonSharpPreference = false;
+static bool MinimizeCost = false;
+static bool RestoreCheck = false;	// Check backtracking in a release build too.
+static bool Locality = false;		// Renumber the problem at setup. See Locality.h.
+static ValueOrderPolicy Ordering = vo_Input;	// Sort each item's sequences. See ValueOrder.h.
+static unsigned OrderingSeed = 1;
+static HugePageMode HugePages = hp_Off;		// For the cells. See PageArena.h.
+static bool FirstTouch = false;
+static int TimeLimit = 0;		// In seconds, or 0 to let the search finish.
+static int BatchCount = 0;		// Problems to solve with BatchSolver, or 0 for the usual single problem.
+static const char* ProblemCacheDir = nullptr;	// Keep generated problems here. See ProblemFile.h.
+static const char* DlxFile = nullptr;			// Solve this problem in Knuth's format. See DlxFormat.h.
+static const char* DlxWriteFile = nullptr;		// Write the generated problem in his format instead of solving it.
+static const char* SolutionLogFile = nullptr;	// Log the solutions instead of printing them. See SolutionLog.h.
+static const char* SolutionLogDecodeFile = nullptr;	// Print the solutions in this log instead of searching.
+
+// Binary trace of the pointer search. See Trace.h:
+static const char* TraceFile = nullptr;
+static const char* TraceDecodeFile = nullptr;	// Print this trace instead of searching.
+static int TraceSize = 1 << 20;		// Records kept.
+static int TraceMinLevel = 0;
+static int TraceMaxLevel = INT_MAX;
+
+// Counts by level. See SearchProfile.h:
+static bool Profile = false;
+static const char* ProfileFile = nullptr;		// Also write the counts here as CSV.
+
+static bool PerfCounting = false;	// Hardware counters. See PerfCounters.h.
+
+// Benchmark suite. See Benchmark.h:
+static bool RunBenchmark = false;
+static bool QuickBenchmark = false;		// Leave out the workloads that take minutes.
+static int BenchmarkRepeats = 5;
+static const char* BenchmarkFile = nullptr;		// Write the results here as JSON.
+static const char* BenchmarkBaseline = nullptr;	// Compare with results written earlier.
+static double BenchmarkThreshold = 10;			// Percent slower that counts as a regression.
+static bool PrimitiveBenchmark = false;			// Time the primitives on the problem instead of searching.
+
+// Differential fuzzing of the engines. See DifferentialFuzz.h:
+static double FuzzSeconds = 0;				// Time budget, or 0 to not fuzz.
+static long long FuzzCount = LLONG_MAX;		// Problems to try.
+static uint32_t FuzzSeed = 1;
+
+// Sharded search. See ShardedSearch.h:
+enum ShardCommands
+{
+	sc_None,
+	sc_Manifest,
+	sc_Worker,
+	sc_Merge,
+};
+static ShardCommands ShardCommand = sc_None;
+static int ShardDepth = 2;
+static int ShardWorker = 0;
+static int ShardWorkerCount = 1;
+
+// Local solver daemon. See SolverDaemon.h:
+enum DaemonCommands
+{
+	dc_None,
+	dc_Serve,
+	dc_Client,		// Solve the problem with the daemon instead of in this process.
+	dc_Status,
+	dc_Stop,
+};
+static DaemonCommands DaemonCommand = dc_None;
+static const char* DaemonSocket = "knuth_solver.sock";
+static int DaemonThreads = 0;		// 0 for one per core.
 #ifdef NDEBUG
 static bool SmallWordList = false;
 #else
 static bool SmallWordList = true;
 #endif
 
-// Functions from MStringValues.cpp:
-bool exact_cover_with_multiplicities_and_colors(const ExactCoverWithMultiplicitiesAndColors& problem, 
-						vector<vector<int>>* presults, int max_results, bool non_sharp_preference = false);
-void print_exact_cover_with_multiplicities_and_colors_stats();
-
 class SimpleTester : public ExactCoverWithMultiplicitiesAndColors
 {
 public:
+	// Sequences that have to be in the solution:
+	vector<int> forced;
+
 	bool test()
 	{
 		vector<vector<int>> results;
 
-		if (UsePointerVersion)
-		{
-			AlgMPointer alg(*this);
-
-			bool b = alg.exactCover(&results, 20);
-			assert(b);
-			print_solution(results);
-			alg.showStats();
-			return b;
-		}
-		else
-		{
-			bool b = exact_cover_with_multiplicities_and_colors(*this, &results, 20);
-			assert(b);
-			print_solution(results);
-			print_exact_cover_with_multiplicities_and_colors_stats();
-			return b;
-		}
+		unique_ptr<Solver> psolver = create_solver(EngineName);
+		bool b = psolver->solve(*this, &results, 20, &forced);
+		assert(b);
+		print_solution(results);
+		psolver->showStats();
+		return b;
 	}
 };
 
@@ -188,6 +255,43 @@ public:
 	}
 };
 ///////////////////////////////////////////////////////////////////////////////
+class SimpleCosted : public SimpleTester
+{
+	// Two items, covered together or one at a time, at different costs. The solutions,
+	// with their costs, are {0} 5, {1 2} 4, {1 4} 2, {3 2} 5 and {3 4} 3.
+public:
+	SimpleCosted()
+	{
+		primary_options.resize(2);
+		primary_options[0] = { "A", 1, 1 };
+		primary_options[1] = { "B", 1, 1 };
+
+		sequences = { { "A", "B" }, { "A" }, { "B" }, { "A" }, { "B" } };
+		costs = { 5, 1, 3, 2, 1 };
+	}
+
+	// Keeps the cheapest max_results solutions, which have to be the expected ones, in the
+	// same order, with the expected costs:
+	bool testCosts(int max_results, const vector<vector<int>>& expected, const vector<long long>& expected_costs)
+	{
+		unique_ptr<Solver> psolver = create_solver(EngineName);
+		if (!psolver->canMinimizeCost())
+			psolver = create_solver("pointer");
+		SolverOptions options;
+		options.MinimizeCost = true;
+		options.Verbose = false;
+		psolver->setOptions(options);
+
+		vector<vector<int>> results;
+		psolver->solve(*this, &results, max_results);
+
+		// The order of the sequences within a solution depends on the search:
+		for (auto& result : results)
+			sort(result.begin(), result.end());
+		return results == expected && psolver->solutionCosts() == expected_costs;
+	}
+};
+///////////////////////////////////////////////////////////////////////////////
 
 void test()
 {
@@ -252,51 +356,597 @@ void test()
 		assert(sc.test());
 	}
 #endif
+#if PREVIOUS
+	{
+		// q x:A is part of the only solution, so forcing it should give the same result:
+		SimpleColoring sc;
+		sc.forced.push_back(3);
+		assert(sc.test());
+	}
+#endif
+#if PREVIOUS
+	{
+		// The cheapest solution, then the three cheapest, cheapest first:
+		SimpleCosted sc;
+		assert(sc.testCosts(1, { { 1, 4 } }, { 2 }));
+		assert(sc.testCosts(3, { { 1, 4 }, { 3, 4 }, { 1, 2 } }, { 2, 3, 4 }));
+	}
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Runs the current shard command. Returns true if there are results to report, which
+// is only the case for the merge step. The costs are only wanted when pcosts is set.
+static bool sharded_search(const ExactCoverWithMultiplicitiesAndColors& problem, const char* pbase_name,
+	int max_results, vector<vector<int>>* presults, vector<long long>* pcosts)
+{
+	if (ShardCommand == sc_Merge)
+	{
+		vector<long long> costs;
+		bool b = merge_shards(problem, pbase_name, presults, &costs) && presults->size() > 0;
+		if (pcosts)
+			pcosts->swap(costs);
+		return b;
+	}
+
+	AlgMPointer alg(problem);
+	alg.setHeuristic(NonSharpPreference);
+	alg.setMinimizeCost(MinimizeCost);
+	if (RestoreCheck)
+		alg.setRestoreCheck(true);
+
+	if (ShardCommand == sc_Manifest)
+	{
+		write_shard_manifest(alg, problem, ShardDepth, max_results, pbase_name);
+	}
+	else
+	{
+		solve_shards(alg, problem, ShardWorker, ShardWorkerCount, pbase_name);
+	}
+	return false;
+}
+///////////////////////////////////////////////////////////////////////////////
+static bool remote_search(const ExactCoverWithMultiplicitiesAndColors& problem, int max_results,
+	vector<vector<int>>* presults, vector<long long>* pcosts)
+{
+	int flags = (NonSharpPreference ? df_NonSharpPreference : 0) | (MinimizeCost ? df_MinimizeCost : 0);
+
+	RemoteStats stats;
+	if (!solve_remote(DaemonSocket, problem, max_results, flags, presults, pcosts, &stats))
+		return false;
+
+	cout << "The solver daemon found " << stats.Solutions << " solutions." << endl;
+	if (stats.Cancelled)
+		cout << "\tThe search was cancelled before it was complete." << endl;
+	cout << "\tTime used (microseconds): " << stats.QueueTime << " queued, " << stats.SetupTime << " for setup and " <<
+		stats.RunTime << " to run, " << stats.Latency << " in all." << endl;
+	cout << "\tLoop ran " << stats.LoopCount << " times." << endl;
+	return presults->size() > 0;
 }
+///////////////////////////////////////////////////////////////////////////////
+// Opened on first use and kept for the rest of the run. Null unless requested:
+static PerfCounters* perf_counters()
+{
+	if (!PerfCounting)
+		return nullptr;
 
+	static PerfCounters counters;
+	return &counters;
+}
+///////////////////////////////////////////////////////////////////////////////
+// Solves the problem with the engine picked by the arguments, and shows its stats.
+// With a time limit, the search runs asynchronously and is cancelled if it takes
+// too long. Whatever solutions it found are still returned. With a trace file, the
+// last steps of the search are written to it.
+template<class Problem>
+static bool engine_search(const Problem& problem, int max_results,
+							vector<vector<int>>* presults, vector<long long>* pcosts, SearchProfile* pprofile)
+{
+	unique_ptr<Solver> psolver = create_solver(EngineName);
+
+	SolverOptions options;
+	options.NonSharpPreference = NonSharpPreference;
+	options.MinimizeCost = MinimizeCost;
+	options.RestoreCheck = RestoreCheck;
+	options.Locality = Locality;
+	options.Ordering = Ordering;
+	options.OrderingSeed = OrderingSeed;
+	options.HugePages = HugePages;
+	options.FirstTouch = FirstTouch;
+	options.pProfile = Profile ? pprofile : nullptr;
+	options.pPerf = perf_counters();
+
+	if (MinimizeCost && !psolver->canMinimizeCost())
+		cout << "Minimum cost search requires the pointer version." << endl;
+
+	TraceBuffer trace;
+	if (TraceFile)
+	{
+		if (!psolver->canTrace())
+			cout << "Tracing requires the pointer version." << endl;
+		trace.start(TraceSize, TraceMinLevel, TraceMaxLevel);
+		options.pTrace = &trace;
+	}
+
+	atomic<bool> cancel(false);
+	if (TimeLimit <= 0)
+	{
+		psolver->setOptions(options);
+		psolver->solve(problem, presults, max_results);
+	}
+	else
+	{
+		// The counters would only see this thread waiting:
+		options.pPerf = nullptr;
+		options.pCancel = &cancel;
+		psolver->setOptions(options);
+
+		future<bool> search = async(launch::async, [&]() { return psolver->solve(problem, presults, max_results); });
+
+		if (search.wait_for(chrono::seconds(TimeLimit)) == future_status::timeout)
+		{
+			cout << "Cancelling the search after " << TimeLimit << " seconds." << endl;
+			cancel.store(true);
+		}
+		search.get();
+	}
+
+	if (TraceFile && psolver->canTrace())
+	{
+		if (trace.write(TraceFile, problem_hash(problem)))
+			cout << "Wrote the last " << min<uint64_t>(trace.recorded(), trace.capacity()) << " of " << trace.recorded() <<
+				" trace records to " << TraceFile << "." << endl;
+	}
+
+	psolver->showStats();
+	if (pcosts)
+		*pcosts = psolver->solutionCosts();
+	return presults->size() > 0;
+}
+///////////////////////////////////////////////////////////////////////////////
+static void show_profile(const SearchProfile& profile)
+{
+	cout << "Search profile by level:" << endl;
+	profile.print();
+
+	if (ProfileFile && profile.writeCsv(ProfileFile))
+		cout << "Wrote the profile to " << ProfileFile << "." << endl;
+}
+///////////////////////////////////////////////////////////////////////////////
+// Times the primitives of both engines on the problem.
+static void benchmark_primitives(const ExactCoverWithMultiplicitiesAndColors& problem)
+{
+#ifndef NDEBUG
+	cout << "This is a debug build, so the times won't mean much." << endl;
+#endif
+	vector<PrimitiveTiming> timings;
+
+	AlgMPointer alg;
+	alg.setVerbose(false);
+	alg.reset(problem);
+	if (!alg.benchmarkPrimitives(BenchmarkRepeats, &timings))
+		cout << "The pointer version's primitives didn't restore the structure!" << endl;
+	format_primitive_timings("pointer", BenchmarkRepeats, timings);
+
+	if (!benchmark_exact_cover_with_multiplicities_and_colors_primitives(problem, BenchmarkRepeats, &timings))
+		cout << "The basic version's primitives didn't restore the structure!" << endl;
+	format_primitive_timings("basic", BenchmarkRepeats, timings);
+}
+///////////////////////////////////////////////////////////////////////////////
+// Whether the run uses something that only works on the problem with names. If not, the
+// generators stream the numbered problem, which never has a vector or a name for each
+// cell, and the engine sets up straight from the generator, so only it holds the cells:
+static bool needs_names()
+{
+	return TraceDecodeFile || PrimitiveBenchmark || ShardCommand != sc_None || DaemonCommand != dc_None ||
+		Locality || Ordering != vo_Input;
+}
+///////////////////////////////////////////////////////////////////////////////
+// Fills in the cells of a streamed problem, e.g. to print solutions once the engine is
+// done with it. The basic version keeps its buffers between searches, so they're freed
+// first, or the cells would be held twice after all:
+static void fill_cells(CompactExactCover* pproblem)
+{
+	if (!pproblem->streamed())
+		return;
+
+	free_exact_cover_with_multiplicities_and_colors_buffers();
+	pproblem->fillCells();
+}
+///////////////////////////////////////////////////////////////////////////////
+static void write_dlx_problem(const CompactExactCover& problem)
+{
+	if (write_dlx_file(DlxWriteFile, problem))
+		cout << "Wrote " << problem.sequences() << " options to " << DlxWriteFile << "." << endl;
+}
+
+static void write_dlx_problem(const ExactCoverWithMultiplicitiesAndColors& problem)
+{
+	CompactExactCover compact;
+	compact.assign(problem);
+	write_dlx_problem(compact);
+}
+///////////////////////////////////////////////////////////////////////////////
+template<class Problem>
+static void write_solutions(const Problem& problem, const vector<vector<int>>& results, const vector<long long>& costs)
+{
+	cout << "Found " << results.size() << " solutions:" << endl;
+	for (int idx = 0; idx < results.size(); idx++)
+	{
+		cout << "Solution:" << endl;
+		if (idx < costs.size())
+			cout << "Cost " << costs[idx] << endl;
+		for (int i : results[idx])
+			problem.format_sequence(i, cout);
+		cout << "(end solution)" << endl;
+	}
+}
+///////////////////////////////////////////////////////////////////////////////
+static int sequence_count(const CompactExactCover& problem)
+{
+	return problem.sequences();
+}
+
+static int sequence_count(const ExactCoverWithMultiplicitiesAndColors& problem)
+{
+	return (int)problem.sequences.size();
+}
+///////////////////////////////////////////////////////////////////////////////
+template<class Problem>
+static void log_solutions(const Problem& problem, const vector<vector<int>>& results)
+{
+	SolutionLogWriter log;
+	if (!log.open(SolutionLogFile, problem_hash(problem), sequence_count(problem)))
+		return;
+
+	for (auto& result : results)
+		log.add(result);
+	if (log.close())
+		cout << "Logged " << log.solutions() << " solutions to " << SolutionLogFile << " in " << log.bytes() << " bytes." << endl;
+}
+
+// The solutions in the log, to print as if the search had just found them:
+template<class Problem>
+static bool logged_solutions(const Problem& problem, vector<vector<int>>* presults)
+{
+	return read_solution_log(SolutionLogDecodeFile, problem_hash(problem), sequence_count(problem), presults) &&
+		presults->size() > 0;
+}
+// Reads a problem in Knuth's format and solves it as it is, so his test files and those
+// of other solvers can be compared with the engines here:
+static bool dlx_problem()
+{
+	auto start_time = chrono::high_resolution_clock::now();
+
+	DlxReader reader;
+	if (!reader.read(DlxFile))
+	{
+		cout << reader.error() << endl;
+		return false;
+	}
+	const CompactExactCover& problem = reader.problem();
+
+	auto end_time = chrono::high_resolution_clock::now();
+	cout << "Read " << problem.items() << " items and " << problem.sequences() << " options from " << DlxFile << " in " <<
+		chrono::duration_cast<chrono::microseconds>(end_time - start_time).count() << " microseconds." << endl;
+
+	vector<vector<int>> results;
+	vector<long long> costs;
+	SearchProfile profile;
+	bool b;
+	if (SolutionLogDecodeFile)
+		b = logged_solutions(problem, &results);
+	else
+		b = engine_search(problem, MinimizeCost ? 5 : 100, &results, &costs, &profile);
+
+	if (Profile)
+		show_profile(profile);
+
+	if (SolutionLogFile)
+		log_solutions(problem, results);
+	else if (b)
+		write_solutions(problem, results, costs);
+	else
+		cout << "The problem has no solutions." << endl;
+	return true;
+}
+///////////////////////////////////////////////////////////////////////////////
+static void compact_partridge_problem(PartridgePuzzle& puzzle)
+{
+	CompactExactCover problem;
+	puzzle.streamProblem(&problem);
+
+	if (DlxWriteFile)
+	{
+		fill_cells(&problem);
+		write_dlx_problem(problem);
+		return;
+	}
+
+	vector<vector<int>> results;
+	SearchProfile profile;
+	bool b;
+	if (SolutionLogDecodeFile)
+		b = logged_solutions(problem, &results);
+	else
+		b = engine_search(problem, 8, &results, nullptr, &profile);
+
+	if (Profile)
+		show_profile(profile);
+
+	if (SolutionLogFile)
+	{
+		log_solutions(problem, results);
+	}
+	else if (b)
+	{
+		fill_cells(&problem);
+		write_solutions(problem, results, vector<long long>());
+	}
+	else
+	{
+		cout << "Puzzle cannot be solved." << endl;
+	}
+}
 ///////////////////////////////////////////////////////////////////////////////
 void partridge_problem()
 {
 	PartridgePuzzle puzzle(8);
 
+	if (!needs_names())
+	{
+		compact_partridge_problem(puzzle);
+		return;
+	}
+
 	ExactCoverWithMultiplicitiesAndColors problem;
 
 	puzzle.generateProblem(&problem);
 
+	if (DlxWriteFile)
+	{
+		write_dlx_problem(problem);
+		return;
+	}
+	if (TraceDecodeFile)
+	{
+		decode_trace(TraceDecodeFile, problem);
+		return;
+	}
+	if (PrimitiveBenchmark)
+	{
+		benchmark_primitives(problem);
+		return;
+	}
+
 	vector<vector<int>> results;
+	SearchProfile profile;
 	
 	// There are over 1000 solution, which would take a long time.
 	bool b;
-	if (UsePointerVersion)
+	if (SolutionLogDecodeFile)
+	{
+		b = logged_solutions(problem, &results);
+	}
+	else if (ShardCommand != sc_None)
+	{
+		b = sharded_search(problem, "partridge", 8, &results, nullptr);
+		if (ShardCommand != sc_Merge)
+			return;
+	}
+	else if (DaemonCommand == dc_Client)
+	{
+		b = remote_search(problem, 8, &results, nullptr);
+	}
+	else
 	{
-		AlgMPointer alg(problem);
-		b = alg.exactCover(&results, 8);
-		alg.setHeuristic(NonSharpPreference);
-		alg.showStats();
+		b = engine_search(problem, 8, &results, nullptr, &profile);
 	}
+
+	if (Profile)
+		show_profile(profile);
+
+	if (SolutionLogFile)
+		log_solutions(problem, results);
+	else if (b)
+		write_solutions(problem, results, vector<long long>());
 	else
 	{
-		b = exact_cover_with_multiplicities_and_colors(problem, &results, 8, NonSharpPreference);
-		print_exact_cover_with_multiplicities_and_colors_stats();
+		cout << "Puzzle cannot be solved." << endl;
+	}
+}
+///////////////////////////////////////////////////////////////////////////////
+// Lots of small problems: the partridge puzzles up to size 4, over and over.
+void batch_problems()
+{
+	const int sizes = 4;
+	vector<PartridgePuzzle> puzzles;
+	for (int n = 1; n <= sizes; n++)
+		puzzles.emplace_back(n);
+
+	BatchSolver solver(EngineName, NonSharpPreference);
+
+	solver.run(
+		[&puzzles](int idx_problem, ExactCoverWithMultiplicitiesAndColors* pproblem)
+		{
+			if (idx_problem >= BatchCount)
+				return false;
+
+			pproblem->primary_options.clear();
+			pproblem->sequences.clear();
+			puzzles[idx_problem % sizes].generateProblem(pproblem);
+			return true;
+		},
+		1, nullptr);
+
+	solver.Stats.format(cout);
+}
+///////////////////////////////////////////////////////////////////////////////
+// Runs both engines on a fixed set of problems. Returns false if the baseline couldn't be
+// read or some cases got slower than it.
+bool benchmark_problems()
+{
+#ifndef NDEBUG
+	cout << "This is a debug build, so the times won't mean much." << endl;
+#endif
+#ifdef ENABLE_TRACE
+	EnableTrace = false;
+#endif
+
+	vector<BenchmarkResult> baseline;
+	if (BenchmarkBaseline && !BenchmarkSuite::readJson(BenchmarkBaseline, &baseline))
+		return false;
+
+	BenchmarkSuite suite;
+
+	// The problems point into the puzzles and word lists, so they all live until the suite is done:
+	const int max_partridge = QuickBenchmark ? 6 : 8;
+	vector<PartridgePuzzle> puzzles;
+	vector<ExactCoverWithMultiplicitiesAndColors> partridge_problems(max_partridge + 1);
+	for (int n = 4; n <= max_partridge; n++)
+		puzzles.emplace_back(n);
+	for (int n = 4; n <= max_partridge; n++)
+	{
+		puzzles[n - 4].generateProblem(&partridge_problems[n]);
+		suite.add("partridge " + to_string(n), partridge_problems[n], 8);
+	}
+
+	WordRectangle small_words, big_words;
+	ExactCoverWithMultiplicitiesAndColors small_word_problem, big_word_problem;
+	if (!small_words.readWords("test_words.txt"))
+		return false;
+	small_words.generateProblem(&small_word_problem);
+	suite.add("word test_words", small_word_problem, 100);
+	if (!QuickBenchmark)
+	{
+		if (!big_words.readWords("20k_words.txt"))
+			return false;
+		big_words.generateProblem(&big_word_problem);
+		suite.add("word 20k_words", big_word_problem, 100);
 	}
 
-	if (b)
+	// The same problems as test():
+	SimpleA a, a_232(2, 3, 2), a_233(2, 3, 3), a_2610(2, 6, 10);
+	SimpleAB ab_1111(1, 1, 1, 1), ab_2311(2, 3, 1, 1), ab_2323(2, 3, 2, 3);
+	SimpleABPair ab_pair(3, 6, 3, 3);
+	SimpleColoring coloring;
+	suite.add("simple A", a, 20);
+	suite.add("simple A 2 3 2", a_232, 20);
+	suite.add("simple A 2 3 3", a_233, 20);
+	suite.add("simple AB 1 1 1 1", ab_1111, 20);
+	suite.add("simple AB 2 3 1 1", ab_2311, 20);
+	suite.add("simple A 2 6 10", a_2610, 20);
+	suite.add("simple AB 2 3 2 3", ab_2323, 20);
+	suite.add("simple AB pair 3 6 3 3", ab_pair, 20);
+	suite.add("simple coloring", coloring, 20);
+
+	suite.run(BenchmarkRepeats);
+
+	if (BenchmarkFile && suite.writeJson(BenchmarkFile))
+		cout << "Wrote the benchmark results to " << BenchmarkFile << "." << endl;
+
+	if (BenchmarkBaseline)
+		return suite.compare(baseline, BenchmarkThreshold) == 0;
+	return true;
+}
+///////////////////////////////////////////////////////////////////////////////
+template<class Problem>
+static void write_rectangles(WordRectangle& word_rectangle, const Problem& problem, bool found,
+							const vector<vector<int>>& results, const vector<long long>& costs)
+{
+	if (found)
 	{
-		cout << "Found " << results.size() << " solutions:" << endl;
+		cout << results.size() << " word rectangle(s) found" << endl;
+
 		for (int idx = 0; idx < results.size(); idx++)
 		{
-			cout << "Solution:" << endl;
-			const vector<int>& result = results[idx];
-			for (int i = 0; i < result.size(); i++)
+			const vector<int> &result = results[idx];
+
+			cout << "Rectangle:" << endl << endl;
+			if (idx < costs.size())
+				cout << "Cost " << costs[idx] << endl << endl;
+			word_rectangle.writeRectangle(problem, result);
+			cout << endl;
+		}
+	}
+	else
+	{
+		cout << "Words cannot be placed." << endl;
+	}
+}
+///////////////////////////////////////////////////////////////////////////////
+// Streams the problem numbered, or with a cache, maps it from there, generating and
+// storing it the first time, and searches it as it is:
+static void compact_word_rectangle_problem(WordRectangle& word_rectangle)
+{
+	auto start_time = chrono::high_resolution_clock::now();
+
+	MappedProblem mapped;
+	CompactExactCover compact;
+	const CompactExactCover* pproblem = &compact;
+
+	if (!ProblemCacheDir)
+	{
+		word_rectangle.streamProblem(&compact);
+		cout << "Problem generated";
+	}
+	else
+	{
+		ProblemCache cache(ProblemCacheDir);
+		unsigned long long key = word_rectangle.problemKey();
+		string file_name = cache.fileName(key);
+
+		if (cache.load(key, &mapped))
+		{
+			pproblem = &mapped.problem();
+			cout << "Problem loaded from " << file_name;
+		}
+		else
+		{
+			word_rectangle.generateProblem(&compact);
+
+			// The search can still use the problem just generated:
+			if (cache.store(key, compact) && cache.load(key, &mapped))
 			{
-				problem.format_sequence(result[i], cout);
+				pproblem = &mapped.problem();
+				cout << "Problem generated and cached in " << file_name;
+			}
+			else
+			{
+				cout << "Problem generated";
 			}
-			cout << "(end solution)" << endl;
 		}
 	}
+	auto end_time = chrono::high_resolution_clock::now();
+	cout << " in " << chrono::duration_cast<chrono::microseconds>(end_time - start_time).count() << " microseconds." << endl;
+
+	if (DlxWriteFile)
+	{
+		fill_cells(&compact);
+		write_dlx_problem(*pproblem);
+		return;
+	}
+
+	vector<vector<int>> results;
+	vector<long long> costs;
+	SearchProfile profile;
+	bool b;
+	if (SolutionLogDecodeFile)
+		b = logged_solutions(*pproblem, &results);
+	else
+		b = engine_search(*pproblem, MinimizeCost ? 5 : 100, &results, &costs, &profile);
+
+	if (Profile)
+		show_profile(profile);
+
+	if (SolutionLogFile)
+	{
+		log_solutions(*pproblem, results);
+	}
 	else
 	{
-		cout << "Puzzle cannot be solved." << endl;
+		fill_cells(&compact);
+		write_rectangles(word_rectangle, *pproblem, b, results, costs);
 	}
 }
 ///////////////////////////////////////////////////////////////////////////////
@@ -311,46 +961,66 @@ void word_rectangle_problem()
 	assert(b);
 	cout << "Word list read successfully." << endl;
 
+	// The cache only holds the numbered problem, so it's only used along with it:
+	if (!needs_names())
+	{
+		compact_word_rectangle_problem(word_rectangle);
+		return;
+	}
+
 	ExactCoverWithMultiplicitiesAndColors problem;
 	word_rectangle.generateProblem(&problem);
 
 	cout << "Problem generated." << endl;
 
-	vector<vector<int>> results;
-
-	if (UsePointerVersion)
+	if (DlxWriteFile)
 	{
-		AlgMPointer alg(problem);
-		alg.setHeuristic(NonSharpPreference);
-		b = alg.exactCover(&results, 100);
-		alg.showStats();
+		write_dlx_problem(problem);
+		return;
 	}
-	else
+	if (TraceDecodeFile)
 	{
-		b = exact_cover_with_multiplicities_and_colors(problem, &results, 100,
-			NonSharpPreference
-		);
-		print_exact_cover_with_multiplicities_and_colors_stats();
+		decode_trace(TraceDecodeFile, problem);
+		return;
 	}
-
-	if (b)
+	if (PrimitiveBenchmark)
 	{
-		cout << results.size() << " word rectangle(s) found" << endl;
+		benchmark_primitives(problem);
+		return;
+	}
 
-		for (int idx = 0; idx < results.size(); idx++)
-		{
-			const vector<int> &result = results[idx];
+	vector<vector<int>> results;
+	vector<long long> costs;
+	SearchProfile profile;
 
-			cout << "Rectangle:" << endl << endl;
-			word_rectangle.writeRectangle(problem, result);
-			cout << endl;
-		}
+	if (SolutionLogDecodeFile)
+	{
+		b = logged_solutions(problem, &results);
+	}
+	else if (ShardCommand != sc_None)
+	{
+		b = sharded_search(problem, "word_rectangle", MinimizeCost ? 5 : 100, &results, &costs);
+		if (ShardCommand != sc_Merge)
+			return;
+	}
+	else if (DaemonCommand == dc_Client)
+	{
+		b = remote_search(problem, MinimizeCost ? 5 : 100, &results, &costs);
 	}
 	else
 	{
-		cout << "Words cannot be placed." << endl;
+		// When minimizing, the cost of a rectangle is the sum of its word ranks, so we
+		// get the rectangles made of the most common words:
+		b = engine_search(problem, MinimizeCost ? 5 : 100, &results, &costs, &profile);
 	}
 
+	if (Profile)
+		show_profile(profile);
+
+	if (SolutionLogFile)
+		log_solutions(problem, results);
+	else
+		write_rectangles(word_rectangle, problem, b, results, costs);
 }
 ///////////////////////////////////////////////////////////////////////////////
 int main(int argc, char *argv[])
@@ -362,10 +1032,98 @@ int main(int argc, char *argv[])
 	bool partridge = true;
 	for (int i = 1; i < argc; i++)
 	{
-		if (strstr(argv[i], "pointer") != nullptr)
-			UsePointerVersion = true;
+		// The trace arguments take file names, so check them before anything a name could contain:
+		if (strstr(argv[i], "trace=") == argv[i])		// e.g. trace=search.trace
+			TraceFile = argv[i] + 6;
+		else if (strstr(argv[i], "tracedecode=") == argv[i])
+			TraceDecodeFile = argv[i] + 12;
+		else if (strstr(argv[i], "tracesize=") == argv[i])	// e.g. tracesize=100000
+			TraceSize = atoi(argv[i] + 10);
+		else if (strstr(argv[i], "tracelevels=") == argv[i])	// e.g. tracelevels=3-5
+		{
+			if (sscanf_s(argv[i] + 12, "%i-%i", &TraceMinLevel, &TraceMaxLevel) != 2 || TraceMinLevel > TraceMaxLevel)
+			{
+				cout << "Expected tracelevels=min-max." << endl;
+				return -1;
+			}
+		}
+		// File names could contain the other arguments, so these go first too:
+		else if (strstr(argv[i], "cache=") == argv[i])		// e.g. cache=problems, see ProblemFile.h
+			ProblemCacheDir = argv[i] + 6;
+		else if (strcmp(argv[i], "cache") == 0)
+			ProblemCacheDir = "problem_cache";
+		else if (strstr(argv[i], "dlx=") == argv[i])		// e.g. dlx=queens.dlx, see DlxFormat.h
+			DlxFile = argv[i] + 4;
+		else if (strstr(argv[i], "dlxwrite=") == argv[i])
+			DlxWriteFile = argv[i] + 9;
+		else if (strstr(argv[i], "solutions=") == argv[i])		// e.g. solutions=partridge.sol, see SolutionLog.h
+			SolutionLogFile = argv[i] + 10;
+		else if (strstr(argv[i], "solutionsdecode=") == argv[i])
+			SolutionLogDecodeFile = argv[i] + 16;
+		else if (strstr(argv[i], "socket=") == argv[i])		// e.g. socket=/tmp/knuth.sock
+			DaemonSocket = argv[i] + 7;
+		else if (strstr(argv[i], "engine=") == argv[i])		// e.g. engine=auto, see Solver.h
+			EngineName = argv[i] + 7;
+		else if (strstr(argv[i], "order=") == argv[i])		// e.g. order=fewest, see ValueOrder.h
+		{
+			if (!parse_value_order(argv[i] + 6, &Ordering))
+			{
+				cout << "Expected order=input, fewest, constraining, score or random." << endl;
+				return -1;
+			}
+		}
+		else if (strstr(argv[i], "orderseed=") == argv[i])	// for order=random
+			OrderingSeed = (unsigned)strtoul(argv[i] + 10, nullptr, 10);
+		else if (strstr(argv[i], "hugepages=") == argv[i])	// e.g. hugepages=transparent, see PageArena.h
+		{
+			if (!parse_huge_page_mode(argv[i] + 10, &HugePages))
+			{
+				cout << "Expected hugepages=off, transparent or explicit." << endl;
+				return -1;
+			}
+		}
+		else if (strstr(argv[i], "firsttouch") == argv[i])
+			FirstTouch = true;
+		else if (strstr(argv[i], "benchmark") == argv[i])
+			RunBenchmark = true;
+		else if (strstr(argv[i], "quick") == argv[i])
+			QuickBenchmark = true;
+		else if (strstr(argv[i], "fuzzcount=") == argv[i])	// e.g. fuzzcount=1 to repeat a failure
+		{
+			FuzzCount = atoll(argv[i] + 10);
+			FuzzSeconds = FuzzSeconds > 0 ? FuzzSeconds : 1e9;
+		}
+		else if (strstr(argv[i], "fuzz=") == argv[i])		// in seconds, e.g. fuzz=60
+			FuzzSeconds = atof(argv[i] + 5);
+		else if (strstr(argv[i], "fuzz") == argv[i])
+			FuzzSeconds = FuzzSeconds > 0 ? FuzzSeconds : 10;
+		else if (strstr(argv[i], "seed=") == argv[i])
+			FuzzSeed = (uint32_t)strtoul(argv[i] + 5, nullptr, 10);
+		else if (strstr(argv[i], "primitives") == argv[i])
+			PrimitiveBenchmark = true;
+		else if (strstr(argv[i], "repeat=") == argv[i])		// e.g. repeat=5
+			BenchmarkRepeats = max(1, atoi(argv[i] + 7));
+		else if (strstr(argv[i], "json=") == argv[i])		// e.g. json=bench.json
+			BenchmarkFile = argv[i] + 5;
+		else if (strstr(argv[i], "baseline=") == argv[i])
+			BenchmarkBaseline = argv[i] + 9;
+		else if (strstr(argv[i], "threshold=") == argv[i])	// in percent, e.g. threshold=5
+			BenchmarkThreshold = atof(argv[i] + 10);
+		else if (strstr(argv[i], "profile=") == argv[i])	// e.g. profile=levels.csv
+		{
+			Profile = true;
+			ProfileFile = argv[i] + 8;
+		}
+		else if (strstr(argv[i], "profile") != nullptr)
+			Profile = true;
+		else if (strstr(argv[i], "perfcounters") != nullptr)
+			PerfCounting = true;
+		else if (strstr(argv[i], "pointer") != nullptr)
+			EngineName = "pointer";
 		else if (strstr(argv[i], "basic") != nullptr)
-			UsePointerVersion = false;
+			EngineName = "basic";
+		else if (strstr(argv[i], "auto") != nullptr)
+			EngineName = "auto";
 		else if (strstr(argv[i], "test") != nullptr)
 			run_test = true;
 		else if (strstr(argv[i], "smallwordlist") != nullptr) // check before word
@@ -378,19 +1136,114 @@ int main(int argc, char *argv[])
 			partridge = true;
 		else if (strstr(argv[i], "nonsharp") != nullptr)
 			NonSharpPreference = true;
+		else if (strstr(argv[i], "mincost") != nullptr)
+			MinimizeCost = true;
+		else if (strstr(argv[i], "restorecheck") != nullptr)
+			RestoreCheck = true;
+		else if (strstr(argv[i], "locality") != nullptr)
+			Locality = true;
+		else if (strstr(argv[i], "shards=") == argv[i])		// e.g. shards=3
+		{
+			ShardCommand = sc_Manifest;
+			ShardDepth = atoi(argv[i] + 7);
+		}
+		else if (strstr(argv[i], "worker=") == argv[i])		// e.g. worker=2/8
+		{
+			ShardCommand = sc_Worker;
+			if (sscanf_s(argv[i] + 7, "%i/%i", &ShardWorker, &ShardWorkerCount) != 2 ||
+				ShardWorker < 0 || ShardWorker >= ShardWorkerCount)
+			{
+				cout << "Expected worker=<index>/<count>." << endl;
+				return -1;
+			}
+		}
+		else if (strstr(argv[i], "merge") != nullptr)
+			ShardCommand = sc_Merge;
+		else if (strstr(argv[i], "timeout=") == argv[i])	// e.g. timeout=60
+			TimeLimit = atoi(argv[i] + 8);
+		else if (strstr(argv[i], "batch=") == argv[i])		// e.g. batch=10000
+			BatchCount = atoi(argv[i] + 6);
+		else if (strstr(argv[i], "daemonstatus") != nullptr)	// check before daemon
+			DaemonCommand = dc_Status;
+		else if (strstr(argv[i], "daemonstop") != nullptr)
+			DaemonCommand = dc_Stop;
+		else if (strstr(argv[i], "daemon") != nullptr)
+			DaemonCommand = dc_Serve;
+		else if (strstr(argv[i], "client") != nullptr)
+			DaemonCommand = dc_Client;
+		else if (strstr(argv[i], "threads=") == argv[i])		// daemon workers, e.g. threads=4
+			DaemonThreads = atoi(argv[i] + 8);
 #ifdef ENABLE_TRACE
 		else if (strstr(argv[i], "notrace") != nullptr)
 			EnableTrace = true;
 #endif
 	}
 
+	if (!create_solver(EngineName))
+	{
+		cout << "There is no engine called " << EngineName << ". The engines are:";
+		for (auto& name : solver_names())
+			cout << " " << name;
+		cout << endl;
+		return -1;
+	}
+
 	if (run_test)
 	{
 		test();
 		return -1;
 	}
 
-	if (partridge)
+	if (DaemonCommand == dc_Serve)
+	{
+		int threads = DaemonThreads > 0 ? DaemonThreads : max(1, (int)thread::hardware_concurrency());
+		SolverDaemon daemon(DaemonSocket, threads);
+		return daemon.run() ? 0 : -1;
+	}
+	if (DaemonCommand == dc_Status)
+	{
+		DaemonStatus status;
+		if (!query_daemon(DaemonSocket, &status))
+			return -1;
+		status.format(cout);
+		return 0;
+	}
+	if (DaemonCommand == dc_Stop)
+	{
+		return stop_daemon(DaemonSocket) ? 0 : -1;
+	}
+
+	if (FuzzSeconds > 0)
+	{
+#ifdef ENABLE_TRACE
+		EnableTrace = false;
+#endif
+		DifferentialFuzzer fuzzer;
+		fuzzer.addDefaultEngines();
+		bool b = fuzzer.run(FuzzSeed, FuzzSeconds, FuzzCount);
+		free_exact_cover_with_multiplicities_and_colors_buffers();
+		return b ? 0 : -1;
+	}
+
+	if (RunBenchmark)
+	{
+		bool b = benchmark_problems();
+		free_exact_cover_with_multiplicities_and_colors_buffers();
+		return b ? 0 : -1;
+	}
+
+	if (DlxFile)
+	{
+		bool b = dlx_problem();
+		free_exact_cover_with_multiplicities_and_colors_buffers();
+		return b ? 0 : -1;
+	}
+
+	if (BatchCount > 0)
+	{
+		batch_problems();
+	}
+	else if (partridge)
 	{
 		partridge_problem();
 	}
@@ -399,6 +1252,7 @@ int main(int argc, char *argv[])
 		word_rectangle_problem();
 	}
 
+	free_exact_cover_with_multiplicities_and_colors_buffers();
 	assert(_CrtCheckMemory());
 	cout << "Done!\n";
 }